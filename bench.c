@@ -0,0 +1,536 @@
+/*
+MIT License
+
+Copyright (c) 2025 Julien Remmery
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/**
+ * Benchmarks of Fil against the libc equivalents.
+ * Each case is timed over BENCH_SAMPLES samples of enough calls to last
+ * BENCH_SAMPLE_NS, the results are written to stdout as JSON: latency per
+ * call in ns (min, p50, p90, p99, max over the samples) and throughput in
+ * GB/s at the median. param is the needle length, or the piece size of
+ * the append cases, hits the number of matches in the input.
+ * ./bench [filter] only runs the cases whose group or impl contains filter.
+ */
+
+#define _GNU_SOURCE
+#include "fil.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define BENCH_SAMPLES   31
+#define BENCH_SAMPLE_NS 500000.0
+#define BENCH_FILE      "tests/bench.tmp"
+
+/**
+ * Inputs of a case. hay is n random lowercase letters, null terminated,
+ * fil holds a copy. The Fil functions that change the Fil alternate
+ * between two replacements, flip tells which one is next.
+ */
+typedef struct {
+    const char *hay;
+    unsigned long n;
+    const char *needle;
+    unsigned long m;
+    char *dest;
+    Fil *fil;
+    const char *s[2];
+    const Fil_Pattern *pat[2];
+    const Fil_Dict *dict[2];
+    const Fil_ByteMap *map;
+    Fil_Pool *pool;
+    unsigned long piece;
+    int flip;
+} Bench;
+
+typedef void (*Bench_Fn)(Bench *b);
+
+static volatile unsigned long bench_sink;
+static const char *bench_filter;
+static int bench_first = 1;
+
+static double bench_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static int bench_cmp(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Time fn and print its result, bytes is the number of bytes one call goes
+ * through.
+ */
+static void bench_run(const char *group, const char *impl, Bench *b, unsigned long bytes,
+                      unsigned long hits, Bench_Fn fn)
+{
+    if (bench_filter && !strstr(group, bench_filter) && !strstr(impl, bench_filter)) return;
+
+    // Warm up, then double the calls per sample until a sample is long enough.
+    unsigned long iterations = 1;
+    double elapsed;
+    for (;;)
+    {
+        double start = bench_now();
+        for (unsigned long i = 0; i < iterations; i++) fn(b);
+        elapsed = bench_now() - start;
+        if (elapsed >= BENCH_SAMPLE_NS || iterations >= (1UL << 30)) break;
+        iterations *= 2;
+    }
+
+    double samples[BENCH_SAMPLES];
+    for (int s = 0; s < BENCH_SAMPLES; s++)
+    {
+        double start = bench_now();
+        for (unsigned long i = 0; i < iterations; i++) fn(b);
+        samples[s] = (bench_now() - start) / (double)iterations;
+    }
+    qsort(samples, BENCH_SAMPLES, sizeof(double), bench_cmp);
+
+    double p50 = samples[BENCH_SAMPLES / 2];
+    printf("%s\n    {\"group\": \"%s\", \"impl\": \"%s\", \"size\": %lu, \"param\": %lu, \"hits\": %lu, "
+           "\"iterations\": %lu, \"gbps\": %.3f, \"ns\": {\"min\": %.1f, \"p50\": %.1f, \"p90\": %.1f, "
+           "\"p99\": %.1f, \"max\": %.1f}}",
+           bench_first ? "" : ",", group, impl, b->n, b->m, hits, iterations,
+           p50 > 0 ? (double)bytes / p50 : 0.0, samples[0], p50, samples[BENCH_SAMPLES * 9 / 10],
+           samples[BENCH_SAMPLES * 99 / 100], samples[BENCH_SAMPLES - 1]);
+    bench_first = 0;
+    fflush(stdout);
+}
+
+static unsigned long bench_seed = 88172645463325252UL;
+
+static unsigned long bench_random(void)
+{
+    bench_seed ^= bench_seed << 13;
+    bench_seed ^= bench_seed >> 7;
+    bench_seed ^= bench_seed << 17;
+    return bench_seed;
+}
+
+/**
+ * n random lowercase letters with mark written every gap bytes, gap 0 for
+ * none. Returns the number of marks.
+ */
+static unsigned long bench_fill(char *hay, unsigned long n, const char *mark, unsigned long gap)
+{
+    unsigned long hits = 0;
+    for (unsigned long i = 0; i < n; i++) hay[i] = (char)('a' + bench_random() % 26);
+    hay[n] = 0;
+    if (!gap) return 0;
+
+    unsigned long m = strlen(mark);
+    for (unsigned long i = gap / 2; i + m <= n; i += gap)
+    {
+        memcpy(hay + i, mark, m);
+        hits++;
+    }
+    return hits;
+}
+
+/**
+ * Needle of m random letters ending with a byte the hay never has, so it
+ * is never found but its prefixes are.
+ */
+static void bench_needle(char *needle, unsigned long m)
+{
+    for (unsigned long i = 0; i + 1 < m; i++) needle[i] = (char)('a' + bench_random() % 26);
+    needle[m - 1] = '!';
+    needle[m] = 0;
+}
+
+static void bench_reset(Bench *b)
+{
+    Fil_free(b->fil);
+    Fil_append_v(b->fil, (Fil_View){b->hay, b->n});
+    b->flip = 0;
+}
+
+static void bench_fil_len(Bench *b) { bench_sink += Fil_len(b->hay); }
+static void bench_strlen(Bench *b) { bench_sink += strlen(b->hay); }
+static void bench_fil_cpy(Bench *b) { bench_sink += Fil_cpy(b->dest, b->hay); }
+static void bench_strcpy(Bench *b) { bench_sink += (unsigned long)strcpy(b->dest, b->hay)[0]; }
+static void bench_memcpy(Bench *b) { bench_sink += (unsigned long)((char *)memcpy(b->dest, b->hay, b->n + 1))[0]; }
+
+static void bench_fil_append(Bench *b)
+{
+    Fil fil = {0};
+    char piece[4097];
+    memcpy(piece, b->hay, b->piece);
+    piece[b->piece] = 0;
+    for (unsigned long done = 0; done < b->n; done += b->piece) Fil_append(&fil, piece);
+    bench_sink += fil.len;
+    Fil_free(&fil);
+}
+
+static void bench_fil_append_v(Bench *b)
+{
+    Fil fil = {0};
+    for (unsigned long done = 0; done < b->n; done += b->piece) Fil_append_v(&fil, (Fil_View){b->hay + done, b->piece});
+    bench_sink += fil.len;
+    Fil_free(&fil);
+}
+
+static void bench_memcpy_pieces(Bench *b)
+{
+    for (unsigned long done = 0; done < b->n; done += b->piece) memcpy(b->dest + done, b->hay + done, b->piece);
+    bench_sink += (unsigned long)b->dest[0];
+}
+
+static void bench_fil_sfstr(Bench *b) { bench_sink += (unsigned long)Fil_sfstr(b->fil, b->needle); }
+static void bench_fil_sfstr_v(Bench *b) { bench_sink += Fil_sfstr_v((Fil_View){b->hay, b->n}, (Fil_View){b->needle, b->m}); }
+static void bench_memmem(Bench *b) { bench_sink += (unsigned long)memmem(b->hay, b->n, b->needle, b->m); }
+static void bench_strstr(Bench *b) { bench_sink += (unsigned long)strstr(b->hay, b->needle); }
+static void bench_fil_slstr(Bench *b) { bench_sink += (unsigned long)Fil_slstr(b->fil, b->needle); }
+static void bench_fil_sfpat(Bench *b) { bench_sink += (unsigned long)Fil_sfpat(b->fil, b->pat[0]); }
+static void bench_fil_sfstr_ci(Bench *b) { bench_sink += (unsigned long)Fil_sfstr_ci(b->fil, b->needle); }
+static void bench_strcasestr(Bench *b) { bench_sink += (unsigned long)strcasestr(b->hay, b->needle); }
+static void bench_fil_sistr(Bench *b) { bench_sink += (unsigned long)Fil_sistr(b->fil, b->needle, ~0UL); }
+
+static void bench_memmem_all(Bench *b)
+{
+    const char *p = b->hay;
+    const char *end = b->hay + b->n;
+    while ((p = memmem(p, (size_t)(end - p), b->needle, b->m))) p += b->m;
+    bench_sink += (unsigned long)end;
+}
+
+static void bench_fil_count_par(Bench *b)
+{
+    unsigned long count = 0;
+    Fil_count_str_par(b->pool, (Fil_View){b->hay, b->n}, (Fil_View){b->needle, b->m}, &count);
+    bench_sink += count;
+}
+
+static void bench_fil_sfchr(Bench *b) { bench_sink += (unsigned long)Fil_sfchr(b->fil, '!'); }
+static void bench_memchr(Bench *b) { bench_sink += (unsigned long)memchr(b->hay, '!', b->n); }
+static void bench_fil_slchr(Bench *b) { bench_sink += (unsigned long)Fil_slchr(b->fil, '!'); }
+static void bench_memrchr(Bench *b) { bench_sink += (unsigned long)memrchr(b->hay, '!', b->n); }
+static void bench_fil_sichr(Bench *b) { bench_sink += (unsigned long)Fil_sichr(b->fil, '#', ~0UL); }
+
+static void bench_memchr_all(Bench *b)
+{
+    const char *p = b->hay;
+    const char *end = b->hay + b->n;
+    while ((p = memchr(p, '#', (size_t)(end - p)))) p++;
+    bench_sink += (unsigned long)end;
+}
+
+static void bench_fil_rfstr(Bench *b)
+{
+    bench_sink += (unsigned long)Fil_rfstr(b->fil, b->s[b->flip], b->s[!b->flip]);
+    b->flip = !b->flip;
+}
+
+static void bench_fil_rlstr(Bench *b)
+{
+    bench_sink += (unsigned long)Fil_rlstr(b->fil, b->s[b->flip], b->s[!b->flip]);
+    b->flip = !b->flip;
+}
+
+static void bench_fil_ristr(Bench *b)
+{
+    bench_sink += (unsigned long)Fil_ristr(b->fil, b->s[b->flip], 2, b->s[!b->flip]);
+    b->flip = !b->flip;
+}
+
+static void bench_fil_rastr(Bench *b)
+{
+    bench_sink += (unsigned long)Fil_rastr(b->fil, b->s[b->flip], b->s[!b->flip]);
+    b->flip = !b->flip;
+}
+
+static void bench_fil_rastr_par(Bench *b)
+{
+    bench_sink += (unsigned long)Fil_rastr_par(b->pool, b->fil, Fil_view_cstr(b->s[b->flip]), Fil_view_cstr(b->s[!b->flip]));
+    b->flip = !b->flip;
+}
+
+static void bench_fil_rapat(Bench *b)
+{
+    bench_sink += (unsigned long)Fil_rapat(b->fil, b->pat[b->flip], b->s[!b->flip]);
+    b->flip = !b->flip;
+}
+
+static void bench_fil_rmulti(Bench *b)
+{
+    bench_sink += (unsigned long)Fil_rmulti(b->fil, b->dict[b->flip]);
+    b->flip = !b->flip;
+}
+
+static void bench_fil_rachr(Bench *b)
+{
+    bench_sink += (unsigned long)Fil_rachr(b->fil, b->flip ? '$' : '#', b->flip ? '#' : '$');
+    b->flip = !b->flip;
+}
+
+static void bench_fil_translate(Bench *b) { bench_sink += (unsigned long)Fil_translate(b->fil, b->map); }
+
+static void bench_restore(Bench *b)
+{
+    memcpy(Fil_str(b->fil), b->hay, b->n + 1);
+    b->fil->len = b->n;
+    bench_sink += (unsigned long)Fil_str(b->fil)[0];
+}
+
+static void bench_fil_delete_chars(Bench *b)
+{
+    bench_restore(b);
+    bench_sink += (unsigned long)Fil_delete_chars(b->fil, Fil_view_cstr("#"));
+}
+
+static void bench_fil_read(Bench *b)
+{
+    Fil fil = {0};
+    bench_sink += (unsigned long)Fil_read_from_file(&fil, BENCH_FILE);
+    Fil_free(&fil);
+}
+
+static void bench_fread(Bench *b)
+{
+    FILE *file = fopen(BENCH_FILE, "rb");
+    if (!file) return;
+    bench_sink += fread(b->dest, 1, b->n, file);
+    fclose(file);
+}
+
+static void bench_fil_map(Bench *b)
+{
+    Fil_View view;
+    if (Fil_map_file(&view, BENCH_FILE)) return;
+    // Touch a byte per page, mapping alone does not read the file.
+    for (unsigned long i = 0; i < view.len; i += 4096) bench_sink += (unsigned long)view.ptr[i];
+    Fil_unmap_file(&view);
+}
+
+static void bench_fil_write(Bench *b) { bench_sink += (unsigned long)Fil_write_to_file(b->fil, BENCH_FILE, 1); }
+
+static void bench_fil_write_atomic(Bench *b)
+{
+    Fil_View view = {b->hay, b->n};
+    bench_sink += (unsigned long)Fil_write_views(BENCH_FILE, &view, 1, FIL_WRITE_ATOMIC | FIL_WRITE_OVERWRITE);
+}
+
+static void bench_fwrite(Bench *b)
+{
+    FILE *file = fopen(BENCH_FILE, "wb");
+    if (!file) return;
+    bench_sink += fwrite(b->hay, 1, b->n, file);
+    fclose(file);
+}
+
+static void bench_len_cpy(char *hay, char *dest, Fil *fil)
+{
+    static const unsigned long sizes[] = {16, 256, 4096, 1UL << 16, 1UL << 20, 1UL << 24};
+    for (unsigned long i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+    {
+        Bench b = {.hay = hay, .n = sizes[i], .dest = dest, .fil = fil};
+        bench_fill(hay, b.n, "", 0);
+        bench_run("len", "Fil_len", &b, b.n, 0, bench_fil_len);
+        bench_run("len", "strlen", &b, b.n, 0, bench_strlen);
+        bench_run("cpy", "Fil_cpy", &b, b.n, 0, bench_fil_cpy);
+        bench_run("cpy", "strcpy", &b, b.n, 0, bench_strcpy);
+        bench_run("cpy", "memcpy", &b, b.n, 0, bench_memcpy);
+    }
+
+    static const unsigned long pieces[] = {16, 256, 4096};
+    for (unsigned long i = 0; i < sizeof(pieces) / sizeof(pieces[0]); i++)
+    {
+        Bench b = {.hay = hay, .n = 1UL << 20, .dest = dest, .fil = fil, .piece = pieces[i], .m = pieces[i]};
+        bench_fill(hay, b.n, "", 0);
+        bench_run("append", "Fil_append", &b, b.n, 0, bench_fil_append);
+        bench_run("append", "Fil_append_v", &b, b.n, 0, bench_fil_append_v);
+        bench_run("append", "memcpy", &b, b.n, 0, bench_memcpy_pieces);
+    }
+}
+
+static void bench_search(char *hay, Fil *fil, Fil_Pool *pool)
+{
+    static const unsigned long sizes[] = {256, 4096, 1UL << 20};
+    static const unsigned long needles[] = {1, 4, 16, 64};
+    char needle[65];
+    for (unsigned long i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+    {
+        for (unsigned long j = 0; j < sizeof(needles) / sizeof(needles[0]); j++)
+        {
+            Bench b = {.hay = hay, .n = sizes[i], .needle = needle, .m = needles[j], .fil = fil};
+            bench_fill(hay, b.n, "", 0);
+            bench_needle(needle, b.m);
+            bench_reset(&b);
+
+            Fil_Pattern pat;
+            Fil_pattern_init(&pat, needle);
+            b.pat[0] = &pat;
+            bench_run("sfstr", "Fil_sfstr", &b, b.n, 0, bench_fil_sfstr);
+            bench_run("sfstr", "Fil_sfstr_v", &b, b.n, 0, bench_fil_sfstr_v);
+            bench_run("sfstr", "Fil_sfpat", &b, b.n, 0, bench_fil_sfpat);
+            bench_run("sfstr", "memmem", &b, b.n, 0, bench_memmem);
+            bench_run("sfstr", "strstr", &b, b.n, 0, bench_strstr);
+            bench_run("slstr", "Fil_slstr", &b, b.n, 0, bench_fil_slstr);
+            bench_run("sfstr_ci", "Fil_sfstr_ci", &b, b.n, 0, bench_fil_sfstr_ci);
+            bench_run("sfstr_ci", "strcasestr", &b, b.n, 0, bench_strcasestr);
+            Fil_pattern_free(&pat);
+        }
+    }
+
+    // Every occurence, with more and more of them.
+    static const unsigned long gaps[] = {0, 4096, 64};
+    for (unsigned long i = 0; i < sizeof(gaps) / sizeof(gaps[0]); i++)
+    {
+        Bench b = {.hay = hay, .n = 1UL << 20, .needle = "#needle#", .m = 8, .fil = fil, .pool = pool};
+        unsigned long hits = bench_fill(hay, b.n, "#needle#", gaps[i]);
+        bench_reset(&b);
+        bench_run("sistr", "Fil_sistr", &b, b.n, hits, bench_fil_sistr);
+        bench_run("sistr", "Fil_count_str_par", &b, b.n, hits, bench_fil_count_par);
+        bench_run("sistr", "memmem", &b, b.n, hits, bench_memmem_all);
+        bench_run("sichr", "Fil_sichr", &b, b.n, hits * 2, bench_fil_sichr);
+        bench_run("sichr", "memchr", &b, b.n, hits * 2, bench_memchr_all);
+    }
+
+    static const unsigned long chr_sizes[] = {16, 256, 4096, 1UL << 20};
+    for (unsigned long i = 0; i < sizeof(chr_sizes) / sizeof(chr_sizes[0]); i++)
+    {
+        Bench b = {.hay = hay, .n = chr_sizes[i], .m = 1, .fil = fil};
+        bench_fill(hay, b.n, "", 0);
+        bench_reset(&b);
+        bench_run("sfchr", "Fil_sfchr", &b, b.n, 0, bench_fil_sfchr);
+        bench_run("sfchr", "memchr", &b, b.n, 0, bench_memchr);
+        bench_run("slchr", "Fil_slchr", &b, b.n, 0, bench_fil_slchr);
+        bench_run("slchr", "memrchr", &b, b.n, 0, bench_memrchr);
+    }
+}
+
+static void bench_replace(char *hay, Fil *fil, Fil_Pool *pool)
+{
+    const char *same[] = {"#aaaa#", "#bbbb#"};
+    const char *grow[] = {"#a#", "#bbbbbbbbb#"};
+    static const unsigned long gaps[] = {4096, 64};
+    for (unsigned long i = 0; i < sizeof(gaps) / sizeof(gaps[0]); i++)
+    {
+        for (int g = 0; g < 2; g++)
+        {
+            const char **s = g ? grow : same;
+            Bench b = {.hay = hay, .n = 1UL << 20, .m = strlen(s[0]), .fil = fil, .pool = pool, .s = {s[0], s[1]}};
+            unsigned long hits = bench_fill(hay, b.n, s[0], gaps[i]);
+            Fil_Pattern pat[2];
+            Fil_Dict dict[2];
+            Fil_pattern_init(&pat[0], s[0]);
+            Fil_pattern_init(&pat[1], s[1]);
+            Fil_dict_build(&dict[0], &s[0], &s[1], 1);
+            Fil_dict_build(&dict[1], &s[1], &s[0], 1);
+            b.pat[0] = &pat[0];
+            b.pat[1] = &pat[1];
+            b.dict[0] = &dict[0];
+            b.dict[1] = &dict[1];
+
+            const char *group = g ? "replace_grow" : "replace";
+            bench_reset(&b);
+            bench_run(group, "Fil_rfstr", &b, b.n, hits, bench_fil_rfstr);
+            bench_reset(&b);
+            bench_run(group, "Fil_rlstr", &b, b.n, hits, bench_fil_rlstr);
+            bench_reset(&b);
+            bench_run(group, "Fil_ristr", &b, b.n, hits, bench_fil_ristr);
+            bench_reset(&b);
+            bench_run(group, "Fil_rastr", &b, b.n, hits, bench_fil_rastr);
+            bench_reset(&b);
+            bench_run(group, "Fil_rastr_par", &b, b.n, hits, bench_fil_rastr_par);
+            bench_reset(&b);
+            bench_run(group, "Fil_rapat", &b, b.n, hits, bench_fil_rapat);
+            bench_reset(&b);
+            bench_run(group, "Fil_rmulti", &b, b.n, hits, bench_fil_rmulti);
+
+            Fil_dict_free(&dict[0]);
+            Fil_dict_free(&dict[1]);
+            Fil_pattern_free(&pat[0]);
+            Fil_pattern_free(&pat[1]);
+        }
+
+        Fil_ByteMap map;
+        Fil_bytemap_init(&map);
+        Fil_bytemap_set(&map, Fil_view_cstr("#$"), Fil_view_cstr("$#"));
+        Bench b = {.hay = hay, .n = 1UL << 20, .m = 1, .fil = fil, .map = &map};
+        unsigned long hits = bench_fill(hay, b.n, "#", gaps[i]);
+        bench_reset(&b);
+        bench_run("replace_chr", "Fil_rachr", &b, b.n, hits, bench_fil_rachr);
+        bench_run("replace_chr", "Fil_translate", &b, b.n, hits, bench_fil_translate);
+        bench_reset(&b);
+        bench_run("replace_chr", "Fil_delete_chars", &b, b.n, hits, bench_fil_delete_chars);
+        bench_run("replace_chr", "restore", &b, b.n, hits, bench_restore);
+    }
+}
+
+static void bench_file(char *hay, char *dest, Fil *fil)
+{
+    static const unsigned long sizes[] = {4096, 1UL << 20, 1UL << 24};
+    for (unsigned long i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+    {
+        Bench b = {.hay = hay, .n = sizes[i], .dest = dest, .fil = fil};
+        bench_fill(hay, b.n, "", 0);
+        bench_reset(&b);
+        bench_run("file_write", "Fil_write_to_file", &b, b.n, 0, bench_fil_write);
+        bench_run("file_write", "Fil_write_views_atomic", &b, b.n, 0, bench_fil_write_atomic);
+        bench_run("file_write", "fwrite", &b, b.n, 0, bench_fwrite);
+        bench_run("file_read", "Fil_read_from_file", &b, b.n, 0, bench_fil_read);
+        bench_run("file_read", "Fil_map_file", &b, b.n, 0, bench_fil_map);
+        bench_run("file_read", "fread", &b, b.n, 0, bench_fread);
+        remove(BENCH_FILE);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1) bench_filter = argv[1];
+
+    unsigned long max = 1UL << 24;
+    char *hay = malloc(max + 1);
+    char *dest = malloc(max + 1);
+    Fil fil = {0};
+    Fil_Pool pool = {0};
+    if (!hay || !dest || Fil_pool_init(&pool, 0))
+    {
+        fprintf(stderr, "bench: out of memory\n");
+        return 1;
+    }
+
+    printf("{\n  \"library\": \"fil\",\n  \"samples\": %d,\n  \"threads\": %lu,\n  \"results\": [",
+           BENCH_SAMPLES, pool.threads);
+    bench_len_cpy(hay, dest, &fil);
+    bench_search(hay, &fil, &pool);
+    bench_replace(hay, &fil, &pool);
+    bench_file(hay, dest, &fil);
+    printf("\n  ]\n}\n");
+
+    Fil_pool_free(&pool);
+    Fil_free(&fil);
+    free(hay);
+    free(dest);
+    return 0;
+}
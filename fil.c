@@ -21,399 +21,4892 @@ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
 OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 SOFTWARE.
 */
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE     // mremap
+#endif
+
 #include "fil.h"
 
 #include <stdio.h>
+#include <stdarg.h>
 #include <stdlib.h>
 #include <errno.h>
 #include <string.h>
+#include <stdint.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <fcntl.h>
 #include <unistd.h>
+#include <pthread.h>
 
-void Fil_free(Fil *fil)
+#if !defined(FIL_NO_SIMD) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define FIL_X86_SIMD
+#include <immintrin.h>
+#endif
+
+#if defined(__GNUC__)
+#define FIL_TARGET(isa) __attribute__((target(isa)))
+// The kernels below read whole aligned blocks, which never cross a page
+// boundary but may touch bytes past the terminator.
+#define FIL_NO_ASAN __attribute__((no_sanitize_address))
+#else
+#define FIL_TARGET(isa)
+#define FIL_NO_ASAN
+#endif
+
+#define FIL_CPU_SSE2    0x1
+#define FIL_CPU_AVX2    0x2
+#define FIL_CPU_SSSE3   0x4
+
+#define FIL_WORD_ONES   (~0UL / 0xFF)
+#define FIL_WORD_HIGHS  (FIL_WORD_ONES << 7)
+#define FIL_WORD_HAS_ZERO(w) (((w) - FIL_WORD_ONES) & ~(w) & FIL_WORD_HIGHS)
+
+// The string lives in the inline buffer of the Fil struct.
+#define FIL_IS_INLINE(fil) ((fil)->is_inline)
+// String and capacity of fil, wherever it is stored. FIL_STR is not an lvalue.
+#define FIL_STR(fil) (FIL_IS_INLINE(fil) ? (fil)->buf.sso : (fil)->buf.heap.string)
+#define FIL_CAP(fil) (FIL_IS_INLINE(fil) ? (unsigned long)FIL_SSO_CAPACITY : (fil)->buf.heap.capacity)
+// Some storage is allocated, the string is at least empty.
+#define FIL_HAS_STR(fil) (FIL_IS_INLINE(fil) || (fil)->buf.heap.string)
+
+/**
+ * Without FIL_STATS the counter macros expand to nothing, their arguments
+ * are not evaluated. FIL_STAT_FIND and FIL_STAT_RFIND count a forward or
+ * backward search of n bytes from hay for a needle of len bytes and
+ * evaluate to found.
+ */
+#ifdef FIL_STATS
+static _Thread_local Fil_Stats fil_stats;
+
+#define FIL_STAT_ADD(field, n) (fil_stats.field += (unsigned long)(n))
+#define FIL_STAT_FIND(hay, n, len, found) fil_stat_find(hay, n, len, found, 0)
+#define FIL_STAT_RFIND(hay, n, len, found) fil_stat_find(hay, n, len, found, 1)
+
+static const char *fil_stat_find(const char *hay, unsigned long n, unsigned long len,
+                                 const char *found, int backward)
 {
-    free(fil->string);
+    if (!found) fil_stats.scanned += n;
+    else if (backward) fil_stats.scanned += (unsigned long)(hay + n - found);
+    else fil_stats.scanned += (unsigned long)(found - hay) + len;
+    fil_stats.matches += found != ((void*)0);
+    return found;
 }
 
-int Fil_resize(Fil *fil, unsigned long new_cap)
+static void fil_stat_capacity(unsigned long capacity)
 {
-    if (!fil || new_cap <= 0) return FIL_ERR_PARAM;
+    if (capacity) fil_stats.capacities[63 - __builtin_clzl(capacity)]++;
+}
+#else
+#define FIL_STAT_ADD(field, n) ((void)0)
+#define FIL_STAT_FIND(hay, n, len, found) (found)
+#define FIL_STAT_RFIND(hay, n, len, found) (found)
+#define fil_stat_capacity(capacity) ((void)0)
+#endif // FIL_STATS
 
-    char *tmp = realloc(fil->string, new_cap);
-    if (!tmp) return FIL_ERR_MEMORY;
-    fil->string = tmp;
-    fil->capacity = new_cap;
-    return 0;
+#ifdef FIL_X86_SIMD
+static int fil_cpu = -1;
+
+/**
+ * CPUID based feature detection, done once and cached.
+ */
+static int fil_cpu_features(void)
+{
+    int features = __atomic_load_n(&fil_cpu, __ATOMIC_RELAXED);
+    if (features < 0)
+    {
+        features = 0;
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("sse2")) features |= FIL_CPU_SSE2;
+        if (__builtin_cpu_supports("avx2")) features |= FIL_CPU_AVX2;
+        if (__builtin_cpu_supports("ssse3")) features |= FIL_CPU_SSSE3;
+        __atomic_store_n(&fil_cpu, features, __ATOMIC_RELAXED);
+    }
+    return features;
 }
 
-unsigned long Fil_len(const char *str)
+FIL_TARGET("sse2") FIL_NO_ASAN
+static unsigned long fil_len_sse2(const char *str)
 {
-    if (!str) return 0;
+    const __m128i zero = _mm_setzero_si128();
+    unsigned int misalign = (unsigned int)((uintptr_t)str & 15);
+    const char *block = str - misalign;
+    unsigned int mask = (unsigned int)_mm_movemask_epi8(
+        _mm_cmpeq_epi8(_mm_load_si128((const __m128i *)block), zero)) >> misalign;
+
+    if (mask) return (unsigned long)__builtin_ctz(mask);
+    for (;;)
+    {
+        block += 16;
+        mask = (unsigned int)_mm_movemask_epi8(
+            _mm_cmpeq_epi8(_mm_load_si128((const __m128i *)block), zero));
+        if (mask) return (unsigned long)(block - str) + (unsigned long)__builtin_ctz(mask);
+    }
+}
+
+FIL_TARGET("avx2") FIL_NO_ASAN
+static unsigned long fil_len_avx2(const char *str)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    unsigned int misalign = (unsigned int)((uintptr_t)str & 31);
+    const char *block = str - misalign;
+    unsigned int mask = (unsigned int)_mm256_movemask_epi8(
+        _mm256_cmpeq_epi8(_mm256_load_si256((const __m256i *)block), zero)) >> misalign;
+
+    if (mask) return (unsigned long)__builtin_ctz(mask);
+    block += 32;
+    if ((uintptr_t)block & 63)
+    {
+        mask = (unsigned int)_mm256_movemask_epi8(
+            _mm256_cmpeq_epi8(_mm256_load_si256((const __m256i *)block), zero));
+        if (mask) return (unsigned long)(block - str) + (unsigned long)__builtin_ctz(mask);
+        block += 32;
+    }
+    // 64 bytes per iteration, a zero byte in either half makes the unsigned min zero.
+    for (;;)
+    {
+        __m256i lo = _mm256_load_si256((const __m256i *)block);
+        __m256i hi = _mm256_load_si256((const __m256i *)(block + 32));
+        __m256i min = _mm256_min_epu8(lo, hi);
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(min, zero)))
+        {
+            mask = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, zero));
+            if (mask) return (unsigned long)(block - str) + (unsigned long)__builtin_ctz(mask);
+            mask = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, zero));
+            return (unsigned long)(block - str) + 32 + (unsigned long)__builtin_ctz(mask);
+        }
+        block += 64;
+    }
+}
+
+FIL_TARGET("sse2") FIL_NO_ASAN
+static void fil_cpy_sse2(char *dest, const char *src)
+{
+    const __m128i zero = _mm_setzero_si128();
+
+    while ((uintptr_t)src & 15)
+    {
+        if (!*src) return;
+        *dest++ = *src++;
+    }
+    for (;;)
+    {
+        __m128i block = _mm_load_si128((const __m128i *)src);
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(block, zero));
+        if (mask)
+        {
+            memcpy(dest, src, (size_t)__builtin_ctz(mask));
+            return;
+        }
+        _mm_storeu_si128((__m128i *)dest, block);
+        src += 16;
+        dest += 16;
+    }
+}
+
+FIL_TARGET("avx2") FIL_NO_ASAN
+static void fil_cpy_avx2(char *dest, const char *src)
+{
+    const __m256i zero = _mm256_setzero_si256();
+
+    while ((uintptr_t)src & 31)
+    {
+        if (!*src) return;
+        *dest++ = *src++;
+    }
+    for (;;)
+    {
+        __m256i block = _mm256_load_si256((const __m256i *)src);
+        unsigned int mask = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, zero));
+        if (mask)
+        {
+            memcpy(dest, src, (size_t)__builtin_ctz(mask));
+            return;
+        }
+        _mm256_storeu_si256((__m256i *)dest, block);
+        src += 32;
+        dest += 32;
+    }
+}
+FIL_TARGET("sse2")
+static const char *fil_memchr_sse2(const char *str, char c, unsigned long n)
+{
+    const __m128i needle = _mm_set1_epi8(c);
+    unsigned long i = 0;
+    unsigned int mask;
+
+    for (; i + 16 <= n; i += 16)
+    {
+        mask = (unsigned int)_mm_movemask_epi8(
+            _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(str + i)), needle));
+        if (mask) return str + i + __builtin_ctz(mask);
+    }
+    if (i < n && n >= 16)
+    {
+        // Last block overlaps the previous one, drop the bytes already checked.
+        mask = (unsigned int)_mm_movemask_epi8(
+            _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(str + n - 16)), needle));
+        mask >>= i - (n - 16);
+        if (mask) return str + i + __builtin_ctz(mask);
+        return ((void*)0);
+    }
+    for (; i < n; i++)
+    {
+        if (str[i] == c) return str + i;
+    }
+    return ((void*)0);
+}
+
+FIL_TARGET("avx2")
+static const char *fil_memchr_avx2(const char *str, char c, unsigned long n)
+{
+    const __m256i needle = _mm256_set1_epi8(c);
+    unsigned long i = 0;
+    unsigned int mask;
+
+    for (; i + 64 <= n; i += 64)
+    {
+        __m256i lo = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(str + i)), needle);
+        __m256i hi = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(str + i + 32)), needle);
+        if (_mm256_movemask_epi8(_mm256_or_si256(lo, hi)))
+        {
+            mask = (unsigned int)_mm256_movemask_epi8(lo);
+            if (mask) return str + i + __builtin_ctz(mask);
+            return str + i + 32 + __builtin_ctz((unsigned int)_mm256_movemask_epi8(hi));
+        }
+    }
+    for (; i + 32 <= n; i += 32)
+    {
+        mask = (unsigned int)_mm256_movemask_epi8(
+            _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(str + i)), needle));
+        if (mask) return str + i + __builtin_ctz(mask);
+    }
+    if (i < n && n >= 32)
+    {
+        mask = (unsigned int)_mm256_movemask_epi8(
+            _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(str + n - 32)), needle));
+        mask >>= i - (n - 32);
+        if (mask) return str + i + __builtin_ctz(mask);
+        return ((void*)0);
+    }
+    for (; i < n; i++)
+    {
+        if (str[i] == c) return str + i;
+    }
+    return ((void*)0);
+}
+FIL_TARGET("sse2")
+static const char *fil_memrchr_sse2(const char *str, char c, unsigned long n)
+{
+    const __m128i needle = _mm_set1_epi8(c);
+    const unsigned long len = n;
+    unsigned int mask;
+
+    for (; n >= 16; n -= 16)
+    {
+        mask = (unsigned int)_mm_movemask_epi8(
+            _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(str + n - 16)), needle));
+        if (mask) return str + n - 16 + (31 - __builtin_clz(mask));
+    }
+    if (n && len >= 16)
+    {
+        // First block overlaps the next one, keep only the n bytes not checked yet.
+        mask = (unsigned int)_mm_movemask_epi8(
+            _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)str), needle));
+        mask &= (1u << n) - 1;
+        if (mask) return str + (31 - __builtin_clz(mask));
+        return ((void*)0);
+    }
+    while (n--)
+    {
+        if (str[n] == c) return str + n;
+    }
+    return ((void*)0);
+}
+
+FIL_TARGET("avx2")
+static const char *fil_memrchr_avx2(const char *str, char c, unsigned long n)
+{
+    const __m256i needle = _mm256_set1_epi8(c);
+    const unsigned long len = n;
+    unsigned int mask;
+
+    for (; n >= 64; n -= 64)
+    {
+        __m256i lo = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(str + n - 64)), needle);
+        __m256i hi = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(str + n - 32)), needle);
+        if (_mm256_movemask_epi8(_mm256_or_si256(lo, hi)))
+        {
+            mask = (unsigned int)_mm256_movemask_epi8(hi);
+            if (mask) return str + n - 32 + (31 - __builtin_clz(mask));
+            mask = (unsigned int)_mm256_movemask_epi8(lo);
+            return str + n - 64 + (31 - __builtin_clz(mask));
+        }
+    }
+    for (; n >= 32; n -= 32)
+    {
+        mask = (unsigned int)_mm256_movemask_epi8(
+            _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(str + n - 32)), needle));
+        if (mask) return str + n - 32 + (31 - __builtin_clz(mask));
+    }
+    if (n && len >= 32)
+    {
+        mask = (unsigned int)_mm256_movemask_epi8(
+            _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)str), needle));
+        mask &= (1u << n) - 1;
+        if (mask) return str + (31 - __builtin_clz(mask));
+        return ((void*)0);
+    }
+    while (n--)
+    {
+        if (str[n] == c) return str + n;
+    }
+    return ((void*)0);
+}
+#endif // FIL_X86_SIMD
 
+/**
+ * Portable word-at-a-time kernels, reading one aligned unsigned long at a time.
+ */
+FIL_NO_ASAN
+static unsigned long fil_len_word(const char *str)
+{
     const char *tmp = str;
 
+    while ((uintptr_t)tmp % sizeof(unsigned long))
+    {
+        if (!*tmp) return (unsigned long)(tmp - str);
+        ++tmp;
+    }
+    for (;;)
+    {
+        unsigned long word;
+        memcpy(&word, tmp, sizeof(word));
+        if (FIL_WORD_HAS_ZERO(word)) break;
+        tmp += sizeof(word);
+    }
     while (*tmp)
     {
         ++tmp;
     }
-    return (unsigned long)(tmp - str);
+    return (unsigned long)(tmp - str);
+}
+
+FIL_NO_ASAN
+static void fil_cpy_word(char *dest, const char *src)
+{
+    while ((uintptr_t)src % sizeof(unsigned long))
+    {
+        if (!*src) return;
+        *dest++ = *src++;
+    }
+    for (;;)
+    {
+        unsigned long word;
+        memcpy(&word, src, sizeof(word));
+        if (FIL_WORD_HAS_ZERO(word)) break;
+        memcpy(dest, &word, sizeof(word));
+        src += sizeof(word);
+        dest += sizeof(word);
+    }
+    while (*src)
+    {
+        *dest++ = *src++;
+    }
+}
+
+static const char *fil_memchr_word(const char *str, char c, unsigned long n)
+{
+    const unsigned long pattern = FIL_WORD_ONES * (unsigned char)c;
+    unsigned long i = 0;
+
+    while (i < n && (uintptr_t)(str + i) % sizeof(unsigned long))
+    {
+        if (str[i] == c) return str + i;
+        i++;
+    }
+    for (; i + sizeof(unsigned long) <= n; i += sizeof(unsigned long))
+    {
+        unsigned long word;
+        memcpy(&word, str + i, sizeof(word));
+        if (FIL_WORD_HAS_ZERO(word ^ pattern)) break;
+    }
+    for (; i < n; i++)
+    {
+        if (str[i] == c) return str + i;
+    }
+    return ((void*)0);
+}
+
+static const char *fil_memrchr_word(const char *str, char c, unsigned long n)
+{
+    const unsigned long pattern = FIL_WORD_ONES * (unsigned char)c;
+
+    while (n && (uintptr_t)(str + n) % sizeof(unsigned long))
+    {
+        if (str[--n] == c) return str + n;
+    }
+    for (; n >= sizeof(unsigned long); n -= sizeof(unsigned long))
+    {
+        unsigned long word;
+        memcpy(&word, str + n - sizeof(word), sizeof(word));
+        if (FIL_WORD_HAS_ZERO(word ^ pattern)) break;
+    }
+    while (n--)
+    {
+        if (str[n] == c) return str + n;
+    }
+    return ((void*)0);
+}
+
+/**
+ * Returns a pointer to the first c in the n bytes of str, NULL if absent.
+ */
+static const char *fil_memchr(const char *str, char c, unsigned long n)
+{
+#ifdef FIL_X86_SIMD
+    int features = fil_cpu_features();
+    if (features & FIL_CPU_AVX2) return FIL_STAT_FIND(str, n, 1, fil_memchr_avx2(str, c, n));
+    if (features & FIL_CPU_SSE2) return FIL_STAT_FIND(str, n, 1, fil_memchr_sse2(str, c, n));
+#endif
+    return FIL_STAT_FIND(str, n, 1, fil_memchr_word(str, c, n));
+}
+
+/**
+ * Returns a pointer to the last c in the n bytes of str, NULL if absent.
+ */
+static const char *fil_memrchr(const char *str, char c, unsigned long n)
+{
+#ifdef FIL_X86_SIMD
+    int features = fil_cpu_features();
+    if (features & FIL_CPU_AVX2) return FIL_STAT_RFIND(str, n, 1, fil_memrchr_avx2(str, c, n));
+    if (features & FIL_CPU_SSE2) return FIL_STAT_RFIND(str, n, 1, fil_memrchr_sse2(str, c, n));
+#endif
+    return FIL_STAT_RFIND(str, n, 1, fil_memrchr_word(str, c, n));
+}
+
+/**
+ * Arena chunks are chained from the most recent one, the data follows the
+ * header and is aligned on FIL_ARENA_ALIGN.
+ */
+struct Fil_ArenaChunk {
+    struct Fil_ArenaChunk *prev;
+    unsigned long size;
+    unsigned long used;
+};
+
+#define FIL_ARENA_ALIGN     16UL
+#define FIL_ARENA_HEADER    ((sizeof(struct Fil_ArenaChunk) + FIL_ARENA_ALIGN - 1) & ~(FIL_ARENA_ALIGN - 1))
+#define FIL_ARENA_DATA(chunk) ((char *)(chunk) + FIL_ARENA_HEADER)
+
+/**
+ * Bump size bytes off the current chunk, a new chunk is chained when it is full.
+ */
+static char *fil_arena_bump(Fil_Arena *arena, unsigned long size)
+{
+    struct Fil_ArenaChunk *chunk = arena->chunk;
+    unsigned long start = chunk ? (chunk->used + FIL_ARENA_ALIGN - 1) & ~(FIL_ARENA_ALIGN - 1) : 0;
+    if (!chunk || start > chunk->size || size > chunk->size - start)
+    {
+        unsigned long chunk_size = arena->chunk_size ? arena->chunk_size : FIL_ARENA_CHUNK_SIZE;
+        chunk_size = FIL_MAX(chunk_size, size);
+        if (chunk_size > ~0UL - FIL_ARENA_HEADER) return ((void*)0);
+        chunk = malloc(FIL_ARENA_HEADER + chunk_size);
+        if (!chunk) return ((void*)0);
+        chunk->prev = arena->chunk;
+        chunk->size = chunk_size;
+        arena->chunk = chunk;
+        start = 0;
+    }
+    chunk->used = start + size;
+    arena->last = FIL_ARENA_DATA(chunk) + start;
+    return arena->last;
+}
+
+/**
+ * Resize block in place, only the last allocation can be resized and only
+ * within its chunk.
+ * Returns 1 on success, 0 if the block has to be moved.
+ */
+static int fil_arena_extend(Fil_Arena *arena, char *block, unsigned long size)
+{
+    if (!block || block != arena->last) return 0;
+
+    struct Fil_ArenaChunk *chunk = arena->chunk;
+    unsigned long start = (unsigned long)(block - FIL_ARENA_DATA(chunk));
+    if (size > chunk->size - start) return 0;
+    chunk->used = start + size;
+    return 1;
+}
+
+/**
+ * Give block back to the arena when it is the last allocation, other blocks
+ * are only released by Fil_arena_reset.
+ */
+static void fil_arena_release(Fil_Arena *arena, char *block)
+{
+    if (block != arena->last) return;
+    arena->chunk->used = (unsigned long)(block - FIL_ARENA_DATA(arena->chunk));
+    arena->last = ((void*)0);
+}
+
+// Allocator of the Fils without one, malloc when NULL.
+static const Fil_Allocator *fil_global_allocator = ((void*)0);
+
+#define FIL_ALLOCATOR(fil) ((fil)->allocator ? (fil)->allocator : fil_global_allocator)
+
+// Heap strings of that capacity are anonymous mappings instead of malloc blocks.
+#define FIL_IS_MAPPED(capacity) ((capacity) >= FIL_MMAP_THRESHOLD)
+
+static unsigned long fil_page_round(unsigned long size)
+{
+    unsigned long page = (unsigned long)sysconf(_SC_PAGESIZE);
+    return (size + page - 1) & ~(page - 1);
+}
+
+static char *fil_map(unsigned long size)
+{
+    void *block = mmap(((void*)0), fil_page_round(size), PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return block == MAP_FAILED ? ((void*)0) : block;
+}
+
+/**
+ * Resize a mapping, keeping its content. On Linux the pages are moved by
+ * mremap, elsewhere they are copied to a new mapping.
+ * Returns the new mapping, NULL on error with block left untouched.
+ */
+static char *fil_remap(char *block, unsigned long old_size, unsigned long new_size)
+{
+#ifdef __linux__
+    void *moved = mremap(block, fil_page_round(old_size), fil_page_round(new_size), MREMAP_MAYMOVE);
+    return moved == MAP_FAILED ? ((void*)0) : moved;
+#else
+    char *moved = fil_map(new_size);
+    if (!moved) return ((void*)0);
+    memcpy(moved, block, FIL_MIN(old_size, new_size));
+    munmap(block, fil_page_round(old_size));
+    return moved;
+#endif // __linux__
+}
+
+/**
+ * Allocate a buffer for the string of fil, in its arena if it has one.
+ */
+static char *fil_alloc(Fil *fil, unsigned long size)
+{
+    if (fil->arena) return fil_arena_bump(fil->arena, size);
+    const Fil_Allocator *allocator = FIL_ALLOCATOR(fil);
+    if (allocator) return allocator->realloc_fn(allocator->context, ((void*)0), 0, size);
+    if (FIL_IS_MAPPED(size)) return fil_map(size);
+    return malloc(size);
+}
+
+/**
+ * Move the heap string of fil to a new_cap bytes buffer, keeping its content.
+ * Returns the new buffer, NULL on error with the string left untouched.
+ */
+static char *fil_realloc(Fil *fil, unsigned long new_cap)
+{
+    char *string = fil->buf.heap.string;
+    const unsigned long capacity = fil->buf.heap.capacity;
+    const Fil_Allocator *allocator = FIL_ALLOCATOR(fil);
+    if (allocator) return allocator->realloc_fn(allocator->context, string, capacity, new_cap);
+
+    int mapped = FIL_IS_MAPPED(capacity);
+    if (!mapped && !FIL_IS_MAPPED(new_cap)) return realloc(string, new_cap);
+    if (mapped && FIL_IS_MAPPED(new_cap)) return fil_remap(string, capacity, new_cap);
+
+    char *block = mapped ? malloc(new_cap) : fil_map(new_cap);
+    if (!block) return ((void*)0);
+    memcpy(block, string, FIL_MIN(capacity, new_cap));
+    if (mapped) munmap(string, fil_page_round(capacity));
+    else free(string);
+    return block;
+}
+
+/**
+ * Capacity to grow fil to for needed bytes, following its growth policy.
+ */
+static unsigned long fil_grow(const Fil *fil, unsigned long needed)
+{
+    if (fil->growth == FIL_GROW_EXACT) return needed;
+    if (fil->growth == FIL_GROW_STEP) return (needed + fil->growth_step - 1) / fil->growth_step * fil->growth_step;
+    return FIL_MAX(needed, FIL_CAP(fil) * FIL_RESIZE_FACTOR);
+}
+
+/**
+ * Grow or shrink the arena block of fil in place.
+ * Returns 1 on success, 0 if the string has to be moved.
+ */
+static int fil_extend(Fil *fil, unsigned long new_cap)
+{
+    if (!fil->arena || FIL_IS_INLINE(fil)) return 0;
+    if (!fil_arena_extend(fil->arena, fil->buf.heap.string, new_cap)) return 0;
+    fil->buf.heap.capacity = new_cap;
+    return 1;
+}
+
+/**
+ * Release the string buffer of fil, inline buffers need nothing.
+ */
+static void fil_release(Fil *fil)
+{
+    if (FIL_IS_INLINE(fil) || !fil->buf.heap.string) return;
+
+    char *string = fil->buf.heap.string;
+    const unsigned long capacity = fil->buf.heap.capacity;
+    const Fil_Allocator *allocator = FIL_ALLOCATOR(fil);
+    if (fil->arena) fil_arena_release(fil->arena, string);
+    else if (allocator) allocator->free_fn(allocator->context, string, capacity);
+    else if (FIL_IS_MAPPED(capacity)) munmap(string, fil_page_round(capacity));
+    else free(string);
+}
+
+/**
+ * Make block, of capacity bytes, the heap or arena string of fil.
+ */
+static void fil_adopt(Fil *fil, char *block, unsigned long capacity)
+{
+    fil->is_inline = 0;
+    fil->buf.heap.string = block;
+    fil->buf.heap.capacity = capacity;
+}
+
+/**
+ * Substring search engine.
+ * Single byte needles go through fil_memchr / fil_memrchr. Needles up to
+ * FIL_SHORT_NEEDLE bytes use a SIMD filter on their two rarest bytes,
+ * candidates are then verified with memcmp. Longer needles, and short needles
+ * whose filter keeps hitting false positives, use Two-Way which is linear in
+ * the worst case.
+ * Backward searches run the same algorithms on the mirrored needle and haystack,
+ * starting from the end of the haystack.
+ */
+#define FIL_SHORT_NEEDLE 64
+
+#define FIL_FORWARD     0
+#define FIL_BACKWARD    1
+
+// Byte i of the n bytes at base, counted from the end when reverse is set.
+#define FIL_AT(base, n, i, reverse) ((reverse) ? (base)[(n) - 1 - (i)] : (base)[(i)])
+
+/**
+ * ASCII lower case of c.
+ */
+static inline unsigned char fil_fold(char c)
+{
+    unsigned char u = (unsigned char)c;
+    return (unsigned char)(u - 'A') < 26 ? (unsigned char)(u | 0x20) : u;
+}
+
+// FIL_AT, lower cased when fold is set for the case-insensitive searches.
+#define FIL_AT_FOLD(base, n, i, reverse, fold) \
+    ((unsigned char)((fold) ? fil_fold((char)FIL_AT(base, n, i, reverse)) : FIL_AT(base, n, i, reverse)))
+
+/**
+ * Approximate rank of each byte value in common text and code, 0 is the rarest.
+ * Used to pick the needle bytes the SIMD filter compares.
+ */
+static const unsigned char fil_byte_rank[256] = {
+    157,   0,   1,   2,   3,   4,   5,   6,   7, 213, 237,   8,   9, 189,  10,  11,
+     12,  13,  14,  15,  16,  17,  18,  19,  20,  21,  22,  23,  24,  25,  26,  27,
+    255, 177, 228, 171, 174, 166, 165, 223, 218, 215, 186, 163, 232, 225, 230, 211,
+    221, 220, 219, 217, 216, 214, 212, 210, 208, 207, 209, 202, 190, 205, 199, 168,
+    164, 203, 176, 188, 191, 206, 183, 180, 193, 200, 170, 173, 192, 185, 198, 201,
+    182, 169, 195, 196, 204, 187, 175, 179, 172, 178, 167, 184, 161, 181, 159, 222,
+    160, 252, 234, 243, 244, 254, 240, 238, 246, 250, 227, 231, 245, 241, 249, 251,
+    239, 226, 247, 248, 253, 242, 233, 236, 229, 235, 224, 197, 162, 194, 158,  28,
+     93,  94,  95,  96,  97,  98,  99, 100, 101, 102, 103, 104, 105, 106, 107, 108,
+    109, 110, 111, 112, 113, 114, 115, 116, 117, 118, 119, 120, 121, 122, 123, 124,
+    125, 126, 127, 128, 129, 130, 131, 132, 133, 134, 135, 136, 137, 138, 139, 140,
+    141, 142, 143, 144, 145, 146, 147, 148, 149, 150, 151, 152, 153, 154, 155, 156,
+     29,  30,  47,  48,  49,  50,  51,  52,  53,  54,  55,  56,  57,  58,  59,  60,
+     61,  62,  63,  64,  65,  66,  67,  68,  69,  70,  71,  72,  73,  74,  75,  76,
+     77,  78,  79,  80,  81,  82,  83,  84,  85,  86,  87,  88,  89,  90,  91,  92,
+     31,  32,  33,  34,  35,  36,  37,  38,  39,  40,  41,  42,  43,  44,  45,  46,
+};
+
+/**
+ * Lexicographically maximal suffix of needle, for the order selected by inverse.
+ * Returns the index before the suffix start, (unsigned long)-1 for the whole needle.
+ */
+static unsigned long fil_maximal_suffix(const unsigned char *needle, unsigned long len,
+                                        int reverse, int inverse, int fold, unsigned long *period)
+{
+    unsigned long suffix = (unsigned long)-1;
+    unsigned long j = 0;
+    unsigned long k = 1;
+    unsigned long p = 1;
+
+    while (j + k < len)
+    {
+        unsigned char a = FIL_AT_FOLD(needle, len, j + k, reverse, fold);
+        unsigned char b = FIL_AT_FOLD(needle, len, suffix + k, reverse, fold);
+        if (a == b)
+        {
+            if (k != p)
+            {
+                ++k;
+            }
+            else
+            {
+                j += p;
+                k = 1;
+            }
+        }
+        else if (inverse ? a > b : a < b)
+        {
+            j += k;
+            k = 1;
+            p = j - suffix;
+        }
+        else
+        {
+            suffix = j++;
+            k = p = 1;
+        }
+    }
+    *period = p;
+    return suffix;
+}
+
+static void fil_twoway_prepare(Fil_Pattern *pat, int reverse, int fold)
+{
+    const unsigned char *needle = (const unsigned char *)pat->needle;
+    const unsigned long len = pat->len;
+    unsigned long period, inverse_period;
+    unsigned long suffix = fil_maximal_suffix(needle, len, reverse, 0, fold, &period);
+    unsigned long inverse_suffix = fil_maximal_suffix(needle, len, reverse, 1, fold, &inverse_period);
+
+    if (inverse_suffix + 1 > suffix + 1)
+    {
+        suffix = inverse_suffix;
+        period = inverse_period;
+    }
+    pat->split[reverse] = suffix + 1;
+    pat->periodic[reverse] = period < len;
+    for (unsigned long i = 0; pat->periodic[reverse] && i < pat->split[reverse]; i++)
+    {
+        pat->periodic[reverse] = FIL_AT_FOLD(needle, len, i, reverse, fold) == FIL_AT_FOLD(needle, len, i + period, reverse, fold);
+    }
+    pat->period[reverse] = pat->periodic[reverse]
+        ? period
+        : FIL_MAX(pat->split[reverse], len - pat->split[reverse]) + 1;
+
+    // Bad character shifts, capped so the table stays 256 bytes.
+    memset(pat->skip[reverse], (int)FIL_MIN(len, 255), sizeof(pat->skip[reverse]));
+    for (unsigned long i = 0; i < len; i++)
+    {
+        pat->skip[reverse][FIL_AT_FOLD(needle, len, i, reverse, fold)] = (unsigned char)FIL_MIN(len - 1 - i, 255);
+    }
+    pat->ready[reverse] = 1;
+}
+
+static inline const char *fil_twoway_scan(const Fil_Pattern *pat, const char *hay,
+                                          unsigned long n, int reverse, int fold)
+{
+    const unsigned char *needle = (const unsigned char *)pat->needle;
+    const unsigned char *skip = pat->skip[reverse];
+    const unsigned char *h = (const unsigned char *)hay;
+    const unsigned long len = pat->len;
+    const unsigned long split = pat->split[reverse];
+    const unsigned long period = pat->period[reverse];
+    const unsigned long period_memory = pat->periodic[reverse] ? len - period : 0;
+    unsigned long memory = 0;
+    unsigned long pos = 0;
+
+    while (pos + len <= n)
+    {
+        unsigned long shift = skip[FIL_AT_FOLD(h, n, pos + len - 1, reverse, fold)];
+        if (shift)
+        {
+            // A periodic needle cannot match before the out of place byte.
+            if (memory && shift < period && shift < 255) shift = len - period;
+            memory = 0;
+            pos += shift;
+            continue;
+        }
+        unsigned long i = FIL_MAX(split, memory);
+        while (i < len - 1 && FIL_AT_FOLD(needle, len, i, reverse, fold) == FIL_AT_FOLD(h, n, pos + i, reverse, fold))
+        {
+            i++;
+        }
+        if (i < len - 1)
+        {
+            pos += i - split + 1;
+            memory = 0;
+            continue;
+        }
+        i = split;
+        while (i > memory && FIL_AT_FOLD(needle, len, i - 1, reverse, fold) == FIL_AT_FOLD(h, n, pos + i - 1, reverse, fold))
+        {
+            i--;
+        }
+        if (i <= memory) return reverse ? hay + n - pos - len : hay + pos;
+        pos += period;
+        memory = period_memory;
+    }
+    return ((void*)0);
+}
+
+static inline const char *fil_twoway(const Fil_Pattern *pat, const char *hay,
+                                     unsigned long n, int reverse)
+{
+    if (!pat->ready[reverse])
+    {
+        // Transient patterns are read only too, prepare a private copy.
+        Fil_Pattern prepared = *pat;
+        fil_twoway_prepare(&prepared, reverse, 0);
+        return fil_twoway_scan(&prepared, hay, n, reverse, 0);
+    }
+    return fil_twoway_scan(pat, hay, n, reverse, 0);
+}
+
+/**
+ * Two-Way search ignoring case, the tables are built on the folded needle
+ * and the haystack is folded as it is read.
+ */
+static const char *fil_twoway_ci(const char *hay, unsigned long n, const char *needle,
+                                 unsigned long m, int reverse)
+{
+    Fil_Pattern pat;
+
+    pat.needle = needle;
+    pat.len = m;
+    fil_twoway_prepare(&pat, reverse, 1);
+    return fil_twoway_scan(&pat, hay, n, reverse, 1);
+}
+
+#ifdef FIL_X86_SIMD
+FIL_TARGET("sse2")
+static const char *fil_find_short_sse2(const Fil_Pattern *pat, const char *hay, unsigned long n)
+{
+    const char *needle = pat->needle;
+    const unsigned long len = pat->len;
+    const unsigned long last = len - 1;
+    const unsigned long rare1 = pat->rare[0];
+    const unsigned long rare2 = pat->rare[1];
+    const __m128i byte1 = _mm_set1_epi8(needle[rare1]);
+    const __m128i byte2 = _mm_set1_epi8(needle[rare2]);
+    unsigned long checks = 0;
+    unsigned long i = 0;
+
+    for (; i + last + 16 <= n; i += 16)
+    {
+        // Too many false positives, let Two-Way finish the haystack.
+        if (checks > (i >> 3) + 64) return fil_twoway(pat, hay + i, n - i, FIL_FORWARD);
+
+        __m128i eq1 = _mm_cmpeq_epi8(byte1, _mm_loadu_si128((const __m128i *)(hay + i + rare1)));
+        __m128i eq2 = _mm_cmpeq_epi8(byte2, _mm_loadu_si128((const __m128i *)(hay + i + rare2)));
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(_mm_and_si128(eq1, eq2));
+        while (mask)
+        {
+            const char *candidate = hay + i + __builtin_ctz(mask);
+            if (!memcmp(candidate, needle, len)) return candidate;
+            mask &= mask - 1;
+            checks++;
+        }
+    }
+    for (; i + last < n; i++)
+    {
+        if (hay[i + rare1] == needle[rare1] && !memcmp(hay + i, needle, len)) return hay + i;
+    }
+    return ((void*)0);
+}
+
+FIL_TARGET("avx2")
+static const char *fil_find_short_avx2(const Fil_Pattern *pat, const char *hay, unsigned long n)
+{
+    const char *needle = pat->needle;
+    const unsigned long len = pat->len;
+    const unsigned long last = len - 1;
+    const unsigned long rare1 = pat->rare[0];
+    const unsigned long rare2 = pat->rare[1];
+    const __m256i byte1 = _mm256_set1_epi8(needle[rare1]);
+    const __m256i byte2 = _mm256_set1_epi8(needle[rare2]);
+    unsigned long checks = 0;
+    unsigned long i = 0;
+
+    for (; i + last + 32 <= n; i += 32)
+    {
+        if (checks > (i >> 3) + 64) return fil_twoway(pat, hay + i, n - i, FIL_FORWARD);
+
+        __m256i eq1 = _mm256_cmpeq_epi8(byte1, _mm256_loadu_si256((const __m256i *)(hay + i + rare1)));
+        __m256i eq2 = _mm256_cmpeq_epi8(byte2, _mm256_loadu_si256((const __m256i *)(hay + i + rare2)));
+        unsigned int mask = (unsigned int)_mm256_movemask_epi8(_mm256_and_si256(eq1, eq2));
+        while (mask)
+        {
+            const char *candidate = hay + i + __builtin_ctz(mask);
+            if (!memcmp(candidate, needle, len)) return candidate;
+            mask &= mask - 1;
+            checks++;
+        }
+    }
+    for (; i + last < n; i++)
+    {
+        if (hay[i + rare1] == needle[rare1] && !memcmp(hay + i, needle, len)) return hay + i;
+    }
+    return ((void*)0);
+}
+
+/**
+ * Backward filters, blocks of candidate positions are taken from the end
+ * and each mask is walked from its highest bit.
+ */
+FIL_TARGET("sse2")
+static const char *fil_rfind_short_sse2(const Fil_Pattern *pat, const char *hay, unsigned long n)
+{
+    const char *needle = pat->needle;
+    const unsigned long len = pat->len;
+    const unsigned long last = len - 1;
+    const unsigned long rare1 = pat->rare[0];
+    const unsigned long rare2 = pat->rare[1];
+    const __m128i byte1 = _mm_set1_epi8(needle[rare1]);
+    const __m128i byte2 = _mm_set1_epi8(needle[rare2]);
+    const unsigned long positions = n - last;
+    unsigned long checks = 0;
+    unsigned long top = positions;
+
+    for (; top >= 16; top -= 16)
+    {
+        if (checks > ((positions - top) >> 3) + 64) return fil_twoway(pat, hay, top + last, FIL_BACKWARD);
+
+        const char *block = hay + top - 16;
+        __m128i eq1 = _mm_cmpeq_epi8(byte1, _mm_loadu_si128((const __m128i *)(block + rare1)));
+        __m128i eq2 = _mm_cmpeq_epi8(byte2, _mm_loadu_si128((const __m128i *)(block + rare2)));
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(_mm_and_si128(eq1, eq2));
+        while (mask)
+        {
+            int bit = 31 - __builtin_clz(mask);
+            if (!memcmp(block + bit, needle, len)) return block + bit;
+            mask &= ~(1u << bit);
+            checks++;
+        }
+    }
+    while (top--)
+    {
+        if (hay[top + rare1] == needle[rare1] && !memcmp(hay + top, needle, len)) return hay + top;
+    }
+    return ((void*)0);
+}
+
+FIL_TARGET("avx2")
+static const char *fil_rfind_short_avx2(const Fil_Pattern *pat, const char *hay, unsigned long n)
+{
+    const char *needle = pat->needle;
+    const unsigned long len = pat->len;
+    const unsigned long last = len - 1;
+    const unsigned long rare1 = pat->rare[0];
+    const unsigned long rare2 = pat->rare[1];
+    const __m256i byte1 = _mm256_set1_epi8(needle[rare1]);
+    const __m256i byte2 = _mm256_set1_epi8(needle[rare2]);
+    const unsigned long positions = n - last;
+    unsigned long checks = 0;
+    unsigned long top = positions;
+
+    for (; top >= 32; top -= 32)
+    {
+        if (checks > ((positions - top) >> 3) + 64) return fil_twoway(pat, hay, top + last, FIL_BACKWARD);
+
+        const char *block = hay + top - 32;
+        __m256i eq1 = _mm256_cmpeq_epi8(byte1, _mm256_loadu_si256((const __m256i *)(block + rare1)));
+        __m256i eq2 = _mm256_cmpeq_epi8(byte2, _mm256_loadu_si256((const __m256i *)(block + rare2)));
+        unsigned int mask = (unsigned int)_mm256_movemask_epi8(_mm256_and_si256(eq1, eq2));
+        while (mask)
+        {
+            int bit = 31 - __builtin_clz(mask);
+            if (!memcmp(block + bit, needle, len)) return block + bit;
+            mask &= ~(1u << bit);
+            checks++;
+        }
+    }
+    while (top--)
+    {
+        if (hay[top + rare1] == needle[rare1] && !memcmp(hay + top, needle, len)) return hay + top;
+    }
+    return ((void*)0);
+}
+#endif // FIL_X86_SIMD
+
+/**
+ * Points pat at needle and picks the filter bytes, nothing is copied.
+ * The Two-Way tables are computed on first use unless twoway is set.
+ */
+static void fil_pattern_prepare(Fil_Pattern *pat, const char *needle, unsigned long len, int twoway)
+{
+    const unsigned char *bytes = (const unsigned char *)needle;
+
+    pat->needle = needle;
+    pat->len = len;
+    pat->ready[FIL_FORWARD] = 0;
+    pat->ready[FIL_BACKWARD] = 0;
+
+    // Two rarest bytes, preferring distinct values so both comparisons filter.
+    pat->rare[0] = 0;
+    for (unsigned long i = 1; i < len; i++)
+    {
+        if (fil_byte_rank[bytes[i]] < fil_byte_rank[bytes[pat->rare[0]]]) pat->rare[0] = i;
+    }
+    pat->rare[1] = pat->rare[0] ? 0 : len - 1;
+    for (unsigned long i = 0; i < len; i++)
+    {
+        if (i == pat->rare[0]) continue;
+        int distinct = bytes[i] != bytes[pat->rare[0]];
+        int best_distinct = bytes[pat->rare[1]] != bytes[pat->rare[0]];
+        if (distinct > best_distinct ||
+            (distinct == best_distinct && fil_byte_rank[bytes[i]] < fil_byte_rank[bytes[pat->rare[1]]]))
+        {
+            pat->rare[1] = i;
+        }
+    }
+
+    if (twoway)
+    {
+        fil_twoway_prepare(pat, FIL_FORWARD, 0);
+        fil_twoway_prepare(pat, FIL_BACKWARD, 0);
+    }
+}
+
+/**
+ * Returns the first occurence of the pattern in the n bytes of hay, NULL if absent.
+ */
+static const char *fil_pattern_find(const Fil_Pattern *pat, const char *hay, unsigned long n)
+{
+    if (pat->len > n) return ((void*)0);
+    if (pat->len == 1) return fil_memchr(hay, pat->needle[0], n);
+#ifdef FIL_X86_SIMD
+    if (pat->len <= FIL_SHORT_NEEDLE)
+    {
+        int features = fil_cpu_features();
+        if (features & FIL_CPU_AVX2) return FIL_STAT_FIND(hay, n, pat->len, fil_find_short_avx2(pat, hay, n));
+        if (features & FIL_CPU_SSE2) return FIL_STAT_FIND(hay, n, pat->len, fil_find_short_sse2(pat, hay, n));
+    }
+#endif
+    return FIL_STAT_FIND(hay, n, pat->len, fil_twoway(pat, hay, n, FIL_FORWARD));
+}
+
+/**
+ * Returns the last occurence of the pattern in the n bytes of hay, NULL if absent.
+ */
+static const char *fil_pattern_rfind(const Fil_Pattern *pat, const char *hay, unsigned long n)
+{
+    if (pat->len > n) return ((void*)0);
+    if (pat->len == 1) return fil_memrchr(hay, pat->needle[0], n);
+#ifdef FIL_X86_SIMD
+    if (pat->len <= FIL_SHORT_NEEDLE)
+    {
+        int features = fil_cpu_features();
+        if (features & FIL_CPU_AVX2) return FIL_STAT_RFIND(hay, n, pat->len, fil_rfind_short_avx2(pat, hay, n));
+        if (features & FIL_CPU_SSE2) return FIL_STAT_RFIND(hay, n, pat->len, fil_rfind_short_sse2(pat, hay, n));
+    }
+#endif
+    return FIL_STAT_RFIND(hay, n, pat->len, fil_twoway(pat, hay, n, FIL_BACKWARD));
+}
+
+/**
+ * Returns the index-th occurence of the pattern in the n bytes of hay, NULL if absent.
+ * Occurences are counted left to right without overlapping.
+ */
+static const char *fil_pattern_ifind(const Fil_Pattern *pat, const char *hay, unsigned long n,
+                                     unsigned long index)
+{
+    const char *end = hay + n;
+    const char *found;
+
+    while ((found = fil_pattern_find(pat, hay, (unsigned long)(end - hay))))
+    {
+        if (--index == 0) return found;
+        hay = found + pat->len;
+    }
+    return ((void*)0);
+}
+
+/**
+ * Copies the n bytes of in to out with every occurence of the pattern
+ * replaced by with. out may alias in as long as the output never overtakes
+ * the input still to be read.
+ * Returns the output length.
+ */
+static unsigned long fil_replace_into(const Fil_Pattern *pat, char *out, const char *in,
+                                      unsigned long n, const char *with, unsigned long with_len)
+{
+    const char *end = in + n;
+    char *write = out;
+    const char *found;
+
+    while ((found = fil_pattern_find(pat, in, (unsigned long)(end - in))))
+    {
+        if (write != in) memmove(write, in, (unsigned long)(found - in));
+        write += found - in;
+        memcpy(write, with, with_len);
+        write += with_len;
+        in = found + pat->len;
+    }
+    if (write != in) memmove(write, in, (unsigned long)(end - in));
+    write += end - in;
+    return (unsigned long)(write - out);
+}
+
+/**
+ * Replace-all engine, the matches are counted once to size the output,
+ * the Fil is resized at most once and the result is built in a single pass.
+ * Shrinking and same length replacements are done in place. Growing ones are
+ * done in place too when the capacity allows it, the string is first moved
+ * to the end of the buffer so the output never overtakes the input.
+ */
+static int fil_replace_all(Fil *fil, const Fil_Pattern *pat, const char *s2, unsigned long s2_len)
+{
+    if (!FIL_HAS_STR(fil)) return FIL_ERR_SEQNOTFOUND;
+
+    const char *end = FIL_STR(fil) + fil->len;
+    const char *found = fil_pattern_find(pat, FIL_STR(fil), fil->len);
+    if (!found) return FIL_ERR_SEQNOTFOUND;
+
+    unsigned long new_len = fil->len;
+    if (s2_len > pat->len)
+    {
+        unsigned long count = 0;
+        while (found)
+        {
+            count++;
+            found += pat->len;
+            found = fil_pattern_find(pat, found, (unsigned long)(end - found));
+        }
+        new_len += count * (s2_len - pat->len);
+    }
+
+    unsigned long new_cap = fil_grow(fil, new_len + 1);
+    if (new_len + 1 > FIL_CAP(fil) && !fil_extend(fil, new_cap))
+    {
+        char *out = fil_alloc(fil, new_cap);
+        if (!out) return FIL_ERR_MEMORY;
+        FIL_STAT_ADD(reallocs, 1);
+        FIL_STAT_ADD(realloc_bytes, new_cap);
+        fil_replace_into(pat, out, FIL_STR(fil), fil->len, s2, s2_len);
+        fil_release(fil);
+        fil_adopt(fil, out, new_cap);
+    }
+    else
+    {
+        unsigned long shift = new_len > fil->len ? new_len - fil->len : 0;
+        if (shift) memmove(FIL_STR(fil) + shift, FIL_STR(fil), fil->len);
+        new_len = fil_replace_into(pat, FIL_STR(fil), FIL_STR(fil) + shift, fil->len, s2, s2_len);
+        FIL_STAT_ADD(copied, shift ? fil->len : 0);
+    }
+    FIL_STAT_ADD(copied, new_len);
+    FIL_STR(fil)[new_len] = 0;
+    fil->len = new_len;
+    return 0;
+}
+
+void Fil_free(Fil *fil)
+{
+    fil_stat_capacity(FIL_CAP(fil));
+    fil_release(fil);
+    fil_adopt(fil, ((void*)0), 0);
+    fil->len = 0;
+}
+
+char *Fil_str(const Fil *fil)
+{
+    if (!fil) return ((void*)0);
+    return FIL_IS_INLINE(fil) ? (char *)fil->buf.sso : fil->buf.heap.string;
+}
+
+unsigned long Fil_capacity(const Fil *fil)
+{
+    return fil ? FIL_CAP(fil) : 0;
+}
+
+/**
+ * Moves the string of src into dest, freeing the previous dest string.
+ * Both must allocate from the same place, the same heap allocator or arena.
+ * src is left empty.
+ */
+static void fil_move(Fil *dest, Fil *src)
+{
+    Fil_free(dest);
+    dest->buf = src->buf;
+    dest->is_inline = src->is_inline;
+    dest->len = src->len;
+    fil_adopt(src, ((void*)0), 0);
+    src->len = 0;
+}
+
+int Fil_resize(Fil *fil, unsigned long new_cap)
+{
+    if (!fil || new_cap <= 0) return FIL_ERR_PARAM;
+
+    if (!FIL_HAS_STR(fil) || FIL_IS_INLINE(fil))
+    {
+        if (new_cap <= FIL_SSO_CAPACITY)
+        {
+            fil->is_inline = 1;
+            return 0;
+        }
+        char *block = fil_alloc(fil, new_cap);
+        if (!block) return FIL_ERR_MEMORY;
+        FIL_STAT_ADD(reallocs, 1);
+        FIL_STAT_ADD(realloc_bytes, new_cap);
+        if (FIL_IS_INLINE(fil))
+        {
+            memcpy(block, fil->buf.sso, FIL_SSO_CAPACITY);
+            FIL_STAT_ADD(copied, FIL_SSO_CAPACITY);
+        }
+        fil_adopt(fil, block, new_cap);
+        return 0;
+    }
+
+    if (fil->arena)
+    {
+        if (fil_extend(fil, new_cap)) return 0;
+        char *block = fil_arena_bump(fil->arena, new_cap);
+        if (!block) return FIL_ERR_MEMORY;
+        FIL_STAT_ADD(reallocs, 1);
+        FIL_STAT_ADD(realloc_bytes, new_cap);
+        memcpy(block, fil->buf.heap.string, FIL_MIN(fil->buf.heap.capacity, new_cap));
+        FIL_STAT_ADD(copied, FIL_MIN(fil->buf.heap.capacity, new_cap));
+        fil_adopt(fil, block, new_cap);
+        return 0;
+    }
+
+    char *tmp = fil_realloc(fil, new_cap);
+    if (!tmp) return FIL_ERR_MEMORY;
+    FIL_STAT_ADD(reallocs, 1);
+    FIL_STAT_ADD(realloc_bytes, new_cap);
+    fil_adopt(fil, tmp, new_cap);
+    return 0;
+}
+
+int Fil_set_growth(Fil *fil, int policy, unsigned long step)
+{
+    if (!fil || policy < FIL_GROW_GEOMETRIC || policy > FIL_GROW_EXACT) return FIL_ERR_PARAM;
+    if (policy == FIL_GROW_STEP && !step) return FIL_ERR_PARAM;
+
+    fil->growth = policy;
+    fil->growth_step = step;
+    return 0;
+}
+
+int Fil_reserve(Fil *fil, unsigned long len)
+{
+    if (!fil) return FIL_ERR_PARAM;
+    if (FIL_HAS_STR(fil) && len < FIL_CAP(fil)) return 0;
+
+    return Fil_resize(fil, len + 1);
+}
+
+int Fil_shrink_to_fit(Fil *fil)
+{
+    if (!fil) return FIL_ERR_PARAM;
+    if (!FIL_HAS_STR(fil) || FIL_IS_INLINE(fil) || fil->len + 1 == FIL_CAP(fil)) return 0;
+
+    if (fil->len < FIL_SSO_CAPACITY)
+    {
+        // The inline buffer overlaps the heap pointer, go through a copy.
+        char copy[FIL_SSO_CAPACITY];
+        memcpy(copy, fil->buf.heap.string, fil->len);
+        copy[fil->len] = 0;
+        fil_release(fil);
+        memcpy(fil->buf.sso, copy, fil->len + 1);
+        fil->is_inline = 1;
+        return 0;
+    }
+    if (fil->arena)
+    {
+        fil_extend(fil, fil->len + 1);
+        return 0;
+    }
+    return Fil_resize(fil, fil->len + 1);
+}
+
+unsigned long Fil_len(const char *str)
+{
+    if (!str) return 0;
+
+#ifdef FIL_X86_SIMD
+    int features = fil_cpu_features();
+    if (features & FIL_CPU_AVX2) return fil_len_avx2(str);
+    if (features & FIL_CPU_SSE2) return fil_len_sse2(str);
+#endif
+    return fil_len_word(str);
+}
+
+unsigned long Fil_cpy(char *dest, const char *src)
+{
+    if (!dest || !src) return FIL_ERR_PARAM;
+
+    FIL_STAT_ADD(copied, Fil_len(src) + 1);
+#ifdef FIL_X86_SIMD
+    int features = fil_cpu_features();
+    if (features & FIL_CPU_AVX2)
+    {
+        fil_cpy_avx2(dest, src);
+        return 0;
+    }
+    if (features & FIL_CPU_SSE2)
+    {
+        fil_cpy_sse2(dest, src);
+        return 0;
+    }
+#endif
+    fil_cpy_word(dest, src);
+    return 0;
+}
+
+unsigned long Fil_cmp(const char *s1, const char *s2)
+{
+    if (!s1 ||!s2) return FIL_ERR_PARAM;
+
+    while(*s1 || *s2)
+    {
+        if (*s1++ != *s2++)
+        {
+            return FIL_CNEQ;
+        }
+    }
+    return FIL_CEQ;
+}
+
+static int fil_append_n(Fil *fil, const char *str, unsigned long str_len)
+{
+    unsigned long new_len = fil->len + str_len; 
+
+    if (new_len + 1 > FIL_CAP(fil))
+    {
+        // str may point into the string being resized.
+        int inside = FIL_HAS_STR(fil) && str >= FIL_STR(fil) && str < FIL_STR(fil) + FIL_CAP(fil);
+        unsigned long offset = inside ? (unsigned long)(str - FIL_STR(fil)) : 0;
+        if (Fil_resize(fil, fil_grow(fil, new_len + 1)))
+        {
+            return FIL_ERR_MEMORY;
+        }
+        if (inside) str = FIL_STR(fil) + offset;
+    }
+    if (str_len) memcpy(FIL_STR(fil) + fil->len, str, str_len);
+    FIL_STAT_ADD(copied, str_len);
+    FIL_STR(fil)[new_len] = 0;
+    fil->len = new_len;
+    return 0;
+}
+
+int Fil_append(Fil *fil, const char *str)
+{
+    if (!fil || !str) return FIL_ERR_PARAM;
+
+    return fil_append_n(fil, str, Fil_len(str));
+}
+
+int Fil_appendf(Fil *fil, const char *fmt, ...)
+{
+    if (!fil || !fmt) return FIL_ERR_PARAM;
+
+    va_list args;
+    unsigned long spare = FIL_CAP(fil) > fil->len ? FIL_CAP(fil) - fil->len : 0;
+    va_start(args, fmt);
+    int n = vsnprintf(spare ? FIL_STR(fil) + fil->len : ((void*)0), spare, fmt, args);
+    va_end(args);
+    if (n < 0) return FIL_ERR_PARAM;
+
+    unsigned long new_len = fil->len + (unsigned long)n;
+    if ((unsigned long)n + 1 > spare)
+    {
+        if (Fil_resize(fil, fil_grow(fil, new_len + 1)))
+        {
+            if (spare) FIL_STR(fil)[fil->len] = 0;
+            return FIL_ERR_MEMORY;
+        }
+        va_start(args, fmt);
+        vsnprintf(FIL_STR(fil) + fil->len, (unsigned long)n + 1, fmt, args);
+        va_end(args);
+    }
+    fil->len = new_len;
+    return 0;
+}
+
+static const char fil_digit_pairs[201] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+/**
+ * Writes the digits of n backward, ending just before end, two at a time.
+ * Returns a pointer to the first digit.
+ */
+static char *fil_format_u64(char *end, uint64_t n)
+{
+    while (n >= 100)
+    {
+        unsigned long pair = (unsigned long)(n % 100) * 2;
+        n /= 100;
+        *--end = fil_digit_pairs[pair + 1];
+        *--end = fil_digit_pairs[pair];
+    }
+    if (n >= 10)
+    {
+        *--end = fil_digit_pairs[n * 2 + 1];
+        *--end = fil_digit_pairs[n * 2];
+    }
+    else
+    {
+        *--end = (char)('0' + n);
+    }
+    return end;
+}
+
+int Fil_append_u64(Fil *fil, unsigned long long n)
+{
+    if (!fil) return FIL_ERR_PARAM;
+
+    char buf[20];
+    char *start = fil_format_u64(buf + sizeof(buf), n);
+    return fil_append_n(fil, start, (unsigned long)(buf + sizeof(buf) - start));
+}
+
+int Fil_append_i64(Fil *fil, long long n)
+{
+    if (!fil) return FIL_ERR_PARAM;
+
+    char buf[21];
+    // Negated as unsigned, -LLONG_MIN does not fit a long long.
+    uint64_t magnitude = n < 0 ? 0 - (uint64_t)n : (uint64_t)n;
+    char *start = fil_format_u64(buf + sizeof(buf), magnitude);
+    if (n < 0) *--start = '-';
+    return fil_append_n(fil, start, (unsigned long)(buf + sizeof(buf) - start));
+}
+
+/**
+ * Grisu3 shortest float formatting, from Florian Loitsch "Printing
+ * Floating-Point Numbers Quickly and Accurately with Integers".
+ * A double is handled as a do-it-yourself float, a 64 bits significand f
+ * and a binary exponent e. Grisu3 gives up on about 0.5% of the doubles,
+ * those it cannot prove shortest and closest, fil_dragon4 redoes them
+ * with exact big integers.
+ */
+typedef struct {
+    uint64_t f;
+    int e;
+} Fil_DiyFp;
+
+#define FIL_DP_SIGNIFICAND_MASK 0x000FFFFFFFFFFFFFULL
+#define FIL_DP_EXPONENT_MASK    0x7FF0000000000000ULL
+#define FIL_DP_HIDDEN_BIT       0x0010000000000000ULL
+
+// 10^k as normalized Fil_DiyFp, k from -348 to 340 by steps of 8,
+// generated with exact rational arithmetic and rounded to nearest.
+static const uint64_t fil_cached_powers_f[87] = {
+    0xfa8fd5a0081c0288ULL, 0xbaaee17fa23ebf76ULL, 0x8b16fb203055ac76ULL,
+    0xcf42894a5dce35eaULL, 0x9a6bb0aa55653b2dULL, 0xe61acf033d1a45dfULL,
+    0xab70fe17c79ac6caULL, 0xff77b1fcbebcdc4fULL, 0xbe5691ef416bd60cULL,
+    0x8dd01fad907ffc3cULL, 0xd3515c2831559a83ULL, 0x9d71ac8fada6c9b5ULL,
+    0xea9c227723ee8bcbULL, 0xaecc49914078536dULL, 0x823c12795db6ce57ULL,
+    0xc21094364dfb5637ULL, 0x9096ea6f3848984fULL, 0xd77485cb25823ac7ULL,
+    0xa086cfcd97bf97f4ULL, 0xef340a98172aace5ULL, 0xb23867fb2a35b28eULL,
+    0x84c8d4dfd2c63f3bULL, 0xc5dd44271ad3cdbaULL, 0x936b9fcebb25c996ULL,
+    0xdbac6c247d62a584ULL, 0xa3ab66580d5fdaf6ULL, 0xf3e2f893dec3f126ULL,
+    0xb5b5ada8aaff80b8ULL, 0x87625f056c7c4a8bULL, 0xc9bcff6034c13053ULL,
+    0x964e858c91ba2655ULL, 0xdff9772470297ebdULL, 0xa6dfbd9fb8e5b88fULL,
+    0xf8a95fcf88747d94ULL, 0xb94470938fa89bcfULL, 0x8a08f0f8bf0f156bULL,
+    0xcdb02555653131b6ULL, 0x993fe2c6d07b7facULL, 0xe45c10c42a2b3b06ULL,
+    0xaa242499697392d3ULL, 0xfd87b5f28300ca0eULL, 0xbce5086492111aebULL,
+    0x8cbccc096f5088ccULL, 0xd1b71758e219652cULL, 0x9c40000000000000ULL,
+    0xe8d4a51000000000ULL, 0xad78ebc5ac620000ULL, 0x813f3978f8940984ULL,
+    0xc097ce7bc90715b3ULL, 0x8f7e32ce7bea5c70ULL, 0xd5d238a4abe98068ULL,
+    0x9f4f2726179a2245ULL, 0xed63a231d4c4fb27ULL, 0xb0de65388cc8ada8ULL,
+    0x83c7088e1aab65dbULL, 0xc45d1df942711d9aULL, 0x924d692ca61be758ULL,
+    0xda01ee641a708deaULL, 0xa26da3999aef774aULL, 0xf209787bb47d6b85ULL,
+    0xb454e4a179dd1877ULL, 0x865b86925b9bc5c2ULL, 0xc83553c5c8965d3dULL,
+    0x952ab45cfa97a0b3ULL, 0xde469fbd99a05fe3ULL, 0xa59bc234db398c25ULL,
+    0xf6c69a72a3989f5cULL, 0xb7dcbf5354e9beceULL, 0x88fcf317f22241e2ULL,
+    0xcc20ce9bd35c78a5ULL, 0x98165af37b2153dfULL, 0xe2a0b5dc971f303aULL,
+    0xa8d9d1535ce3b396ULL, 0xfb9b7cd9a4a7443cULL, 0xbb764c4ca7a44410ULL,
+    0x8bab8eefb6409c1aULL, 0xd01fef10a657842cULL, 0x9b10a4e5e9913129ULL,
+    0xe7109bfba19c0c9dULL, 0xac2820d9623bf429ULL, 0x80444b5e7aa7cf85ULL,
+    0xbf21e44003acdd2dULL, 0x8e679c2f5e44ff8fULL, 0xd433179d9c8cb841ULL,
+    0x9e19db92b4e31ba9ULL, 0xeb96bf6ebadf77d9ULL, 0xaf87023b9bf0ee6bULL,
+};
+
+static const short fil_cached_powers_e[87] = {
+    -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980, -954, -927,
+    -901, -874, -847, -821, -794, -768, -741, -715, -688, -661, -635, -608,
+    -582, -555, -529, -502, -475, -449, -422, -396, -369, -343, -316, -289,
+    -263, -236, -210, -183, -157, -130, -103, -77, -50, -24, 3, 30,
+    56, 83, 109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+    375, 402, 428, 455, 481, 508, 534, 561, 588, 614, 641, 667,
+    694, 720, 747, 774, 800, 827, 853, 880, 907, 933, 960, 986,
+    1013, 1039, 1066,
+};
+
+static const uint64_t fil_pow10[20] = {
+    1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL,
+    100000000ULL, 1000000000ULL, 10000000000ULL, 100000000000ULL, 1000000000000ULL,
+    10000000000000ULL, 100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL,
+    100000000000000000ULL, 1000000000000000000ULL, 10000000000000000000ULL
+};
+
+static Fil_DiyFp fil_diyfp_mul(Fil_DiyFp x, Fil_DiyFp y)
+{
+    const uint64_t mask = 0xFFFFFFFFULL;
+    uint64_t a = x.f >> 32, b = x.f & mask, c = y.f >> 32, d = y.f & mask;
+    uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+    uint64_t tmp = (bd >> 32) + (ad & mask) + (bc & mask);
+    tmp += 1ULL << 31;  // Round.
+    Fil_DiyFp r = {ac + (ad >> 32) + (bc >> 32) + (tmp >> 32), x.e + y.e + 64};
+    return r;
+}
+
+static Fil_DiyFp fil_diyfp_normalize(Fil_DiyFp x)
+{
+    int shift = __builtin_clzll(x.f);
+    x.f <<= shift;
+    x.e -= shift;
+    return x;
+}
+
+/**
+ * Rounds the last digit down while it gets closer to w, then checks that
+ * the digits are within the interval and closest to w whatever the error
+ * of the scaled boundaries, unit, was.
+ * Returns 0 when that cannot be proven.
+ */
+static int fil_grisu_weed(char *buf, int len, uint64_t too_high_w, uint64_t unsafe, uint64_t rest,
+                          uint64_t ten_kappa, uint64_t unit)
+{
+    uint64_t small = too_high_w - unit;
+    uint64_t big = too_high_w + unit;
+
+    while (rest < small && unsafe - rest >= ten_kappa &&
+           (rest + ten_kappa < small || small - rest >= rest + ten_kappa - small))
+    {
+        buf[len - 1]--;
+        rest += ten_kappa;
+    }
+    // One more step down could be closer to the real w, undecided.
+    if (rest < big && unsafe - rest >= ten_kappa &&
+        (rest + ten_kappa < big || big - rest > rest + ten_kappa - big))
+    {
+        return 0;
+    }
+    return 2 * unit <= rest && rest <= unsafe - 4 * unit;
+}
+
+/**
+ * Generates the digits of w into buf, stopping as soon as they fall in
+ * (low, high) widened by the one unit error of the scaling.
+ * k is adjusted to the decimal exponent of the last digit.
+ * Returns the number of digits, 0 when Grisu3 cannot decide.
+ */
+static int fil_grisu_digits(Fil_DiyFp low, Fil_DiyFp w, Fil_DiyFp high, char *buf, int *k)
+{
+    uint64_t unit = 1;
+    uint64_t too_high = high.f + unit;
+    uint64_t unsafe = too_high - (low.f - unit);
+    Fil_DiyFp one = {1ULL << -w.e, w.e};
+    uint32_t p1 = (uint32_t)(too_high >> -one.e);
+    uint64_t p2 = too_high & (one.f - 1);
+    int len = 0;
+
+    int kappa = 1;
+    while (kappa < 10 && p1 >= fil_pow10[kappa]) kappa++;
+    while (kappa > 0)
+    {
+        uint32_t d = (uint32_t)(p1 / fil_pow10[kappa - 1]);
+        p1 = (uint32_t)(p1 % fil_pow10[kappa - 1]);
+        if (d || len) buf[len++] = (char)('0' + d);
+        kappa--;
+        uint64_t rest = ((uint64_t)p1 << -one.e) + p2;
+        if (rest < unsafe)
+        {
+            *k += kappa;
+            return fil_grisu_weed(buf, len, too_high - w.f, unsafe, rest,
+                                  fil_pow10[kappa] << -one.e, unit) ? len : 0;
+        }
+    }
+
+    for (;;)
+    {
+        p2 *= 10;
+        unit *= 10;
+        unsafe *= 10;
+        char d = (char)(p2 >> -one.e);
+        if (d || len) buf[len++] = (char)('0' + d);
+        p2 &= one.f - 1;
+        kappa--;
+        if (p2 < unsafe)
+        {
+            *k += kappa;
+            return fil_grisu_weed(buf, len, (too_high - w.f) * unit, unsafe, p2, one.f, unit) ? len : 0;
+        }
+    }
+}
+
+/**
+ * Significand and binary exponent of the finite positive bits, and whether
+ * the double below is closer than the one above, for powers of two.
+ */
+static Fil_DiyFp fil_diyfp_from_bits(uint64_t bits, int *lower_closer)
+{
+    int biased_e = (int)((bits & FIL_DP_EXPONENT_MASK) >> 52);
+    uint64_t significand = bits & FIL_DP_SIGNIFICAND_MASK;
+    Fil_DiyFp v;
+    if (biased_e)
+    {
+        v.f = significand + FIL_DP_HIDDEN_BIT;
+        v.e = biased_e - 1075;
+    }
+    else
+    {
+        v.f = significand;
+        v.e = -1074;
+    }
+    // The smallest normal is as far from the largest subnormal as from its successor.
+    *lower_closer = !significand && biased_e > 1;
+    return v;
+}
+
+/**
+ * Shortest digits of the finite positive bits d into buf, d = buf * 10^k.
+ * Returns the number of digits, 0 when Grisu3 cannot prove them shortest.
+ */
+static int fil_grisu3(uint64_t bits, char *buf, int *k)
+{
+    int lower_closer;
+    Fil_DiyFp v = fil_diyfp_from_bits(bits, &lower_closer);
+
+    // Boundaries halfway to the neighbouring doubles, plus normalized so
+    // that its top bit is set, minus on the same exponent.
+    Fil_DiyFp plus = {(v.f << 1) + 1, v.e - 1};
+    plus = fil_diyfp_normalize(plus);
+    Fil_DiyFp minus;
+    if (lower_closer)
+    {
+        minus.f = (v.f << 2) - 1;
+        minus.e = v.e - 2;
+    }
+    else
+    {
+        minus.f = (v.f << 1) - 1;
+        minus.e = v.e - 1;
+    }
+    minus.f <<= minus.e - plus.e;
+    minus.e = plus.e;
+
+    // Cached power bringing the exponent of plus in [-60, -32].
+    double dk = (-61 - plus.e) * 0.30102999566398114 + 347;
+    int ki = (int)dk;
+    if (dk - ki > 0.0) ki++;
+    unsigned int index = (unsigned int)((ki >> 3) + 1);
+    *k = -(-348 + (int)(index << 3));
+    Fil_DiyFp c_mk = {fil_cached_powers_f[index], fil_cached_powers_e[index]};
+
+    Fil_DiyFp w = fil_diyfp_mul(fil_diyfp_normalize(v), c_mk);
+    Fil_DiyFp wp = fil_diyfp_mul(plus, c_mk);
+    Fil_DiyFp wm = fil_diyfp_mul(minus, c_mk);
+    return fil_grisu_digits(wm, w, wp, buf, k);
+}
+
+/**
+ * Unsigned big integer for the exact fallback, 32 bits limbs from the least
+ * significant, used limbs only, the top one is never 0. The largest value
+ * handled, a subnormal scaled by 10^324, takes 36 limbs.
+ */
+#define FIL_BIG_LIMBS 40
+
+typedef struct {
+    uint32_t limb[FIL_BIG_LIMBS];
+    int used;
+} Fil_Big;
+
+static void fil_big_set(Fil_Big *b, uint64_t n)
+{
+    b->limb[0] = (uint32_t)n;
+    b->limb[1] = (uint32_t)(n >> 32);
+    b->used = b->limb[1] ? 2 : b->limb[0] ? 1 : 0;
+}
+
+static void fil_big_mul(Fil_Big *b, uint32_t m)
+{
+    uint64_t carry = 0;
+    for (int i = 0; i < b->used; i++)
+    {
+        carry += (uint64_t)b->limb[i] * m;
+        b->limb[i] = (uint32_t)carry;
+        carry >>= 32;
+    }
+    if (carry) b->limb[b->used++] = (uint32_t)carry;
+}
+
+static void fil_big_mul_pow10(Fil_Big *b, int n)
+{
+    for (; n >= 9; n -= 9) fil_big_mul(b, 1000000000U);
+    fil_big_mul(b, (uint32_t)fil_pow10[n]);
+}
+
+static void fil_big_shl(Fil_Big *b, int shift)
+{
+    if (!b->used) return;
+
+    int bits = shift % 32;
+    if (bits)
+    {
+        uint32_t carry = 0;
+        for (int i = 0; i < b->used; i++)
+        {
+            uint32_t limb = b->limb[i];
+            b->limb[i] = limb << bits | carry;
+            carry = limb >> (32 - bits);
+        }
+        if (carry) b->limb[b->used++] = carry;
+    }
+    int words = shift / 32;
+    if (words)
+    {
+        memmove(b->limb + words, b->limb, (unsigned long)b->used * sizeof(b->limb[0]));
+        memset(b->limb, 0, (unsigned long)words * sizeof(b->limb[0]));
+        b->used += words;
+    }
+}
+
+static int fil_big_cmp(const Fil_Big *a, const Fil_Big *b)
+{
+    if (a->used != b->used) return a->used < b->used ? -1 : 1;
+    for (int i = a->used; i-- > 0;)
+    {
+        if (a->limb[i] != b->limb[i]) return a->limb[i] < b->limb[i] ? -1 : 1;
+    }
+    return 0;
+}
+
+static void fil_big_add(Fil_Big *sum, const Fil_Big *a, const Fil_Big *b)
+{
+    if (a->used < b->used)
+    {
+        const Fil_Big *tmp = a;
+        a = b;
+        b = tmp;
+    }
+    uint64_t carry = 0;
+    for (int i = 0; i < a->used; i++)
+    {
+        carry += (uint64_t)a->limb[i] + (i < b->used ? b->limb[i] : 0);
+        sum->limb[i] = (uint32_t)carry;
+        carry >>= 32;
+    }
+    sum->used = a->used;
+    if (carry) sum->limb[sum->used++] = (uint32_t)carry;
+}
+
+/**
+ * a -= b, b must not be greater than a.
+ */
+static void fil_big_sub(Fil_Big *a, const Fil_Big *b)
+{
+    int64_t borrow = 0;
+    for (int i = 0; i < a->used; i++)
+    {
+        borrow += (int64_t)a->limb[i] - (i < b->used ? b->limb[i] : 0);
+        a->limb[i] = (uint32_t)borrow;
+        borrow = borrow < 0 ? -1 : 0;
+    }
+    while (a->used && !a->limb[a->used - 1]) a->used--;
+}
+
+/**
+ * Exact counterpart of fil_grisu3 for the doubles it cannot decide, free
+ * format digit generation from Burger and Dybvig "Printing Floating-Point
+ * Numbers Quickly and Accurately". d is r / s, the boundaries are m_minus / s
+ * below and m_plus / s above, all scaled by 10 for each digit produced.
+ * Returns the number of digits, always shortest and closest.
+ */
+static int fil_dragon4(uint64_t bits, char *buf, int *k)
+{
+    int lower_closer;
+    Fil_DiyFp v = fil_diyfp_from_bits(bits, &lower_closer);
+    // The boundaries are inclusive when an even significand wins the ties.
+    int even = !(v.f & 1);
+    Fil_Big r, s, m_plus, m_minus, high;
+
+    // Halfway to the neighbours is 2^(e - 1), or 2^(e - 2) below powers of two.
+    fil_big_set(&r, v.f << (1 + lower_closer));
+    fil_big_set(&s, 1ULL << (1 + lower_closer));
+    fil_big_set(&m_plus, 1ULL << lower_closer);
+    fil_big_set(&m_minus, 1);
+    if (v.e >= 0)
+    {
+        fil_big_shl(&r, v.e);
+        fil_big_shl(&m_plus, v.e);
+        fil_big_shl(&m_minus, v.e);
+    }
+    else
+    {
+        fil_big_shl(&s, -v.e);
+    }
+
+    // 10^(exponent - 1) <= d, the estimate is at most one short.
+    double estimate = (v.e + 63 - __builtin_clzll(v.f)) * 0.30102999566398114;
+    int exponent = (int)estimate;
+    if (estimate - exponent > 1e-10) exponent++;
+    if (exponent >= 0)
+    {
+        fil_big_mul_pow10(&s, exponent);
+    }
+    else
+    {
+        fil_big_mul_pow10(&r, -exponent);
+        fil_big_mul_pow10(&m_plus, -exponent);
+        fil_big_mul_pow10(&m_minus, -exponent);
+    }
+    fil_big_add(&high, &r, &m_plus);
+    if (fil_big_cmp(&high, &s) >= !even)
+    {
+        fil_big_mul(&s, 10);
+        exponent++;
+    }
+
+    int len = 0;
+    for (;;)
+    {
+        fil_big_mul(&r, 10);
+        fil_big_mul(&m_plus, 10);
+        fil_big_mul(&m_minus, 10);
+        char d = '0';
+        while (fil_big_cmp(&r, &s) >= 0)
+        {
+            fil_big_sub(&r, &s);
+            d++;
+        }
+        fil_big_add(&high, &r, &m_plus);
+        int low_ok = fil_big_cmp(&r, &m_minus) < even;
+        int high_ok = fil_big_cmp(&high, &s) >= !even;
+        if (low_ok && high_ok)
+        {
+            // Both ends are in, round to nearest, ties to even.
+            Fil_Big twice = r;
+            fil_big_mul(&twice, 2);
+            int c = fil_big_cmp(&twice, &s);
+            if (c > 0 || (c == 0 && (d & 1))) d++;
+        }
+        else if (high_ok)
+        {
+            d++;
+        }
+        buf[len++] = d;
+        if (low_ok || high_ok) break;
+    }
+    *k = exponent - len;
+    return len;
+}
+
+int Fil_append_f64(Fil *fil, double d)
+{
+    if (!fil) return FIL_ERR_PARAM;
+
+    uint64_t bits;
+    memcpy(&bits, &d, sizeof(bits));
+    char buf[40];
+    char *out = buf;
+    if (bits >> 63) *out++ = '-';
+    bits &= ~(1ULL << 63);
+
+    if ((bits & FIL_DP_EXPONENT_MASK) == FIL_DP_EXPONENT_MASK)
+    {
+        memcpy(out, bits & FIL_DP_SIGNIFICAND_MASK ? "nan" : "inf", 3);
+        return fil_append_n(fil, buf, (unsigned long)(out + 3 - buf));
+    }
+    if (!bits)
+    {
+        *out++ = '0';
+        return fil_append_n(fil, buf, (unsigned long)(out - buf));
+    }
+
+    int k;
+    int len = fil_grisu3(bits, out, &k);
+    if (!len) len = fil_dragon4(bits, out, &k);
+    int kk = len + k;   // 10^(kk-1) <= d < 10^kk
+    if (k >= 0 && kk <= 21)
+    {
+        // 1234e7 -> 12340000000
+        memset(out + len, '0', (unsigned long)k);
+        out += kk;
+    }
+    else if (kk > 0 && kk <= 21)
+    {
+        // 1234e-2 -> 12.34
+        memmove(out + kk + 1, out + kk, (unsigned long)(len - kk));
+        out[kk] = '.';
+        out += len + 1;
+    }
+    else if (kk > -6 && kk <= 0)
+    {
+        // 1234e-6 -> 0.001234
+        int offset = 2 - kk;
+        memmove(out + offset, out, (unsigned long)len);
+        out[0] = '0';
+        out[1] = '.';
+        memset(out + 2, '0', (unsigned long)(offset - 2));
+        out += len + offset;
+    }
+    else
+    {
+        // 1234e30 -> 1.234e+33
+        if (len > 1)
+        {
+            memmove(out + 2, out + 1, (unsigned long)(len - 1));
+            out[1] = '.';
+            out += len + 1;
+        }
+        else
+        {
+            out++;
+        }
+        int exponent = kk - 1;
+        *out++ = 'e';
+        *out++ = exponent < 0 ? '-' : '+';
+        char exp_buf[4];
+        char *exp_end = exp_buf + sizeof(exp_buf);
+        char *exp_start = fil_format_u64(exp_end, (uint64_t)(exponent < 0 ? -exponent : exponent));
+        memcpy(out, exp_start, (unsigned long)(exp_end - exp_start));
+        out += exp_end - exp_start;
+    }
+    return fil_append_n(fil, buf, (unsigned long)(out - buf));
+}
+
+int Fil_merge(Fil *dest, Fil *src)
+{
+    if (!dest || !src) return FIL_ERR_PARAM;
+
+    unsigned long new_len = dest->len + src->len; 
+
+    if (new_len + 1 > FIL_CAP(dest))
+    {
+        if (Fil_resize(dest, fil_grow(dest, new_len + 1)))
+        {
+            return FIL_ERR_MEMORY;
+        }
+    }
+    if (src->len) memcpy(FIL_STR(dest) + dest->len, FIL_STR(src), src->len);
+    FIL_STAT_ADD(copied, src->len);
+    FIL_STR(dest)[new_len] = 0;
+    dest->len = new_len;
+    return 0;
+}
+
+int Fil_rfstr(Fil *fil, const char *s1, const char *s2)
+{
+    if (!fil || !s1 || !s2) return FIL_ERR_PARAM;
+
+    return Fil_rfstr_v(fil, Fil_view_cstr(s1), Fil_view_cstr(s2));
+}
+
+int Fil_rastr(Fil *fil, const char *s1, const char *s2)
+{
+    if (!fil || !s1 || !s2) return FIL_ERR_PARAM;
+
+    return Fil_rastr_v(fil, Fil_view_cstr(s1), Fil_view_cstr(s2));
+}
+
+int Fil_rlstr(Fil *fil, const char *s1, const char *s2)
+{
+    if (!fil || !s1 || !s2) return FIL_ERR_PARAM;
+
+    return Fil_rlstr_v(fil, Fil_view_cstr(s1), Fil_view_cstr(s2));
+}
+
+int Fil_ristr(Fil *fil, const char *s1, unsigned long index, const char *s2)
+{
+    if (!fil || !s1 || index == 0 || !s2) return FIL_ERR_PARAM;
+
+    return Fil_ristr_v(fil, Fil_view_cstr(s1), index, Fil_view_cstr(s2));
+}
+
+char* Fil_sfstr(Fil *fil, const char *seq)
+{
+    if (!fil || !seq || !FIL_HAS_STR(fil)) return ((void*)0);
+
+    unsigned long found = Fil_sfstr_v(Fil_view(fil), Fil_view_cstr(seq));
+    return found == FIL_NPOS ? ((void*)0) : FIL_STR(fil) + found;
+}
+
+char* Fil_slstr(Fil *fil, const char *seq)
+{
+    if (!fil || !seq || !FIL_HAS_STR(fil)) return ((void*)0);
+
+    unsigned long found = Fil_slstr_v(Fil_view(fil), Fil_view_cstr(seq));
+    return found == FIL_NPOS ? ((void*)0) : FIL_STR(fil) + found;
+}
+
+char* Fil_sistr(Fil *fil, const char *seq, unsigned long index)
+{
+    if (!fil || !seq || index == 0 || !FIL_HAS_STR(fil)) return ((void*)0);
+
+    unsigned long found = Fil_sistr_v(Fil_view(fil), Fil_view_cstr(seq), index);
+    return found == FIL_NPOS ? ((void*)0) : FIL_STR(fil) + found;
+}
+
+char *Fil_sfstr_ci(Fil *fil, const char *seq)
+{
+    if (!fil || !seq || !FIL_HAS_STR(fil)) return ((void*)0);
+
+    unsigned long found = Fil_sfstr_ci_v(Fil_view(fil), Fil_view_cstr(seq));
+    return found == FIL_NPOS ? ((void*)0) : FIL_STR(fil) + found;
+}
+
+char *Fil_slstr_ci(Fil *fil, const char *seq)
+{
+    if (!fil || !seq || !FIL_HAS_STR(fil)) return ((void*)0);
+
+    unsigned long found = Fil_slstr_ci_v(Fil_view(fil), Fil_view_cstr(seq));
+    return found == FIL_NPOS ? ((void*)0) : FIL_STR(fil) + found;
+}
+
+char *Fil_sistr_ci(Fil *fil, const char *seq, unsigned long index)
+{
+    if (!fil || !seq || index == 0 || !FIL_HAS_STR(fil)) return ((void*)0);
+
+    unsigned long found = Fil_sistr_ci_v(Fil_view(fil), Fil_view_cstr(seq), index);
+    return found == FIL_NPOS ? ((void*)0) : FIL_STR(fil) + found;
+}
+
+char *Fil_sfchr(Fil *fil, const char c)
+{
+    if (!fil || !FIL_HAS_STR(fil)) return ((void*)0);
+
+    return (char *)fil_memchr(FIL_STR(fil), c, fil->len);
+}
+
+char *Fil_slchr(Fil *fil, const char c)
+{
+    if (!fil || !FIL_HAS_STR(fil)) return ((void*)0);
+
+    return (char *)fil_memrchr(FIL_STR(fil), c, fil->len);
+}
+
+char *Fil_sichr(Fil *fil, const char c, unsigned long index)
+{
+    if (!fil || !FIL_HAS_STR(fil) || index == 0) return ((void*)0);
+
+    const char *current = FIL_STR(fil);
+    const char *end = FIL_STR(fil) + fil->len;
+    const char *found;
+
+    while ((found = fil_memchr(current, c, (unsigned long)(end - current))))
+    {
+        if (--index == 0) return (char *)found;
+        current = found + 1;
+    }
+    return ((void*)0);
+}
+
+int Fil_rfchr(Fil *fil, const char c1, const char c2)
+{
+    if (!fil || !FIL_HAS_STR(fil)) return FIL_ERR_PARAM;
+
+    char *found = Fil_sfchr(fil, c1);
+    if (!found) return FIL_ERR_SEQNOTFOUND;
+    *found = c2;
+    return 0;
+}
+
+int Fil_rlchr(Fil *fil, const char c1, const char c2)
+{
+    if (!fil || !FIL_HAS_STR(fil)) return FIL_ERR_PARAM;
+
+    char *found = Fil_slchr(fil, c1);
+    if (!found) return FIL_ERR_SEQNOTFOUND;
+    *found = c2;
+    return 0;
+}
+
+int Fil_richr(Fil *fil, const char c1, unsigned long index, const char c2)
+{
+    if (!fil || !FIL_HAS_STR(fil) || index == 0) return FIL_ERR_PARAM;
+
+    char *found = Fil_sichr(fil, c1, index);
+    if (!found) return FIL_ERR_SEQNOTFOUND;
+    *found = c2;
+    return 0;
+}
+
+int Fil_pattern_init(Fil_Pattern *pat, const char *needle)
+{
+    if (!pat || !needle) return FIL_ERR_PARAM;
+
+    unsigned long len = Fil_len(needle);
+    if (!len) return FIL_ERR_PARAM;
+
+    char *copy = malloc(len + 1);
+    if (!copy) return FIL_ERR_MEMORY;
+    memcpy(copy, needle, len + 1);
+    fil_pattern_prepare(pat, copy, len, 1);
+    return 0;
+}
+
+void Fil_pattern_free(Fil_Pattern *pat)
+{
+    if (!pat) return;
+
+    free((void *)pat->needle);
+    pat->needle = ((void*)0);
+    pat->len = 0;
+}
+
+char *Fil_sfpat(Fil *fil, const Fil_Pattern *pat)
+{
+    if (!fil || !pat || !pat->len || !FIL_HAS_STR(fil)) return ((void*)0);
+
+    return (char *)fil_pattern_find(pat, FIL_STR(fil), fil->len);
+}
+
+char *Fil_slpat(Fil *fil, const Fil_Pattern *pat)
+{
+    if (!fil || !pat || !pat->len || !FIL_HAS_STR(fil)) return ((void*)0);
+
+    return (char *)fil_pattern_rfind(pat, FIL_STR(fil), fil->len);
+}
+
+char *Fil_sipat(Fil *fil, const Fil_Pattern *pat, unsigned long index)
+{
+    if (!fil || !pat || !pat->len || index == 0 || !FIL_HAS_STR(fil)) return ((void*)0);
+
+    return (char *)fil_pattern_ifind(pat, FIL_STR(fil), fil->len, index);
+}
+
+int Fil_rapat(Fil *fil, const Fil_Pattern *pat, const char *s2)
+{
+    if (!fil || !pat || !pat->len || !s2) return FIL_ERR_PARAM;
+
+    return fil_replace_all(fil, pat, s2, Fil_len(s2));
+}
+
+int Fil_dict_build(Fil_Dict *dict, const char **needles, const char **replacements, unsigned long count)
+{
+    if (!dict || !needles || !count) return FIL_ERR_PARAM;
+
+    memset(dict, 0, sizeof(*dict));
+    unsigned long needles_len = 0;
+    unsigned long replacements_len = 0;
+    unsigned int class_count = 1;
+
+    for (unsigned long i = 0; i < count; i++)
+    {
+        if (!needles[i] || !needles[i][0]) return FIL_ERR_PARAM;
+        if (replacements && !replacements[i]) return FIL_ERR_PARAM;
+
+        for (const unsigned char *c = (const unsigned char *)needles[i]; *c; c++, needles_len++)
+        {
+            if (!dict->classes[*c]) dict->classes[*c] = (unsigned short)class_count++;
+        }
+        if (replacements) replacements_len += Fil_len(replacements[i]);
+    }
+    if (needles_len >= 0xFFFFFFFFUL / class_count) return FIL_ERR_PARAM;
+
+    // The trie has at most one state per needle byte, plus the root.
+    unsigned long max_states = needles_len + 1;
+    unsigned int *fail = malloc(max_states * sizeof(unsigned int));
+    unsigned int *queue = malloc(max_states * sizeof(unsigned int));
+    dict->transitions = calloc(max_states * class_count, sizeof(unsigned int));
+    dict->outputs = calloc(max_states, sizeof(unsigned int));
+    dict->depths = calloc(max_states, sizeof(unsigned int));
+    dict->needle_lens = malloc(count * sizeof(unsigned long));
+    dict->replacement_offsets = malloc(count * sizeof(unsigned long));
+    dict->replacement_lens = malloc(count * sizeof(unsigned long));
+    dict->replacements = malloc(replacements_len + 1);
+    dict->count = count;
+    dict->class_count = class_count;
+    dict->state_count = 1;
+
+    if (!fail || !queue || !dict->transitions || !dict->outputs || !dict->depths ||
+        !dict->needle_lens || !dict->replacement_offsets || !dict->replacement_lens ||
+        !dict->replacements)
+    {
+        free(fail);
+        free(queue);
+        Fil_dict_free(dict);
+        return FIL_ERR_MEMORY;
+    }
+
+    unsigned long offset = 0;
+    for (unsigned long i = 0; i < count; i++)
+    {
+        unsigned int state = 0;
+        const unsigned char *c = (const unsigned char *)needles[i];
+        for (; *c; c++)
+        {
+            unsigned int *next = &dict->transitions[(unsigned long)state * class_count + dict->classes[*c]];
+            if (!*next)
+            {
+                *next = dict->state_count++;
+                dict->depths[*next] = dict->depths[state] + 1;
+            }
+            state = *next;
+        }
+        if (!dict->outputs[state]) dict->outputs[state] = (unsigned int)i + 1;
+        dict->needle_lens[i] = (unsigned long)(c - (const unsigned char *)needles[i]);
+
+        unsigned long replacement_len = replacements ? Fil_len(replacements[i]) : 0;
+        if (replacement_len) memcpy(dict->replacements + offset, replacements[i], replacement_len);
+        dict->replacement_offsets[i] = offset;
+        dict->replacement_lens[i] = replacement_len;
+        offset += replacement_len;
+    }
+    dict->replacements[offset] = 0;
+    if (!replacements)
+    {
+        free(dict->replacements);
+        dict->replacements = ((void*)0);
+    }
+
+    // Breadth first, so the failure state of every state is complete before
+    // its missing transitions are filled from it.
+    unsigned long head = 0;
+    unsigned long tail = 0;
+    for (unsigned int c = 0; c < class_count; c++)
+    {
+        unsigned int child = dict->transitions[c];
+        if (child)
+        {
+            fail[child] = 0;
+            queue[tail++] = child;
+        }
+    }
+    while (head < tail)
+    {
+        unsigned int state = queue[head++];
+        unsigned int *row = dict->transitions + (unsigned long)state * class_count;
+        const unsigned int *fail_row = dict->transitions + (unsigned long)fail[state] * class_count;
+
+        // The state own needle is longer than any needle ending at its failure state.
+        if (!dict->outputs[state]) dict->outputs[state] = dict->outputs[fail[state]];
+        for (unsigned int c = 0; c < class_count; c++)
+        {
+            if (row[c])
+            {
+                fail[row[c]] = fail_row[c];
+                queue[tail++] = row[c];
+            }
+            else
+            {
+                row[c] = fail_row[c];
+            }
+        }
+    }
+    free(fail);
+    free(queue);
+    return 0;
+}
+
+void Fil_dict_free(Fil_Dict *dict)
+{
+    if (!dict) return;
+
+    free(dict->transitions);
+    free(dict->outputs);
+    free(dict->depths);
+    free(dict->needle_lens);
+    free(dict->replacement_offsets);
+    free(dict->replacement_lens);
+    free(dict->replacements);
+    memset(dict, 0, sizeof(*dict));
+}
+
+/**
+ * Leftmost-longest scan of the n bytes of hay, starting at pos.
+ * A candidate is only reported once no partial match still alive in the
+ * automaton could start at or before it. Each call starts from the root,
+ * the bytes read past the reported match are read again by the next call:
+ * at most the longest needle length per match.
+ * Returns 1 and fills start and index when a match is found, 0 otherwise.
+ */
+static int fil_dict_next(const Fil_Dict *dict, const char *hay, unsigned long n, unsigned long pos,
+                         unsigned long *start, unsigned long *index)
+{
+    const unsigned char *h = (const unsigned char *)hay;
+    const unsigned int *transitions = dict->transitions;
+    const unsigned long class_count = dict->class_count;
+    unsigned int state = 0;
+    unsigned int best = 0;
+    unsigned long best_start = 0;
+
+    while (pos < n)
+    {
+        if (!state)
+        {
+            // Skip the bytes that keep the automaton at the root.
+            while (pos < n && !transitions[dict->classes[h[pos]]])
+            {
+                pos++;
+            }
+            if (pos == n) break;
+        }
+        state = transitions[state * class_count + dict->classes[h[pos++]]];
+
+        unsigned int output = dict->outputs[state];
+        if (output)
+        {
+            unsigned long output_start = pos - dict->needle_lens[output - 1];
+            if (!best || output_start <= best_start)
+            {
+                best = output;
+                best_start = output_start;
+            }
+        }
+        if (best && pos - dict->depths[state] > best_start) break;
+    }
+    if (!best) return 0;
+
+    *start = best_start;
+    *index = best - 1;
+    return 1;
+}
+
+char *Fil_smulti(Fil *fil, const Fil_Dict *dict, unsigned long *index)
+{
+    if (!fil || !dict || !dict->transitions || !FIL_HAS_STR(fil)) return ((void*)0);
+
+    unsigned long start, found_index;
+    if (!fil_dict_next(dict, FIL_STR(fil), fil->len, 0, &start, &found_index)) return ((void*)0);
+    if (index) *index = found_index;
+    return FIL_STR(fil) + start;
+}
+
+int Fil_rmulti(Fil *fil, const Fil_Dict *dict)
+{
+    if (!fil || !dict || !dict->transitions || !dict->replacements) return FIL_ERR_PARAM;
+    if (!FIL_HAS_STR(fil)) return FIL_ERR_SEQNOTFOUND;
+
+    unsigned long start, index;
+    unsigned long pos = 0;
+    if (!fil_dict_next(dict, FIL_STR(fil), fil->len, pos, &start, &index)) return FIL_ERR_SEQNOTFOUND;
+
+    Fil out = {0};
+    out.arena = fil->arena;
+    out.allocator = fil->allocator;
+    if (Fil_resize(&out, fil->len + 1)) return FIL_ERR_MEMORY;
+    FIL_STR(&out)[0] = 0;
+    do
+    {
+        if (fil_append_n(&out, FIL_STR(fil) + pos, start - pos) ||
+            fil_append_n(&out, dict->replacements + dict->replacement_offsets[index],
+                         dict->replacement_lens[index]))
+        {
+            Fil_free(&out);
+            return FIL_ERR_MEMORY;
+        }
+        pos = start + dict->needle_lens[index];
+    } while (fil_dict_next(dict, FIL_STR(fil), fil->len, pos, &start, &index));
+
+    if (fil_append_n(&out, FIL_STR(fil) + pos, fil->len - pos))
+    {
+        Fil_free(&out);
+        return FIL_ERR_MEMORY;
+    }
+    fil_move(fil, &out);
+    return 0;
+}
+
+// A view may only have a NULL ptr when it is empty.
+#define FIL_VIEW_VALID(view) ((view).ptr || !(view).len)
+
+Fil_View Fil_view(const Fil *fil)
+{
+    Fil_View view = {0};
+    if (!fil || !FIL_HAS_STR(fil)) return view;
+
+    view.ptr = FIL_STR(fil);
+    view.len = fil->len;
+    return view;
+}
+
+Fil_View Fil_view_cstr(const char *str)
+{
+    Fil_View view = {str, Fil_len(str)};
+    return view;
+}
+
+Fil_View Fil_view_sub(Fil_View view, unsigned long start, unsigned long len)
+{
+    start = FIL_MIN(start, view.len);
+    Fil_View sub = {view.ptr ? view.ptr + start : view.ptr, FIL_MIN(len, view.len - start)};
+    return sub;
+}
+
+int Fil_append_v(Fil *fil, Fil_View view)
+{
+    if (!fil || !FIL_VIEW_VALID(view)) return FIL_ERR_PARAM;
+
+    return fil_append_n(fil, view.ptr, view.len);
+}
+
+unsigned long Fil_cmp_v(Fil_View v1, Fil_View v2)
+{
+    if (!FIL_VIEW_VALID(v1) || !FIL_VIEW_VALID(v2)) return FIL_ERR_PARAM;
+
+    if (v1.len != v2.len) return FIL_CNEQ;
+    if (v1.len && memcmp(v1.ptr, v2.ptr, v1.len)) return FIL_CNEQ;
+    return FIL_CEQ;
+}
+
+unsigned long Fil_sfstr_v(Fil_View hay, Fil_View seq)
+{
+    if (!hay.ptr || !seq.ptr || !seq.len) return FIL_NPOS;
+
+    Fil_Pattern pat;
+    fil_pattern_prepare(&pat, seq.ptr, seq.len, 0);
+    const char *found = fil_pattern_find(&pat, hay.ptr, hay.len);
+    return found ? (unsigned long)(found - hay.ptr) : FIL_NPOS;
+}
+
+unsigned long Fil_slstr_v(Fil_View hay, Fil_View seq)
+{
+    if (!hay.ptr || !seq.ptr || !seq.len) return FIL_NPOS;
+
+    Fil_Pattern pat;
+    fil_pattern_prepare(&pat, seq.ptr, seq.len, 0);
+    const char *found = fil_pattern_rfind(&pat, hay.ptr, hay.len);
+    return found ? (unsigned long)(found - hay.ptr) : FIL_NPOS;
+}
+
+unsigned long Fil_sistr_v(Fil_View hay, Fil_View seq, unsigned long index)
+{
+    if (!hay.ptr || !seq.ptr || !seq.len || index == 0) return FIL_NPOS;
+
+    Fil_Pattern pat;
+    fil_pattern_prepare(&pat, seq.ptr, seq.len, 0);
+    const char *found = fil_pattern_ifind(&pat, hay.ptr, hay.len, index);
+    return found ? (unsigned long)(found - hay.ptr) : FIL_NPOS;
+}
+
+static int fil_eq_ci(const char *s1, const char *s2, unsigned long n)
+{
+    for (unsigned long i = 0; i < n; i++)
+    {
+        if (fil_fold(s1[i]) != fil_fold(s2[i])) return 0;
+    }
+    return 1;
+}
+
+/**
+ * Case flipping and folding, a byte is a letter of the flipped case when
+ * it is in [first, first + 26). Bytes >= 0x80 are negative and never are.
+ * The search compares the folded first and last bytes of the needle at
+ * each position, only candidates matching both are compared in full.
+ */
+#ifdef FIL_X86_SIMD
+FIL_TARGET("sse2")
+static void fil_flip_case_sse2(char *str, unsigned long n, char first)
+{
+    const __m128i below = _mm_set1_epi8((char)(first - 1));
+    const __m128i above = _mm_set1_epi8((char)(first + 26));
+    const __m128i bit = _mm_set1_epi8(0x20);
+    unsigned long i = 0;
+
+    for (; i + 16 <= n; i += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(str + i));
+        __m128i in = _mm_and_si128(_mm_cmpgt_epi8(v, below), _mm_cmpgt_epi8(above, v));
+        _mm_storeu_si128((__m128i *)(str + i), _mm_xor_si128(v, _mm_and_si128(in, bit)));
+    }
+    for (; i < n; i++)
+    {
+        if ((unsigned char)(str[i] - first) < 26) str[i] ^= 0x20;
+    }
+}
+
+FIL_TARGET("avx2")
+static void fil_flip_case_avx2(char *str, unsigned long n, char first)
+{
+    const __m256i below = _mm256_set1_epi8((char)(first - 1));
+    const __m256i above = _mm256_set1_epi8((char)(first + 26));
+    const __m256i bit = _mm256_set1_epi8(0x20);
+    unsigned long i = 0;
+
+    for (; i + 32 <= n; i += 32)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(str + i));
+        __m256i in = _mm256_and_si256(_mm256_cmpgt_epi8(v, below), _mm256_cmpgt_epi8(above, v));
+        _mm256_storeu_si256((__m256i *)(str + i), _mm256_xor_si256(v, _mm256_and_si256(in, bit)));
+    }
+    for (; i < n; i++)
+    {
+        if ((unsigned char)(str[i] - first) < 26) str[i] ^= 0x20;
+    }
+}
+
+FIL_TARGET("sse2")
+static inline __m128i fil_fold_sse2(__m128i v)
+{
+    __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('A' - 1)),
+                                  _mm_cmpgt_epi8(_mm_set1_epi8('Z' + 1), v));
+    return _mm_or_si128(v, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
+}
+
+FIL_TARGET("sse2")
+static const char *fil_find_ci_sse2(const char *hay, unsigned long n, const char *needle, unsigned long m)
+{
+    const __m128i first = _mm_set1_epi8((char)fil_fold(needle[0]));
+    const __m128i last = _mm_set1_epi8((char)fil_fold(needle[m - 1]));
+    unsigned long checks = 0;
+    unsigned long i = 0;
+
+    for (; i + m - 1 + 16 <= n; i += 16)
+    {
+        // Too many false positives, let Two-Way finish the haystack.
+        if (checks > (i >> 3) + 64) return fil_twoway_ci(hay + i, n - i, needle, m, FIL_FORWARD);
+
+        __m128i a = fil_fold_sse2(_mm_loadu_si128((const __m128i *)(hay + i)));
+        __m128i b = fil_fold_sse2(_mm_loadu_si128((const __m128i *)(hay + i + m - 1)));
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last)));
+        for (; mask; mask &= mask - 1)
+        {
+            const char *candidate = hay + i + __builtin_ctz(mask);
+            if (fil_eq_ci(candidate, needle, m)) return candidate;
+            checks++;
+        }
+    }
+    for (; i + m <= n; i++)
+    {
+        if (fil_eq_ci(hay + i, needle, m)) return hay + i;
+    }
+    return ((void*)0);
+}
+
+/**
+ * Backward counterpart of fil_find_ci_sse2, the candidate starts are filtered
+ * 16 at a time from the end of hay.
+ */
+FIL_TARGET("sse2")
+static const char *fil_rfind_ci_sse2(const char *hay, unsigned long n, const char *needle, unsigned long m)
+{
+    const __m128i first = _mm_set1_epi8((char)fil_fold(needle[0]));
+    const __m128i last = _mm_set1_epi8((char)fil_fold(needle[m - 1]));
+    const unsigned long positions = n - m + 1;
+    unsigned long starts = positions;   // Candidate starts left, [0, starts).
+    unsigned long checks = 0;
+
+    for (; starts >= 16; starts -= 16)
+    {
+        if (checks > ((positions - starts) >> 3) + 64) return fil_twoway_ci(hay, starts + m - 1, needle, m, FIL_BACKWARD);
+
+        unsigned long i = starts - 16;
+        __m128i a = fil_fold_sse2(_mm_loadu_si128((const __m128i *)(hay + i)));
+        __m128i b = fil_fold_sse2(_mm_loadu_si128((const __m128i *)(hay + i + m - 1)));
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last)));
+        while (mask)
+        {
+            int bit = 31 - __builtin_clz(mask);
+            if (fil_eq_ci(hay + i + bit, needle, m)) return hay + i + bit;
+            mask &= ~(1U << bit);
+            checks++;
+        }
+    }
+    while (starts-- > 0)
+    {
+        if (fil_eq_ci(hay + starts, needle, m)) return hay + starts;
+    }
+    return ((void*)0);
+}
+
+FIL_TARGET("avx2")
+static inline __m256i fil_fold_avx2(__m256i v)
+{
+    __m256i upper = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('A' - 1)),
+                                     _mm256_cmpgt_epi8(_mm256_set1_epi8('Z' + 1), v));
+    return _mm256_or_si256(v, _mm256_and_si256(upper, _mm256_set1_epi8(0x20)));
+}
+
+FIL_TARGET("avx2")
+static const char *fil_find_ci_avx2(const char *hay, unsigned long n, const char *needle, unsigned long m)
+{
+    const __m256i first = _mm256_set1_epi8((char)fil_fold(needle[0]));
+    const __m256i last = _mm256_set1_epi8((char)fil_fold(needle[m - 1]));
+    unsigned long checks = 0;
+    unsigned long i = 0;
+
+    for (; i + m - 1 + 32 <= n; i += 32)
+    {
+        if (checks > (i >> 3) + 64) return fil_twoway_ci(hay + i, n - i, needle, m, FIL_FORWARD);
+
+        __m256i a = fil_fold_avx2(_mm256_loadu_si256((const __m256i *)(hay + i)));
+        __m256i b = fil_fold_avx2(_mm256_loadu_si256((const __m256i *)(hay + i + m - 1)));
+        unsigned int mask = (unsigned int)_mm256_movemask_epi8(
+            _mm256_and_si256(_mm256_cmpeq_epi8(a, first), _mm256_cmpeq_epi8(b, last)));
+        for (; mask; mask &= mask - 1)
+        {
+            const char *candidate = hay + i + __builtin_ctz(mask);
+            if (fil_eq_ci(candidate, needle, m)) return candidate;
+            checks++;
+        }
+    }
+    for (; i + m <= n; i++)
+    {
+        if (fil_eq_ci(hay + i, needle, m)) return hay + i;
+    }
+    return ((void*)0);
+}
+
+FIL_TARGET("avx2")
+static const char *fil_rfind_ci_avx2(const char *hay, unsigned long n, const char *needle, unsigned long m)
+{
+    const __m256i first = _mm256_set1_epi8((char)fil_fold(needle[0]));
+    const __m256i last = _mm256_set1_epi8((char)fil_fold(needle[m - 1]));
+    const unsigned long positions = n - m + 1;
+    unsigned long starts = positions;
+    unsigned long checks = 0;
+
+    for (; starts >= 32; starts -= 32)
+    {
+        if (checks > ((positions - starts) >> 3) + 64) return fil_twoway_ci(hay, starts + m - 1, needle, m, FIL_BACKWARD);
+
+        unsigned long i = starts - 32;
+        __m256i a = fil_fold_avx2(_mm256_loadu_si256((const __m256i *)(hay + i)));
+        __m256i b = fil_fold_avx2(_mm256_loadu_si256((const __m256i *)(hay + i + m - 1)));
+        unsigned int mask = (unsigned int)_mm256_movemask_epi8(
+            _mm256_and_si256(_mm256_cmpeq_epi8(a, first), _mm256_cmpeq_epi8(b, last)));
+        while (mask)
+        {
+            int bit = 31 - __builtin_clz(mask);
+            if (fil_eq_ci(hay + i + bit, needle, m)) return hay + i + bit;
+            mask &= ~(1U << bit);
+            checks++;
+        }
+    }
+    while (starts-- > 0)
+    {
+        if (fil_eq_ci(hay + starts, needle, m)) return hay + starts;
+    }
+    return ((void*)0);
+}
+#endif // FIL_X86_SIMD
+
+static void fil_flip_case(char *str, unsigned long n, char first)
+{
+#ifdef FIL_X86_SIMD
+    int features = fil_cpu_features();
+    if (features & FIL_CPU_AVX2)
+    {
+        fil_flip_case_avx2(str, n, first);
+        return;
+    }
+    if (features & FIL_CPU_SSE2)
+    {
+        fil_flip_case_sse2(str, n, first);
+        return;
+    }
+#endif
+    for (unsigned long i = 0; i < n; i++)
+    {
+        if ((unsigned char)(str[i] - first) < 26) str[i] ^= 0x20;
+    }
+}
+
+/**
+ * First occurence of the m bytes of needle in the n bytes of hay, ignoring
+ * case. m must not be 0.
+ */
+static const char *fil_find_ci(const char *hay, unsigned long n, const char *needle, unsigned long m)
+{
+    if (m > n) return ((void*)0);
+#ifdef FIL_X86_SIMD
+    int features = fil_cpu_features();
+    if (features & FIL_CPU_AVX2) return FIL_STAT_FIND(hay, n, m, fil_find_ci_avx2(hay, n, needle, m));
+    if (features & FIL_CPU_SSE2) return FIL_STAT_FIND(hay, n, m, fil_find_ci_sse2(hay, n, needle, m));
+#endif
+    unsigned char first = fil_fold(needle[0]);
+    unsigned long checks = 0;
+    for (unsigned long i = 0; i + m <= n; i++)
+    {
+        if (fil_fold(hay[i]) != first) continue;
+        if (++checks > (i >> 3) + 64) return FIL_STAT_FIND(hay, n, m, fil_twoway_ci(hay + i, n - i, needle, m, FIL_FORWARD));
+        if (fil_eq_ci(hay + i, needle, m)) return FIL_STAT_FIND(hay, n, m, hay + i);
+    }
+    return FIL_STAT_FIND(hay, n, m, ((void*)0));
+}
+
+/**
+ * Last occurence of the m bytes of needle in the n bytes of hay, ignoring
+ * case. m must not be 0.
+ */
+static const char *fil_rfind_ci(const char *hay, unsigned long n, const char *needle, unsigned long m)
+{
+    if (m > n) return ((void*)0);
+#ifdef FIL_X86_SIMD
+    int features = fil_cpu_features();
+    if (features & FIL_CPU_AVX2) return FIL_STAT_RFIND(hay, n, m, fil_rfind_ci_avx2(hay, n, needle, m));
+    if (features & FIL_CPU_SSE2) return FIL_STAT_RFIND(hay, n, m, fil_rfind_ci_sse2(hay, n, needle, m));
+#endif
+    unsigned char first = fil_fold(needle[0]);
+    unsigned long checks = 0;
+    for (unsigned long i = n - m + 1; i-- > 0;)
+    {
+        if (fil_fold(hay[i]) != first) continue;
+        if (++checks > ((n - m - i) >> 3) + 64) return FIL_STAT_RFIND(hay, n, m, fil_twoway_ci(hay, i + m, needle, m, FIL_BACKWARD));
+        if (fil_eq_ci(hay + i, needle, m)) return FIL_STAT_RFIND(hay, n, m, hay + i);
+    }
+    return FIL_STAT_RFIND(hay, n, m, ((void*)0));
+}
+
+int Fil_to_lower(Fil *fil)
+{
+    if (!fil || !FIL_HAS_STR(fil)) return FIL_ERR_PARAM;
+
+    fil_flip_case(FIL_STR(fil), fil->len, 'A');
+    return 0;
+}
+
+int Fil_to_upper(Fil *fil)
+{
+    if (!fil || !FIL_HAS_STR(fil)) return FIL_ERR_PARAM;
+
+    fil_flip_case(FIL_STR(fil), fil->len, 'a');
+    return 0;
+}
+
+unsigned long Fil_cmp_ci_v(Fil_View v1, Fil_View v2)
+{
+    if (!FIL_VIEW_VALID(v1) || !FIL_VIEW_VALID(v2)) return FIL_CNEQ;
+
+    if (v1.len != v2.len) return FIL_CNEQ;
+    return fil_eq_ci(v1.ptr, v2.ptr, v1.len) ? FIL_CEQ : FIL_CNEQ;
+}
+
+unsigned long Fil_sfstr_ci_v(Fil_View hay, Fil_View seq)
+{
+    if (!hay.ptr || !seq.ptr || !seq.len) return FIL_NPOS;
+
+    const char *found = fil_find_ci(hay.ptr, hay.len, seq.ptr, seq.len);
+    return found ? (unsigned long)(found - hay.ptr) : FIL_NPOS;
+}
+
+unsigned long Fil_slstr_ci_v(Fil_View hay, Fil_View seq)
+{
+    if (!hay.ptr || !seq.ptr || !seq.len || seq.len > hay.len) return FIL_NPOS;
+
+    const char *found = fil_rfind_ci(hay.ptr, hay.len, seq.ptr, seq.len);
+    return found ? (unsigned long)(found - hay.ptr) : FIL_NPOS;
+}
+
+unsigned long Fil_sistr_ci_v(Fil_View hay, Fil_View seq, unsigned long index)
+{
+    if (!hay.ptr || !seq.ptr || !seq.len || index == 0) return FIL_NPOS;
+
+    const char *p = hay.ptr;
+    const char *end = hay.ptr + hay.len;
+    const char *found;
+    while ((found = fil_find_ci(p, (unsigned long)(end - p), seq.ptr, seq.len)))
+    {
+        if (--index == 0) return (unsigned long)(found - hay.ptr);
+        p = found + seq.len;
+    }
+    return FIL_NPOS;
+}
+
+/**
+ * Replace the s1_len bytes of the Fil at start by the s2_len bytes of s2.
+ */
+static int fil_replace_at(Fil *fil, unsigned long start, unsigned long s1_len,
+                          const char *s2, unsigned long s2_len)
+{
+    unsigned long new_len = (fil->len - s1_len) + s2_len;
+
+    if (new_len + 1 > FIL_CAP(fil))
+    {
+        if (Fil_resize(fil, fil_grow(fil, new_len + 1)))
+        {
+            return FIL_ERR_MEMORY;
+        }
+    }
+    memmove(FIL_STR(fil) + start + s2_len, FIL_STR(fil) + start + s1_len, fil->len - start - s1_len);
+    if (s2_len) memcpy(FIL_STR(fil) + start, s2, s2_len);
+    FIL_STAT_ADD(copied, (s1_len != s2_len ? fil->len - start - s1_len : 0) + s2_len);
+    FIL_STR(fil)[new_len] = 0;
+    fil->len = new_len;
+    return 0;
+}
+
+int Fil_rfstr_v(Fil *fil, Fil_View s1, Fil_View s2)
+{
+    if (!fil || !FIL_VIEW_VALID(s1) || !FIL_VIEW_VALID(s2)) return FIL_ERR_PARAM;
+
+    unsigned long found = Fil_sfstr_v(Fil_view(fil), s1);
+    if (found == FIL_NPOS) return FIL_ERR_SEQNOTFOUND;
+    return fil_replace_at(fil, found, s1.len, s2.ptr, s2.len);
+}
+
+int Fil_rastr_v(Fil *fil, Fil_View s1, Fil_View s2)
+{
+    if (!fil || !FIL_VIEW_VALID(s1) || !FIL_VIEW_VALID(s2)) return FIL_ERR_PARAM;
+    if (!s1.len) return FIL_ERR_SEQNOTFOUND;
+
+    Fil_Pattern pat;
+    fil_pattern_prepare(&pat, s1.ptr, s1.len, 0);
+    return fil_replace_all(fil, &pat, s2.ptr, s2.len);
+}
+
+int Fil_rlstr_v(Fil *fil, Fil_View s1, Fil_View s2)
+{
+    if (!fil || !FIL_VIEW_VALID(s1) || !FIL_VIEW_VALID(s2)) return FIL_ERR_PARAM;
+
+    unsigned long found = Fil_slstr_v(Fil_view(fil), s1);
+    if (found == FIL_NPOS) return FIL_ERR_SEQNOTFOUND;
+    return fil_replace_at(fil, found, s1.len, s2.ptr, s2.len);
+}
+
+int Fil_ristr_v(Fil *fil, Fil_View s1, unsigned long index, Fil_View s2)
+{
+    if (!fil || !FIL_VIEW_VALID(s1) || index == 0 || !FIL_VIEW_VALID(s2)) return FIL_ERR_PARAM;
+
+    unsigned long found = Fil_sistr_v(Fil_view(fil), s1, index);
+    if (found == FIL_NPOS) return FIL_ERR_SEQNOTFOUND;
+    return fil_replace_at(fil, found, s1.len, s2.ptr, s2.len);
+}
+
+void Fil_arena_init(Fil_Arena *arena, unsigned long chunk_size)
+{
+    if (!arena) return;
+    arena->chunk = ((void*)0);
+    arena->last = ((void*)0);
+    arena->chunk_size = chunk_size ? chunk_size : FIL_ARENA_CHUNK_SIZE;
+}
+
+void *Fil_arena_alloc(Fil_Arena *arena, unsigned long size)
+{
+    if (!arena || size <= 0) return ((void*)0);
+    return fil_arena_bump(arena, size);
+}
+
+Fil *Fil_arena_new(Fil_Arena *arena)
+{
+    if (!arena) return ((void*)0);
+
+    Fil *fil = Fil_arena_alloc(arena, sizeof(Fil));
+    if (!fil) return ((void*)0);
+    memset(fil, 0, sizeof(Fil));
+    fil->arena = arena;
+    return fil;
+}
+
+int Fil_arena_attach(Fil_Arena *arena, Fil *fil)
+{
+    if (!arena || !fil || FIL_HAS_STR(fil)) return FIL_ERR_PARAM;
+    fil->arena = arena;
+    return 0;
+}
+
+void Fil_arena_reset(Fil_Arena *arena)
+{
+    if (!arena || !arena->chunk) return;
+
+    struct Fil_ArenaChunk *chunk = arena->chunk->prev;
+    while (chunk)
+    {
+        struct Fil_ArenaChunk *prev = chunk->prev;
+        free(chunk);
+        chunk = prev;
+    }
+    arena->chunk->prev = ((void*)0);
+    arena->chunk->used = 0;
+    arena->last = ((void*)0);
+}
+
+void Fil_arena_free(Fil_Arena *arena)
+{
+    if (!arena) return;
+
+    Fil_arena_reset(arena);
+    free(arena->chunk);
+    arena->chunk = ((void*)0);
+}
+
+void Fil_set_allocator(const Fil_Allocator *allocator)
+{
+    fil_global_allocator = allocator;
+}
+
+int Fil_use_allocator(Fil *fil, const Fil_Allocator *allocator)
+{
+    if (!fil || (FIL_HAS_STR(fil) && !FIL_IS_INLINE(fil))) return FIL_ERR_PARAM;
+    fil->allocator = allocator;
+    return 0;
+}
+
+/**
+ * Thread cache allocator.
+ * Size class k holds buffers of 2^(k + FIL_TCACHE_MIN_CLASS) bytes, the free
+ * buffers of a class are chained through their first bytes. The cache is
+ * registered with a pthread key on its first free so it is released when
+ * the thread exits.
+ */
+#define FIL_TCACHE_MIN_CLASS 5
+#define FIL_TCACHE_CLASSES (FIL_TCACHE_MAX_CLASS - FIL_TCACHE_MIN_CLASS + 1)
+
+typedef struct {
+    void *free[FIL_TCACHE_CLASSES];
+    unsigned int count[FIL_TCACHE_CLASSES];
+    int registered;
+} Fil_TCache;
+
+static _Thread_local Fil_TCache fil_tcache;
+static pthread_key_t fil_tcache_key;
+static pthread_once_t fil_tcache_once = PTHREAD_ONCE_INIT;
+
+static void fil_tcache_release(void *arg)
+{
+    Fil_TCache *cache = arg;
+    for (int k = 0; k < FIL_TCACHE_CLASSES; k++)
+    {
+        while (cache->free[k])
+        {
+            void *next;
+            memcpy(&next, cache->free[k], sizeof(void *));
+            free(cache->free[k]);
+            cache->free[k] = next;
+        }
+        cache->count[k] = 0;
+    }
+    cache->registered = 0;
+}
+
+static void fil_tcache_key_init(void)
+{
+    pthread_key_create(&fil_tcache_key, fil_tcache_release);
+}
+
+/**
+ * Size class of a size bytes buffer, -1 if it is too large to be cached.
+ */
+static int fil_tcache_class(unsigned long size)
+{
+    if (size <= 1UL << FIL_TCACHE_MIN_CLASS) return 0;
+    int bits = 64 - __builtin_clzl(size - 1);
+    return bits > FIL_TCACHE_MAX_CLASS ? -1 : bits - FIL_TCACHE_MIN_CLASS;
+}
+
+static void *fil_tcache_get(int k)
+{
+    void *block = fil_tcache.free[k];
+    if (!block) return malloc(1UL << (k + FIL_TCACHE_MIN_CLASS));
+    memcpy(&fil_tcache.free[k], block, sizeof(void *));
+    fil_tcache.count[k]--;
+    return block;
+}
+
+static void fil_tcache_free(void *context, void *ptr, unsigned long size)
+{
+    int k = fil_tcache_class(size);
+    if (k < 0 || fil_tcache.count[k] >= FIL_TCACHE_DEPTH)
+    {
+        free(ptr);
+        return;
+    }
+    if (!fil_tcache.registered)
+    {
+        pthread_once(&fil_tcache_once, fil_tcache_key_init);
+        pthread_setspecific(fil_tcache_key, &fil_tcache);
+        fil_tcache.registered = 1;
+    }
+    memcpy(ptr, &fil_tcache.free[k], sizeof(void *));
+    fil_tcache.free[k] = ptr;
+    fil_tcache.count[k]++;
+}
+
+static void *fil_tcache_realloc(void *context, void *ptr, unsigned long old_size, unsigned long new_size)
+{
+    int to = fil_tcache_class(new_size);
+    if (!ptr) return to < 0 ? malloc(new_size) : fil_tcache_get(to);
+
+    int from = fil_tcache_class(old_size);
+    if (from < 0 && to < 0) return realloc(ptr, new_size);
+    if (from == to) return ptr;
+
+    void *block = to < 0 ? malloc(new_size) : fil_tcache_get(to);
+    if (!block) return ((void*)0);
+    memcpy(block, ptr, FIL_MIN(old_size, new_size));
+    fil_tcache_free(context, ptr, old_size);
+    return block;
+}
+
+static const Fil_Allocator fil_tcache_allocator = {fil_tcache_realloc, fil_tcache_free, ((void*)0)};
+
+const Fil_Allocator *Fil_tcache_allocator(void)
+{
+    return &fil_tcache_allocator;
+}
+
+void Fil_tcache_flush(void)
+{
+    fil_tcache_release(&fil_tcache);
+}
+
+struct Fil_RopeNode {
+    struct Fil_RopeNode *left;
+    struct Fil_RopeNode *right;
+    unsigned long len;      // Bytes of this chunk.
+    unsigned long total;    // Bytes of the subtree.
+    unsigned int priority;
+    char data[];
+};
+
+typedef struct Fil_RopeNode Fil_RopeNode;
+
+#define FIL_ROPE_TOTAL(node) ((node) ? (node)->total : 0)
+
+static unsigned int fil_rope_counter = 0;
+
+static void fil_rope_update(Fil_RopeNode *node)
+{
+    node->total = FIL_ROPE_TOTAL(node->left) + node->len + FIL_ROPE_TOTAL(node->right);
+}
+
+/**
+ * New leaf holding a copy of the len bytes of data, left uninitialized when
+ * data is NULL. Returns NULL on error.
+ */
+static Fil_RopeNode *fil_rope_node(const char *data, unsigned long len)
+{
+    Fil_RopeNode *node = malloc(sizeof(Fil_RopeNode) + len);
+    if (!node) return ((void*)0);
+
+    // Hashed global counter, the priorities only need to look random and
+    // must differ between ropes built separately and then concatenated.
+    unsigned int x = __atomic_fetch_add(&fil_rope_counter, 0x9E3779B9u, __ATOMIC_RELAXED);
+    x ^= x >> 16;
+    x *= 0x85EBCA6Bu;
+    x ^= x >> 13;
+    x *= 0xC2B2AE35u;
+    x ^= x >> 16;
+
+    node->left = ((void*)0);
+    node->right = ((void*)0);
+    node->len = len;
+    node->total = len;
+    node->priority = x;
+    if (data) memcpy(node->data, data, len);
+    return node;
+}
+
+static void fil_rope_free_nodes(Fil_RopeNode *node)
+{
+    while (node)
+    {
+        fil_rope_free_nodes(node->left);
+        Fil_RopeNode *right = node->right;
+        free(node);
+        node = right;
+    }
+}
+
+/**
+ * Concatenate the texts of a and b.
+ */
+static Fil_RopeNode *fil_rope_merge(Fil_RopeNode *a, Fil_RopeNode *b)
+{
+    if (!a) return b;
+    if (!b) return a;
+
+    if (a->priority > b->priority)
+    {
+        a->right = fil_rope_merge(a->right, b);
+        fil_rope_update(a);
+        return a;
+    }
+    b->left = fil_rope_merge(a, b->left);
+    fil_rope_update(b);
+    return b;
+}
+
+/**
+ * Split node into l, the chunks before offset k, m, the chunk k falls in
+ * (at its end when k is on a chunk boundary), and r, the chunks after.
+ * local is set to the offset of k in m.
+ */
+static void fil_rope_split3(Fil_RopeNode *node, unsigned long k, Fil_RopeNode **l,
+                            Fil_RopeNode **m, Fil_RopeNode **r, unsigned long *local)
+{
+    if (!node)
+    {
+        *l = *m = *r = ((void*)0);
+        *local = 0;
+        return;
+    }
+
+    unsigned long left_total = FIL_ROPE_TOTAL(node->left);
+    if (node->left && k <= left_total)
+    {
+        Fil_RopeNode *rest;
+        fil_rope_split3(node->left, k, l, m, &rest, local);
+        node->left = rest;
+        fil_rope_update(node);
+        *r = node;
+    }
+    else if (k <= left_total + node->len)
+    {
+        *l = node->left;
+        *m = node;
+        *r = node->right;
+        *local = k - left_total;
+        node->left = ((void*)0);
+        node->right = ((void*)0);
+        fil_rope_update(node);
+    }
+    else
+    {
+        Fil_RopeNode *rest;
+        fil_rope_split3(node->right, k - left_total - node->len, &rest, m, r, local);
+        node->right = rest;
+        fil_rope_update(node);
+        *l = node;
+    }
+}
+
+/**
+ * Split node at offset k into l and r, the chunk k falls in is cut in two.
+ * On error the tree is left whole in l.
+ * Returns 0 on success, positive integer on error.
+ */
+static int fil_rope_cut(Fil_RopeNode *node, unsigned long k,
+                        Fil_RopeNode **l, Fil_RopeNode **r)
+{
+    Fil_RopeNode *m;
+    unsigned long local;
+    fil_rope_split3(node, k, l, &m, r, &local);
+    if (!m) return 0;
+
+    if (local == m->len)
+    {
+        *l = fil_rope_merge(*l, m);
+        return 0;
+    }
+    if (local == 0)
+    {
+        *r = fil_rope_merge(m, *r);
+        return 0;
+    }
+
+    Fil_RopeNode *head = fil_rope_node(m->data, local);
+    Fil_RopeNode *tail = fil_rope_node(m->data + local, m->len - local);
+    if (!head || !tail)
+    {
+        free(head);
+        free(tail);
+        *l = fil_rope_merge(fil_rope_merge(*l, m), *r);
+        *r = ((void*)0);
+        return FIL_ERR_MEMORY;
+    }
+    free(m);
+    *l = fil_rope_merge(*l, head);
+    *r = fil_rope_merge(tail, *r);
+    return 0;
+}
+
+/**
+ * Build a tree of chunks holding the len bytes of data.
+ * Returns 0 on success, positive integer on error.
+ */
+static int fil_rope_build(const char *data, unsigned long len, Fil_RopeNode **out)
+{
+    Fil_RopeNode *tree = ((void*)0);
+    while (len)
+    {
+        unsigned long chunk = FIL_MIN(len, FIL_ROPE_CHUNK_SIZE);
+        Fil_RopeNode *node = fil_rope_node(data, chunk);
+        if (!node)
+        {
+            fil_rope_free_nodes(tree);
+            return FIL_ERR_MEMORY;
+        }
+        tree = fil_rope_merge(tree, node);
+        data += chunk;
+        len -= chunk;
+    }
+    *out = tree;
+    return 0;
+}
+
+/**
+ * Calls fn on every chunk in text order, from offset from on.
+ * base is the offset of the first byte of node. Stops when fn returns
+ * anything but 0.
+ * Returns 1 if stopped, 0 otherwise.
+ */
+static int fil_rope_walk(const Fil_RopeNode *node, unsigned long base, unsigned long from,
+                         int (*fn)(const char *data, unsigned long len, void *ctx), void *ctx)
+{
+    while (node)
+    {
+        unsigned long start = base + FIL_ROPE_TOTAL(node->left);
+        if (from < start && fil_rope_walk(node->left, base, from, fn, ctx)) return 1;
+        if (from < start + node->len)
+        {
+            unsigned long skip = from > start ? from - start : 0;
+            if (fn(node->data + skip, node->len - skip, ctx)) return 1;
+        }
+        base = start + node->len;
+        node = node->right;
+    }
+    return 0;
+}
+
+int Fil_rope_init(Fil_Rope *rope, Fil_View view)
+{
+    if (!rope || !FIL_VIEW_VALID(view)) return FIL_ERR_PARAM;
+
+    rope->root = ((void*)0);
+    return fil_rope_build(view.ptr, view.len, &rope->root);
+}
+
+void Fil_rope_free(Fil_Rope *rope)
+{
+    if (!rope) return;
+
+    fil_rope_free_nodes(rope->root);
+    rope->root = ((void*)0);
+}
+
+unsigned long Fil_rope_len(const Fil_Rope *rope)
+{
+    if (!rope) return 0;
+
+    return FIL_ROPE_TOTAL(rope->root);
+}
+
+int Fil_rope_insert(Fil_Rope *rope, unsigned long offset, Fil_View view)
+{
+    if (!rope || !FIL_VIEW_VALID(view) || offset > Fil_rope_len(rope)) return FIL_ERR_PARAM;
+    if (!view.len) return 0;
+
+    Fil_RopeNode *l, *m, *r;
+    unsigned long local;
+    fil_rope_split3(rope->root, offset, &l, &m, &r, &local);
+
+    Fil_RopeNode *mid = ((void*)0);
+    int ret = 0;
+    if (m && m->len + view.len <= FIL_ROPE_CHUNK_SIZE)
+    {
+        // Small edits rewrite the chunk they fall in, so typing does not
+        // leave a trail of tiny chunks behind.
+        mid = fil_rope_node(((void*)0), m->len + view.len);
+        if (!mid) ret = FIL_ERR_MEMORY;
+        else
+        {
+            memcpy(mid->data, m->data, local);
+            memcpy(mid->data + local, view.ptr, view.len);
+            memcpy(mid->data + local + view.len, m->data + local, m->len - local);
+            free(m);
+        }
+    }
+    else
+    {
+        ret = fil_rope_build(view.ptr, view.len, &mid);
+        Fil_RopeNode *head = m, *tail = ((void*)0);
+        if (!ret && m && local == 0)
+        {
+            head = ((void*)0);
+            tail = m;
+        }
+        else if (!ret && m && local < m->len)
+        {
+            head = fil_rope_node(m->data, local);
+            tail = fil_rope_node(m->data + local, m->len - local);
+            if (!head || !tail)
+            {
+                free(head);
+                free(tail);
+                fil_rope_free_nodes(mid);
+                ret = FIL_ERR_MEMORY;
+            }
+            else free(m);
+        }
+        if (!ret) mid = fil_rope_merge(fil_rope_merge(head, mid), tail);
+    }
+
+    if (ret) mid = m;
+    rope->root = fil_rope_merge(fil_rope_merge(l, mid), r);
+    return ret;
+}
+
+int Fil_rope_delete(Fil_Rope *rope, unsigned long offset, unsigned long len)
+{
+    if (!rope || offset > Fil_rope_len(rope) || len > Fil_rope_len(rope) - offset) return FIL_ERR_PARAM;
+    if (!len) return 0;
+
+    Fil_RopeNode *head, *rest, *removed, *tail;
+    int ret = fil_rope_cut(rope->root, offset, &head, &rest);
+    if (ret)
+    {
+        rope->root = head;
+        return ret;
+    }
+    ret = fil_rope_cut(rest, len, &removed, &tail);
+    if (ret)
+    {
+        rope->root = fil_rope_merge(head, removed);
+        return ret;
+    }
+    fil_rope_free_nodes(removed);
+    rope->root = fil_rope_merge(head, tail);
+    return 0;
+}
+
+int Fil_rope_replace(Fil_Rope *rope, unsigned long offset, unsigned long len, Fil_View view)
+{
+    if (!rope || !FIL_VIEW_VALID(view)) return FIL_ERR_PARAM;
+
+    int ret = Fil_rope_delete(rope, offset, len);
+    if (ret) return ret;
+    return Fil_rope_insert(rope, offset, view);
+}
+
+int Fil_rope_concat(Fil_Rope *dest, Fil_Rope *src)
+{
+    if (!dest || !src || dest == src) return FIL_ERR_PARAM;
+
+    dest->root = fil_rope_merge(dest->root, src->root);
+    src->root = ((void*)0);
+    return 0;
+}
+
+/**
+ * Search state carried from chunk to chunk. tail holds the last
+ * pat->len - 1 bytes seen, followed by room for as many bytes of the next
+ * chunk, to find the matches spanning a chunk boundary.
+ */
+typedef struct {
+    const Fil_Pattern *pat;
+    char *tail;
+    unsigned long tail_len;
+    unsigned long offset;   // Offset of the current chunk.
+    unsigned long found;
+} Fil_RopeSearch;
+
+static int fil_rope_search_chunk(const char *data, unsigned long len, void *ctx)
+{
+    Fil_RopeSearch *search = ctx;
+    unsigned long keep = search->pat->len - 1;
+
+    if (search->tail_len)
+    {
+        unsigned long head = FIL_MIN(keep, len);
+        memcpy(search->tail + search->tail_len, data, head);
+        // Every match starting in the tail ends past it, it is shorter
+        // than the needle.
+        const char *found = fil_pattern_find(search->pat, search->tail, search->tail_len + head);
+        if (found && (unsigned long)(found - search->tail) < search->tail_len)
+        {
+            search->found = search->offset - search->tail_len + (unsigned long)(found - search->tail);
+            return 1;
+        }
+    }
+
+    const char *found = fil_pattern_find(search->pat, data, len);
+    if (found)
+    {
+        search->found = search->offset + (unsigned long)(found - data);
+        return 1;
+    }
+
+    if (keep)
+    {
+        unsigned long total = search->tail_len + len;
+        unsigned long new_len = FIL_MIN(keep, total);
+        if (len >= new_len)
+        {
+            memcpy(search->tail, data + len - new_len, new_len);
+        }
+        else
+        {
+            memmove(search->tail, search->tail + search->tail_len - (new_len - len), new_len - len);
+            memcpy(search->tail + new_len - len, data, len);
+        }
+        search->tail_len = new_len;
+    }
+    search->offset += len;
+    return 0;
+}
+
+unsigned long Fil_rope_sfstr(const Fil_Rope *rope, Fil_View seq, unsigned long from)
+{
+    if (!rope || !seq.ptr || !seq.len || from >= Fil_rope_len(rope)) return FIL_NPOS;
+
+    Fil_Pattern pat;
+    fil_pattern_prepare(&pat, seq.ptr, seq.len, 1);
+
+    Fil_RopeSearch search = {&pat, ((void*)0), 0, from, FIL_NPOS};
+    if (seq.len > 1)
+    {
+        search.tail = malloc(2 * (seq.len - 1));
+        if (!search.tail) return FIL_NPOS;
+    }
+    fil_rope_walk(rope->root, 0, from, fil_rope_search_chunk, &search);
+    free(search.tail);
+    return search.found;
+}
+
+static int fil_rope_flatten_chunk(const char *data, unsigned long len, void *ctx)
+{
+    Fil *fil = ctx;
+    memcpy(FIL_STR(fil) + fil->len, data, len);
+    fil->len += len;
+    return 0;
+}
+
+int Fil_rope_flatten(const Fil_Rope *rope, Fil *fil)
+{
+    if (!rope || !fil) return FIL_ERR_PARAM;
+
+    unsigned long len = Fil_rope_len(rope);
+    if (len + 1 > FIL_CAP(fil) && Fil_resize(fil, len + 1)) return FIL_ERR_MEMORY;
+    fil->len = 0;
+    fil_rope_walk(rope->root, 0, 0, fil_rope_flatten_chunk, fil);
+    FIL_STR(fil)[fil->len] = 0;
+    return 0;
+}
+
+struct Fil_PoolState {
+    pthread_mutex_t lock;
+    pthread_cond_t wake;        // Workers wait for a new batch.
+    pthread_cond_t done;        // The caller waits for the batch to finish.
+    pthread_t *workers;
+    unsigned long worker_count;
+    void (*fn)(void *task);
+    char *tasks;
+    unsigned long task_size;
+    unsigned long task_count;
+    unsigned long next;         // Next task to run.
+    unsigned long pending;      // Tasks not finished yet.
+    unsigned long batch;
+    int stop;
+};
+
+/**
+ * Run the tasks of the current batch until there is none left.
+ * Called and returns with the lock held.
+ */
+static void fil_pool_drain(struct Fil_PoolState *state)
+{
+    while (state->next < state->task_count)
+    {
+        void *task = state->tasks + state->next++ * state->task_size;
+        pthread_mutex_unlock(&state->lock);
+        state->fn(task);
+        pthread_mutex_lock(&state->lock);
+        if (--state->pending == 0) pthread_cond_signal(&state->done);
+    }
+}
+
+static void *fil_pool_worker(void *arg)
+{
+    struct Fil_PoolState *state = arg;
+    unsigned long seen = 0;
+
+    pthread_mutex_lock(&state->lock);
+    for (;;)
+    {
+        while (!state->stop && state->batch == seen) pthread_cond_wait(&state->wake, &state->lock);
+        if (state->stop) break;
+        seen = state->batch;
+        fil_pool_drain(state);
+    }
+    pthread_mutex_unlock(&state->lock);
+    return ((void*)0);
+}
+
+/**
+ * Run fn on each of the count tasks of task_size bytes, on the pool threads
+ * and the calling one, and wait for all of them.
+ */
+static void fil_pool_run(Fil_Pool *pool, void (*fn)(void *task), void *tasks,
+                         unsigned long task_size, unsigned long count)
+{
+    if (!pool || !pool->state || !pool->state->worker_count || count == 1)
+    {
+        for (unsigned long i = 0; i < count; i++) fn((char *)tasks + i * task_size);
+        return;
+    }
+
+    struct Fil_PoolState *state = pool->state;
+    pthread_mutex_lock(&state->lock);
+    state->fn = fn;
+    state->tasks = tasks;
+    state->task_size = task_size;
+    state->task_count = count;
+    state->next = 0;
+    state->pending = count;
+    state->batch++;
+    pthread_cond_broadcast(&state->wake);
+    fil_pool_drain(state);
+    while (state->pending) pthread_cond_wait(&state->done, &state->lock);
+    pthread_mutex_unlock(&state->lock);
+}
+
+int Fil_pool_init(Fil_Pool *pool, unsigned long threads)
+{
+    if (!pool) return FIL_ERR_PARAM;
+
+    if (!threads)
+    {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 0 ? (unsigned long)cpus : 1;
+    }
+    pool->threads = threads;
+    pool->state = calloc(1, sizeof(struct Fil_PoolState));
+    if (!pool->state) return FIL_ERR_MEMORY;
+
+    struct Fil_PoolState *state = pool->state;
+    state->workers = malloc(threads * sizeof(pthread_t));
+    if (!state->workers)
+    {
+        free(state);
+        pool->state = ((void*)0);
+        return FIL_ERR_MEMORY;
+    }
+    pthread_mutex_init(&state->lock, ((void*)0));
+    pthread_cond_init(&state->wake, ((void*)0));
+    pthread_cond_init(&state->done, ((void*)0));
+    for (unsigned long i = 0; i + 1 < threads; i++)
+    {
+        if (pthread_create(&state->workers[i], ((void*)0), fil_pool_worker, state))
+        {
+            Fil_pool_free(pool);
+            return FIL_ERR_MEMORY;
+        }
+        state->worker_count++;
+    }
+    return 0;
+}
+
+void Fil_pool_free(Fil_Pool *pool)
+{
+    if (!pool || !pool->state) return;
+
+    struct Fil_PoolState *state = pool->state;
+    pthread_mutex_lock(&state->lock);
+    state->stop = 1;
+    pthread_cond_broadcast(&state->wake);
+    pthread_mutex_unlock(&state->lock);
+    for (unsigned long i = 0; i < state->worker_count; i++) pthread_join(state->workers[i], ((void*)0));
+
+    pthread_mutex_destroy(&state->lock);
+    pthread_cond_destroy(&state->wake);
+    pthread_cond_destroy(&state->done);
+    free(state->workers);
+    free(state);
+    pool->state = ((void*)0);
+}
+
+// Match offsets kept per chunk to resynchronize when only counting.
+#define FIL_PAR_SYNC 64
+
+/**
+ * Matches starting in [start, end) of hay, found greedily from start.
+ * When keep_all is not set only the first FIL_PAR_SYNC offsets are kept,
+ * enough to find where the chain of the chunk meets the chain of the
+ * previous chunks.
+ */
+typedef struct {
+    const Fil_Pattern *pat;
+    const char *hay;
+    unsigned long n;
+    unsigned long start;
+    unsigned long end;
+    int keep_all;
+    int error;
+    unsigned long *offsets;
+    unsigned long stored;
+    unsigned long capacity;
+    unsigned long count;
+    unsigned long last;
+    unsigned long sync[FIL_PAR_SYNC];
+} Fil_ParChunk;
+
+static void fil_par_search(void *task)
+{
+    Fil_ParChunk *chunk = task;
+    const Fil_Pattern *pat = chunk->pat;
+    const char *hay = chunk->hay;
+    const char *limit = hay + FIL_MIN(chunk->n, chunk->end + pat->len - 1);
+    const char *p = hay + chunk->start;
+    const char *found;
+
+    chunk->offsets = chunk->sync;
+    chunk->capacity = FIL_PAR_SYNC;
+    while ((found = fil_pattern_find(pat, p, (unsigned long)(limit - p))) &&
+           (unsigned long)(found - hay) < chunk->end)
+    {
+        unsigned long offset = (unsigned long)(found - hay);
+        if (chunk->stored == chunk->capacity && chunk->keep_all)
+        {
+            unsigned long capacity = chunk->capacity * 2;
+            unsigned long *offsets = malloc(capacity * sizeof(unsigned long));
+            if (!offsets)
+            {
+                chunk->error = FIL_ERR_MEMORY;
+                return;
+            }
+            memcpy(offsets, chunk->offsets, chunk->stored * sizeof(unsigned long));
+            if (chunk->offsets != chunk->sync) free(chunk->offsets);
+            chunk->offsets = offsets;
+            chunk->capacity = capacity;
+        }
+        if (chunk->stored < chunk->capacity) chunk->offsets[chunk->stored++] = offset;
+        chunk->count++;
+        chunk->last = offset;
+        p = found + pat->len;
+    }
+}
+
+/**
+ * Output of the merge, offsets is only filled when not NULL.
+ */
+typedef struct {
+    unsigned long *offsets;
+    unsigned long count;
+    unsigned long capacity;
+} Fil_ParOut;
+
+static int fil_par_push(Fil_ParOut *out, const unsigned long *offsets, unsigned long count)
+{
+    if (out->offsets && out->count + count > out->capacity)
+    {
+        unsigned long capacity = FIL_MAX(out->count + count, out->capacity * 2);
+        unsigned long *tmp = realloc(out->offsets, capacity * sizeof(unsigned long));
+        if (!tmp) return FIL_ERR_MEMORY;
+        out->offsets = tmp;
+        out->capacity = capacity;
+    }
+    if (out->offsets) memcpy(out->offsets + out->count, offsets, count * sizeof(unsigned long));
+    out->count += count;
+    return 0;
+}
+
+/**
+ * Chain the chunks in order. When a match of the previous chunks runs into a
+ * chunk, its own chain started too early: the matches are searched again
+ * from the end of that match until one of them is also in the chunk chain,
+ * from there both chains are the same.
+ */
+static int fil_par_merge(const Fil_Pattern *pat, const char *hay, unsigned long n,
+                         const Fil_ParChunk *chunks, unsigned long count, Fil_ParOut *out)
+{
+    unsigned long next = 0;     // Offset where the next match may start.
+    for (unsigned long c = 0; c < count; c++)
+    {
+        const Fil_ParChunk *chunk = &chunks[c];
+        unsigned long i = 0;
+        while (next > chunk->start)
+        {
+            const char *limit = hay + FIL_MIN(n, chunk->end + pat->len - 1);
+            const char *found = next < chunk->end ?
+                fil_pattern_find(pat, hay + next, (unsigned long)(limit - (hay + next))) : ((void*)0);
+            unsigned long offset = found ? (unsigned long)(found - hay) : chunk->end;
+            if (offset >= chunk->end)
+            {
+                i = chunk->count;
+                break;
+            }
+            while (i < chunk->stored && chunk->offsets[i] < offset) i++;
+            if (i < chunk->stored && chunk->offsets[i] == offset) break;
+            if (fil_par_push(out, &offset, 1)) return FIL_ERR_MEMORY;
+            next = offset + pat->len;
+        }
+        if (i < chunk->count)
+        {
+            if (!out->offsets) out->count += chunk->count - i;
+            else if (fil_par_push(out, chunk->offsets + i, chunk->count - i)) return FIL_ERR_MEMORY;
+            next = chunk->last + pat->len;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Number of chunks len bytes are split in, a few per thread to even out
+ * the load, and 1 when there is nothing to share.
+ */
+static unsigned long fil_par_chunk_count(const Fil_Pool *pool, unsigned long len)
+{
+    unsigned long threads = pool && pool->state ? pool->threads : 1;
+    if (threads == 1) return 1;
+    return FIL_MAX(1, FIL_MIN(threads * 4, len / FIL_PAR_MIN_CHUNK));
+}
+
+/**
+ * Split hay in chunks, search them on the pool and merge the results.
+ */
+static int fil_par_find(Fil_Pool *pool, Fil_View hay, Fil_View seq, Fil_ParOut *out)
+{
+    Fil_Pattern pat;
+    fil_pattern_prepare(&pat, seq.ptr, seq.len, 1);
+
+    unsigned long count = fil_par_chunk_count(pool, hay.len);
+    Fil_ParChunk *chunks = calloc(count, sizeof(Fil_ParChunk));
+    if (!chunks) return FIL_ERR_MEMORY;
+
+    unsigned long size = hay.len / count;
+    for (unsigned long c = 0; c < count; c++)
+    {
+        chunks[c].pat = &pat;
+        chunks[c].hay = hay.ptr;
+        chunks[c].n = hay.len;
+        chunks[c].start = c * size;
+        chunks[c].end = c + 1 == count ? hay.len : (c + 1) * size;
+        chunks[c].keep_all = out->offsets != ((void*)0);
+    }
+    fil_pool_run(pool, fil_par_search, chunks, sizeof(Fil_ParChunk), count);
+
+    int ret = 0;
+    for (unsigned long c = 0; c < count; c++)
+    {
+        if (chunks[c].error) ret = chunks[c].error;
+    }
+    if (!ret) ret = fil_par_merge(&pat, hay.ptr, hay.len, chunks, count, out);
+    for (unsigned long c = 0; c < count; c++)
+    {
+        if (chunks[c].offsets != chunks[c].sync) free(chunks[c].offsets);
+    }
+    free(chunks);
+    return ret;
+}
+
+int Fil_count_str_par(Fil_Pool *pool, Fil_View hay, Fil_View seq, unsigned long *count)
+{
+    if (!FIL_VIEW_VALID(hay) || !seq.ptr || !count) return FIL_ERR_PARAM;
+    *count = 0;
+    if (!seq.len || !hay.len) return 0;
+
+    Fil_ParOut out = {0};
+    int ret = fil_par_find(pool, hay, seq, &out);
+    if (ret) return ret;
+    *count = out.count;
+    return 0;
+}
+
+int Fil_find_all_par(Fil_Pool *pool, Fil_View hay, Fil_View seq, unsigned long **offsets, unsigned long *count)
+{
+    if (!FIL_VIEW_VALID(hay) || !seq.ptr || !offsets || !count) return FIL_ERR_PARAM;
+    *offsets = ((void*)0);
+    *count = 0;
+    if (!seq.len || !hay.len) return FIL_ERR_SEQNOTFOUND;
+
+    Fil_ParOut out = {((void*)0), 0, 16};
+    out.offsets = malloc(out.capacity * sizeof(unsigned long));
+    if (!out.offsets) return FIL_ERR_MEMORY;
+
+    int ret = fil_par_find(pool, hay, seq, &out);
+    if (!ret && !out.count) ret = FIL_ERR_SEQNOTFOUND;
+    if (ret)
+    {
+        free(out.offsets);
+        return ret;
+    }
+    *offsets = out.offsets;
+    *count = out.count;
+    return 0;
+}
+
+/**
+ * Output of one chunk of a parallel replace-all: the input bytes
+ * [in_start, in_end) holding count whole matches, written at out.
+ */
+typedef struct {
+    const char *in;
+    unsigned long in_start;
+    unsigned long in_end;
+    const unsigned long *matches;
+    unsigned long count;
+    unsigned long match_len;
+    const char *with;
+    unsigned long with_len;
+    unsigned long out_offset;
+    char *out;
+} Fil_ParReplace;
+
+static void fil_par_replace(void *task)
+{
+    Fil_ParReplace *part = task;
+    char *out = part->out;
+    unsigned long pos = part->in_start;
+    for (unsigned long i = 0; i < part->count; i++)
+    {
+        unsigned long gap = part->matches[i] - pos;
+        memcpy(out, part->in + pos, gap);
+        out += gap;
+        if (part->with_len) memcpy(out, part->with, part->with_len);
+        out += part->with_len;
+        pos = part->matches[i] + part->match_len;
+    }
+    memcpy(out, part->in + pos, part->in_end - pos);
+}
+
+int Fil_rastr_par(Fil_Pool *pool, Fil *fil, Fil_View s1, Fil_View s2)
+{
+    if (!fil || !FIL_VIEW_VALID(s1) || !FIL_VIEW_VALID(s2)) return FIL_ERR_PARAM;
+
+    unsigned long count = fil_par_chunk_count(pool, fil->len);
+    if (count == 1 || !s1.len) return Fil_rastr_v(fil, s1, s2);
+
+    Fil_ParOut found = {((void*)0), 0, 16};
+    found.offsets = malloc(found.capacity * sizeof(unsigned long));
+    if (!found.offsets) return FIL_ERR_MEMORY;
+    int ret = fil_par_find(pool, Fil_view(fil), s1, &found);
+    if (!ret && !found.count) ret = FIL_ERR_SEQNOTFOUND;
+
+    Fil_ParReplace *parts = ret ? ((void*)0) : calloc(count, sizeof(Fil_ParReplace));
+    if (!ret && !parts) ret = FIL_ERR_MEMORY;
+    if (ret)
+    {
+        free(found.offsets);
+        return ret;
+    }
+
+    // Each part takes the matches starting in its share of the input and
+    // ends after the last of them, so no match is cut. The prefix sum of
+    // the output sizes gives where each part writes.
+    unsigned long size = fil->len / count;
+    unsigned long match = 0;
+    unsigned long in_start = 0;
+    unsigned long out_len = 0;
+    for (unsigned long c = 0; c < count; c++)
+    {
+        unsigned long end = c + 1 == count ? fil->len : (c + 1) * size;
+        Fil_ParReplace *part = &parts[c];
+        part->in_start = in_start;
+        part->matches = found.offsets + match;
+        while (match < found.count && found.offsets[match] < end) match++;
+        part->count = (unsigned long)(found.offsets + match - part->matches);
+        if (part->count) end = FIL_MAX(end, part->matches[part->count - 1] + s1.len);
+        part->in_end = FIL_MAX(end, in_start);
+        in_start = part->in_end;
+        part->in = FIL_STR(fil);
+        part->match_len = s1.len;
+        part->with = s2.ptr;
+        part->with_len = s2.len;
+        part->out_offset = out_len;
+        out_len += part->in_end - part->in_start - part->count * s1.len + part->count * s2.len;
+    }
+
+    char *out = fil_alloc(fil, out_len + 1);
+    if (!out)
+    {
+        free(parts);
+        free(found.offsets);
+        return FIL_ERR_MEMORY;
+    }
+    FIL_STAT_ADD(reallocs, 1);
+    FIL_STAT_ADD(realloc_bytes, out_len + 1);
+    FIL_STAT_ADD(copied, out_len);
+    for (unsigned long c = 0; c < count; c++) parts[c].out = out + parts[c].out_offset;
+    fil_pool_run(pool, fil_par_replace, parts, sizeof(Fil_ParReplace), count);
+
+    fil_release(fil);
+    fil_adopt(fil, out, out_len + 1);
+    out[out_len] = 0;
+    fil->len = out_len;
+    free(parts);
+    free(found.offsets);
+    return 0;
+}
+
+/**
+ * Hash of the n bytes of str, read 8 at a time. Each word is mixed in with
+ * a multiplication and the result goes through the murmur3 finalizer.
+ */
+static unsigned long long fil_hash(const char *str, unsigned long n)
+{
+    const unsigned long long k = 0x9E3779B97F4A7C15ULL;
+    unsigned long long h = n * k;
+    unsigned long long w;
+    unsigned long i = 0;
+
+    for (; i + 8 <= n; i += 8)
+    {
+        memcpy(&w, str + i, 8);
+        h = (h ^ w) * k;
+        h ^= h >> 29;
+    }
+    if (i < n)
+    {
+        w = 0;
+        memcpy(&w, str + i, n - i);
+        h = (h ^ w) * k;
+    }
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+/**
+ * id is the index of the string plus 1, 0 for an empty slot.
+ */
+struct Fil_InternSlot {
+    unsigned long long hash;
+    unsigned long id;
+};
+
+// Strings longer than this get their own arena block instead of being packed.
+#define FIL_INTERN_PACKED(intern) ((intern)->arena.chunk_size / 4)
+
+/**
+ * Slot of view in slots, the empty slot where it goes if it is not there.
+ */
+static struct Fil_InternSlot *fil_intern_slot(const Fil_Intern *intern, Fil_View view, unsigned long long hash)
+{
+    unsigned long mask = intern->capacity - 1;
+    unsigned long i = (unsigned long)hash & mask;
+    for (;;)
+    {
+        struct Fil_InternSlot *slot = &intern->slots[i];
+        if (!slot->id) return slot;
+        if (slot->hash == hash)
+        {
+            const Fil_View *str = &intern->strings[slot->id - 1];
+            if (str->len == view.len && (!view.len || !memcmp(str->ptr, view.ptr, view.len))) return slot;
+        }
+        i = (i + 1) & mask;
+    }
+}
+
+/**
+ * Double the slots, entries are placed again from their cached hash.
+ */
+static int fil_intern_grow(Fil_Intern *intern)
+{
+    unsigned long capacity = intern->capacity * 2;
+    struct Fil_InternSlot *slots = calloc(capacity, sizeof(struct Fil_InternSlot));
+    if (!slots) return FIL_ERR_MEMORY;
+
+    for (unsigned long i = 0; i < intern->capacity; i++)
+    {
+        const struct Fil_InternSlot *slot = &intern->slots[i];
+        if (!slot->id) continue;
+        unsigned long j = (unsigned long)slot->hash & (capacity - 1);
+        while (slots[j].id) j = (j + 1) & (capacity - 1);
+        slots[j] = *slot;
+    }
+    free(intern->slots);
+    intern->slots = slots;
+    intern->capacity = capacity;
+    return 0;
+}
+
+/**
+ * Copy view in the arena. Short strings are packed one after the other in
+ * blocks of a chunk, without the alignment of Fil_arena_alloc.
+ */
+static const char *fil_intern_store(Fil_Intern *intern, Fil_View view)
+{
+    unsigned long size = view.len + 1;
+    char *dest;
+    if (size > FIL_INTERN_PACKED(intern))
+    {
+        dest = fil_arena_bump(&intern->arena, size);
+        if (!dest) return ((void*)0);
+    }
+    else
+    {
+        if (size > intern->block_left)
+        {
+            intern->block = fil_arena_bump(&intern->arena, intern->arena.chunk_size);
+            if (!intern->block) return ((void*)0);
+            intern->block_left = intern->arena.chunk_size;
+        }
+        dest = intern->block;
+        intern->block += size;
+        intern->block_left -= size;
+    }
+    if (view.len) memcpy(dest, view.ptr, view.len);
+    dest[view.len] = 0;
+    return dest;
+}
+
+int Fil_intern_init(Fil_Intern *intern, unsigned long capacity)
+{
+    if (!intern) return FIL_ERR_PARAM;
+
+    // Grows past 3/4 full.
+    unsigned long slots = 16;
+    while (slots / 4 * 3 < capacity) slots *= 2;
+
+    Fil_arena_init(&intern->arena, 0);
+    intern->slots = calloc(slots, sizeof(struct Fil_InternSlot));
+    if (!intern->slots) return FIL_ERR_MEMORY;
+    intern->capacity = slots;
+    intern->strings = ((void*)0);
+    intern->count = 0;
+    intern->strings_capacity = 0;
+    intern->block = ((void*)0);
+    intern->block_left = 0;
+    return 0;
+}
+
+void Fil_intern_free(Fil_Intern *intern)
+{
+    if (!intern) return;
+
+    Fil_arena_free(&intern->arena);
+    free(intern->slots);
+    free(intern->strings);
+    intern->slots = ((void*)0);
+    intern->capacity = 0;
+    intern->strings = ((void*)0);
+    intern->count = 0;
+    intern->strings_capacity = 0;
+    intern->block = ((void*)0);
+    intern->block_left = 0;
+}
+
+int Fil_intern_add(Fil_Intern *intern, Fil_View view, unsigned long *id)
+{
+    if (!intern || !intern->slots || !FIL_VIEW_VALID(view) || !id) return FIL_ERR_PARAM;
+
+    unsigned long long hash = fil_hash(view.ptr, view.len);
+    struct Fil_InternSlot *slot = fil_intern_slot(intern, view, hash);
+    if (slot->id)
+    {
+        *id = slot->id - 1;
+        return 0;
+    }
+
+    if (intern->count == intern->strings_capacity)
+    {
+        unsigned long capacity = FIL_MAX(16, intern->strings_capacity * 2);
+        Fil_View *strings = realloc(intern->strings, capacity * sizeof(Fil_View));
+        if (!strings) return FIL_ERR_MEMORY;
+        intern->strings = strings;
+        intern->strings_capacity = capacity;
+    }
+    if ((intern->count + 1) * 4 > intern->capacity * 3)
+    {
+        if (fil_intern_grow(intern)) return FIL_ERR_MEMORY;
+        slot = fil_intern_slot(intern, view, hash);
+    }
+
+    const char *ptr = fil_intern_store(intern, view);
+    if (!ptr) return FIL_ERR_MEMORY;
+    intern->strings[intern->count].ptr = ptr;
+    intern->strings[intern->count].len = view.len;
+    slot->hash = hash;
+    slot->id = ++intern->count;
+    *id = intern->count - 1;
+    return 0;
+}
+
+unsigned long Fil_intern_find(const Fil_Intern *intern, Fil_View view)
+{
+    if (!intern || !intern->slots || !FIL_VIEW_VALID(view)) return FIL_NPOS;
+
+    const struct Fil_InternSlot *slot = fil_intern_slot(intern, view, fil_hash(view.ptr, view.len));
+    return slot->id ? slot->id - 1 : FIL_NPOS;
+}
+
+Fil_View Fil_intern_get(const Fil_Intern *intern, unsigned long id)
+{
+    Fil_View view = {((void*)0), 0};
+    if (!intern || id >= intern->count) return view;
+
+    return intern->strings[id];
+}
+
+#define FIL_SPLIT_BYTE  0
+#define FIL_SPLIT_STR   1
+#define FIL_SPLIT_SET   2
+
+#define FIL_SET_HAS(bitmap, c) ((bitmap)[(unsigned char)(c) >> 3] & (1 << ((unsigned char)(c) & 7)))
+
+/**
+ * Bitmap and nibble tables of the bytes of set, nibbles holds 2 tables of 16.
+ */
+static void fil_set_tables(Fil_View set, unsigned char *bitmap, unsigned char *nibbles)
+{
+    memset(bitmap, 0, 32);
+    memset(nibbles, 0, 2 * 16);
+    for (unsigned long i = 0; i < set.len; i++)
+    {
+        unsigned char c = (unsigned char)set.ptr[i];
+        bitmap[c >> 3] |= (unsigned char)(1 << (c & 7));
+        nibbles[(c >> 7) * 16 + (c & 0x0F)] |= (unsigned char)(1 << ((c >> 4) & 7));
+    }
+}
+
+/**
+ * Byte set lookup with pshufb. A byte is split in its low and high nibble,
+ * nibbles[0][lo] has bit hi set when the byte is in the set for hi < 8 and
+ * nibbles[1][lo] bit hi - 8 for the others. The high nibble is turned into
+ * that bit by a second shuffle.
+ * The match helpers return a vector with the bytes in the set nonzero.
+ */
+#ifdef FIL_X86_SIMD
+FIL_TARGET("ssse3")
+static inline __m128i fil_set_match_ssse3(__m128i t0, __m128i t1, __m128i v)
+{
+    const __m128i b0 = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i b1 = _mm_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 2, 4, 8, 16, 32, 64, -128);
+    const __m128i low = _mm_set1_epi8(0x0F);
+    __m128i lo = _mm_and_si128(v, low);
+    __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), low);
+    return _mm_or_si128(_mm_and_si128(_mm_shuffle_epi8(t0, lo), _mm_shuffle_epi8(b0, hi)),
+                        _mm_and_si128(_mm_shuffle_epi8(t1, lo), _mm_shuffle_epi8(b1, hi)));
+}
+
+FIL_TARGET("avx2")
+static inline __m256i fil_set_match_avx2(__m256i t0, __m256i t1, __m256i v)
+{
+    const __m256i b0 = _mm256_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 0, 0, 0, 0, 0, 0, 0, 0,
+                                        1, 2, 4, 8, 16, 32, 64, -128, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m256i b1 = _mm256_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 2, 4, 8, 16, 32, 64, -128,
+                                        0, 0, 0, 0, 0, 0, 0, 0, 1, 2, 4, 8, 16, 32, 64, -128);
+    const __m256i low = _mm256_set1_epi8(0x0F);
+    __m256i lo = _mm256_and_si256(v, low);
+    __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), low);
+    return _mm256_or_si256(_mm256_and_si256(_mm256_shuffle_epi8(t0, lo), _mm256_shuffle_epi8(b0, hi)),
+                           _mm256_and_si256(_mm256_shuffle_epi8(t1, lo), _mm256_shuffle_epi8(b1, hi)));
+}
+
+FIL_TARGET("ssse3")
+static const char *fil_find_set_ssse3(const unsigned char *bitmap, const unsigned char *nibbles,
+                                      const char *str, unsigned long n)
+{
+    const __m128i t0 = _mm_loadu_si128((const __m128i *)nibbles);
+    const __m128i t1 = _mm_loadu_si128((const __m128i *)(nibbles + 16));
+    unsigned long i = 0;
+
+    for (; i + 16 <= n; i += 16)
+    {
+        __m128i hit = fil_set_match_ssse3(t0, t1, _mm_loadu_si128((const __m128i *)(str + i)));
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(hit, _mm_setzero_si128())) ^ 0xFFFF;
+        if (mask) return str + i + __builtin_ctz((unsigned int)mask);
+    }
+    for (; i < n; i++)
+    {
+        if (FIL_SET_HAS(bitmap, str[i])) return str + i;
+    }
+    return ((void*)0);
+}
+
+FIL_TARGET("avx2")
+static const char *fil_find_set_avx2(const unsigned char *bitmap, const unsigned char *nibbles,
+                                     const char *str, unsigned long n)
+{
+    const __m256i t0 = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)nibbles));
+    const __m256i t1 = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)(nibbles + 16)));
+    unsigned long i = 0;
+
+    for (; i + 32 <= n; i += 32)
+    {
+        __m256i hit = fil_set_match_avx2(t0, t1, _mm256_loadu_si256((const __m256i *)(str + i)));
+        unsigned int mask = ~(unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(hit, _mm256_setzero_si256()));
+        if (mask) return str + i + __builtin_ctz(mask);
+    }
+    for (; i < n; i++)
+    {
+        if (FIL_SET_HAS(bitmap, str[i])) return str + i;
+    }
+    return ((void*)0);
+}
+#endif // FIL_X86_SIMD
+
+/**
+ * Returns a pointer to the first byte of the n bytes of str that is in the
+ * set of the tables, NULL if absent.
+ */
+static const char *fil_find_set(const unsigned char *bitmap, const unsigned char *nibbles,
+                                const char *str, unsigned long n)
+{
+#ifdef FIL_X86_SIMD
+    int features = fil_cpu_features();
+    if (features & FIL_CPU_AVX2) return FIL_STAT_FIND(str, n, 1, fil_find_set_avx2(bitmap, nibbles, str, n));
+    if (features & FIL_CPU_SSSE3) return FIL_STAT_FIND(str, n, 1, fil_find_set_ssse3(bitmap, nibbles, str, n));
+#endif
+    for (unsigned long i = 0; i < n; i++)
+    {
+        if (FIL_SET_HAS(bitmap, str[i])) return FIL_STAT_FIND(str, n, 1, str + i);
+    }
+    return FIL_STAT_FIND(str, n, 1, ((void*)0));
+}
+
+/**
+ * Common part of the Fil_split_* initializers.
+ */
+static int fil_split_init(Fil_Split *split, Fil_View view, int kind)
+{
+    if (!split || !FIL_VIEW_VALID(view)) return FIL_ERR_PARAM;
+
+    split->rest = view;
+    split->kind = kind;
+    split->done = !view.ptr;
+    return 0;
+}
+
+int Fil_split_byte(Fil_Split *split, Fil_View view, char delim)
+{
+    int ret = fil_split_init(split, view, FIL_SPLIT_BYTE);
+    if (ret) return ret;
+
+    split->byte = delim;
+    return 0;
+}
+
+int Fil_split_str(Fil_Split *split, Fil_View view, Fil_View delim)
+{
+    if (!FIL_VIEW_VALID(delim)) return FIL_ERR_PARAM;
+    int ret = fil_split_init(split, view, FIL_SPLIT_STR);
+    if (ret) return ret;
+
+    split->delim.len = 0;
+    if (delim.len) fil_pattern_prepare(&split->delim, delim.ptr, delim.len, 1);
+    return 0;
+}
+
+int Fil_split_set(Fil_Split *split, Fil_View view, Fil_View set)
+{
+    if (!FIL_VIEW_VALID(set)) return FIL_ERR_PARAM;
+    int ret = fil_split_init(split, view, FIL_SPLIT_SET);
+    if (ret) return ret;
+
+    fil_set_tables(set, split->bitmap, split->nibbles[0]);
+    return 0;
+}
+
+int Fil_split_next(Fil_Split *split, Fil_View *token)
+{
+    if (!split || !token || split->done) return 0;
+
+    const char *ptr = split->rest.ptr;
+    unsigned long len = split->rest.len;
+    const char *found = ((void*)0);
+    unsigned long delim_len = 1;
+    switch (split->kind)
+    {
+        case FIL_SPLIT_BYTE:
+            found = fil_memchr(ptr, split->byte, len);
+            break;
+        case FIL_SPLIT_STR:
+            delim_len = split->delim.len;
+            if (delim_len) found = fil_pattern_find(&split->delim, ptr, len);
+            break;
+        default:
+            found = fil_find_set(split->bitmap, split->nibbles[0], ptr, len);
+            break;
+    }
+
+    token->ptr = ptr;
+    if (!found)
+    {
+        token->len = len;
+        split->done = 1;
+        return 1;
+    }
+    token->len = (unsigned long)(found - ptr);
+    split->rest.ptr = found + delim_len;
+    split->rest.len = len - token->len - delim_len;
+    return 1;
 }
 
-unsigned long Fil_cpy(char *dest, const char *src)
+/**
+ * A map row is applied by adding the shuffle of its deltas by the low
+ * nibbles to the bytes whose high nibble is the row.
+ */
+#ifdef FIL_X86_SIMD
+FIL_TARGET("ssse3")
+static void fil_translate_ssse3(char *str, unsigned long n, const Fil_ByteMap *map)
 {
-    if (!dest || !src) return FIL_ERR_PARAM;
+    const __m128i low = _mm_set1_epi8(0x0F);
+    __m128i deltas[FIL_TRANSLATE_ROWS];
+    __m128i rows[FIL_TRANSLATE_ROWS];
+    int count = 0;
+    for (int h = 0; h < 16; h++)
+    {
+        if (!(map->rows & (1U << h))) continue;
+        deltas[count] = _mm_loadu_si128((const __m128i *)(map->deltas + h * 16));
+        rows[count++] = _mm_set1_epi8((char)h);
+    }
 
-    while (*src)
+    unsigned long i = 0;
+    for (; i + 16 <= n; i += 16)
     {
-        *dest++ = *src++;
+        __m128i v = _mm_loadu_si128((const __m128i *)(str + i));
+        __m128i lo = _mm_and_si128(v, low);
+        __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), low);
+        for (int r = 0; r < count; r++)
+        {
+            __m128i delta = _mm_and_si128(_mm_shuffle_epi8(deltas[r], lo), _mm_cmpeq_epi8(hi, rows[r]));
+            v = _mm_add_epi8(v, delta);
+        }
+        _mm_storeu_si128((__m128i *)(str + i), v);
     }
-    return 0;
+    for (; i < n; i++) str[i] = (char)(str[i] + map->deltas[(unsigned char)str[i]]);
 }
 
-unsigned long Fil_cmp(const char *s1, const char *s2)
+FIL_TARGET("avx2")
+static void fil_translate_avx2(char *str, unsigned long n, const Fil_ByteMap *map)
 {
-    if (!s1 ||!s2) return FIL_ERR_PARAM;
+    const __m256i low = _mm256_set1_epi8(0x0F);
+    __m256i deltas[FIL_TRANSLATE_ROWS];
+    __m256i rows[FIL_TRANSLATE_ROWS];
+    int count = 0;
+    for (int h = 0; h < 16; h++)
+    {
+        if (!(map->rows & (1U << h))) continue;
+        deltas[count] = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)(map->deltas + h * 16)));
+        rows[count++] = _mm256_set1_epi8((char)h);
+    }
 
-    while(*s1 || *s2)
+    unsigned long i = 0;
+    for (; i + 32 <= n; i += 32)
     {
-        if (*s1++ != *s2++)
+        __m256i v = _mm256_loadu_si256((const __m256i *)(str + i));
+        __m256i lo = _mm256_and_si256(v, low);
+        __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), low);
+        for (int r = 0; r < count; r++)
         {
-            return FIL_CNEQ;
+            __m256i delta = _mm256_and_si256(_mm256_shuffle_epi8(deltas[r], lo), _mm256_cmpeq_epi8(hi, rows[r]));
+            v = _mm256_add_epi8(v, delta);
         }
+        _mm256_storeu_si256((__m256i *)(str + i), v);
     }
-    return FIL_CEQ;
+    for (; i < n; i++) str[i] = (char)(str[i] + map->deltas[(unsigned char)str[i]]);
 }
 
-int Fil_append(Fil *fil, const char *str)
-{
-    if (!fil || !str) return FIL_ERR_PARAM;
-
-    unsigned long str_len = Fil_len(str);
-    unsigned long new_len = fil->len + str_len; 
+/**
+ * Shuffle indices packing the bytes of each 8 bit mask to the front,
+ * the rest zeroes them.
+ */
+static unsigned char fil_compact_table[256][8];
+static pthread_once_t fil_compact_once = PTHREAD_ONCE_INIT;
 
-    if (new_len + 1 > fil->capacity)
+static void fil_compact_init(void)
+{
+    for (unsigned int mask = 0; mask < 256; mask++)
     {
-        if (Fil_resize(fil, FIL_MAX(new_len + 1, fil->capacity * FIL_RESIZE_FACTOR)))
+        unsigned int k = 0;
+        for (unsigned int b = 0; b < 8; b++)
         {
-            return FIL_ERR_MEMORY;
+            if (mask & (1U << b)) fil_compact_table[mask][k++] = (unsigned char)b;
         }
+        while (k < 8) fil_compact_table[mask][k++] = 0x80;
     }
-    Fil_cpy(fil->string + fil->len, str);
-    fil->string[new_len] = 0;
-    fil->len = new_len;
-    return 0;
 }
 
-int Fil_merge(Fil *dest, Fil *src)
+/**
+ * Stream compaction, 16 bytes at a time. Blocks without a byte of the set
+ * are moved as they are, the others are packed half by half with pshufb.
+ * Stores never go past the end of the block read, so it runs in place.
+ * Returns the new length.
+ */
+FIL_TARGET("ssse3")
+static unsigned long fil_delete_set_ssse3(char *str, unsigned long n, const unsigned char *bitmap,
+                                          const unsigned char *nibbles)
 {
-    if (!dest || !src) return FIL_ERR_PARAM;
-
-    unsigned long new_len = dest->len + src->len; 
+    const __m128i t0 = _mm_loadu_si128((const __m128i *)nibbles);
+    const __m128i t1 = _mm_loadu_si128((const __m128i *)(nibbles + 16));
+    const __m128i eight = _mm_set1_epi8(8);
+    unsigned long i = 0;
+    unsigned long j = 0;
 
-    if (new_len + 1 > dest->capacity)
+    pthread_once(&fil_compact_once, fil_compact_init);
+    for (; i + 16 <= n; i += 16)
     {
-        if (Fil_resize(dest, FIL_MAX(new_len + 1, dest->capacity * FIL_RESIZE_FACTOR)))
+        __m128i v = _mm_loadu_si128((const __m128i *)(str + i));
+        __m128i hit = fil_set_match_ssse3(t0, t1, v);
+        unsigned int keep = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(hit, _mm_setzero_si128()));
+        if (keep == 0xFFFF)
         {
-            return FIL_ERR_MEMORY;
+            _mm_storeu_si128((__m128i *)(str + j), v);
+            j += 16;
+            continue;
         }
+        __m128i lo = _mm_loadl_epi64((const __m128i *)fil_compact_table[keep & 0xFF]);
+        __m128i hi = _mm_add_epi8(_mm_loadl_epi64((const __m128i *)fil_compact_table[keep >> 8]), eight);
+        __m128i packed = _mm_shuffle_epi8(v, _mm_unpacklo_epi64(lo, hi));
+        _mm_storel_epi64((__m128i *)(str + j), packed);
+        j += (unsigned long)__builtin_popcount(keep & 0xFF);
+        _mm_storel_epi64((__m128i *)(str + j), _mm_srli_si128(packed, 8));
+        j += (unsigned long)__builtin_popcount(keep >> 8);
     }
-    Fil_cpy(dest->string + dest->len, src->string);
-    dest->string[new_len] = 0;
-    dest->len = new_len;
-    return FIL_NOT_IMPLEMENTED;
+    for (; i < n; i++)
+    {
+        if (!FIL_SET_HAS(bitmap, str[i])) str[j++] = str[i];
+    }
+    return j;
 }
+#endif // FIL_X86_SIMD
 
-int Fil_rfstr(Fil *fil, const char *s1, const char *s2)
+static void fil_translate(char *str, unsigned long n, const Fil_ByteMap *map)
 {
-    if (!fil || !s1 || !s2) return FIL_ERR_PARAM;
-
-    const char *found = Fil_sfstr(fil, s1);
-    if (!found) return FIL_ERR_SEQNOTFOUND;
-
-    unsigned long s1_len = Fil_len(s1);
-    unsigned long s1_start = (unsigned long)(found - fil->string);
-    unsigned long s2_len = Fil_len(s2);
-    unsigned long new_len = (fil->len - s1_len) + s2_len;
-
-    if (new_len + 1 > fil->capacity)
+    if (!map->rows) return;
+#ifdef FIL_X86_SIMD
+    if (__builtin_popcount(map->rows) <= FIL_TRANSLATE_ROWS)
     {
-        if (Fil_resize(fil, FIL_MAX(new_len + 1, fil->capacity * FIL_RESIZE_FACTOR)))
+        int features = fil_cpu_features();
+        if (features & FIL_CPU_AVX2)
         {
-            return FIL_ERR_MEMORY;
+            fil_translate_avx2(str, n, map);
+            return;
+        }
+        if (features & FIL_CPU_SSSE3)
+        {
+            fil_translate_ssse3(str, n, map);
+            return;
         }
     }
-    Fil_cpy(fil->string + s1_start + s2_len, fil->string + s1_start + s1_len);
-    Fil_cpy(fil->string + s1_start, s2);
-    fil->string[new_len] = 0;
-    fil->len = new_len;
-    return FIL_NOT_IMPLEMENTED;
+#endif
+    for (unsigned long i = 0; i < n; i++) str[i] = (char)(str[i] + map->deltas[(unsigned char)str[i]]);
 }
 
-int Fil_rastr(Fil *fil, const char *s1, const char *s2)
+/**
+ * Remove the bytes of the set of the tables from the n bytes of str.
+ * Returns the new length.
+ */
+static unsigned long fil_delete_set(char *str, unsigned long n, const unsigned char *bitmap,
+                                    const unsigned char *nibbles)
 {
-    if (!fil || !s1 || !s2) return FIL_ERR_PARAM;
-    const char *found;
-    const unsigned long s1_len = Fil_len(s1);
-    const unsigned long s2_len = Fil_len(s2);
-    do { 
-        found = Fil_sfstr(fil, s1);
-        if (!found) return FIL_ERR_SEQNOTFOUND;
-
-        unsigned long s1_start = (unsigned long)(found - fil->string);
-        unsigned long new_len = (fil->len - s1_len) + s2_len;
-
-        if (new_len + 1 > fil->capacity)
-        {
-            if (Fil_resize(fil, FIL_MAX(new_len + 1, fil->capacity * FIL_RESIZE_FACTOR)))
-            {
-                return FIL_ERR_MEMORY;
-            }
-        }
-        Fil_cpy(fil->string + s1_start + s2_len, fil->string + s1_start + s1_len);
-        Fil_cpy(fil->string + s1_start, s2);
-        fil->string[new_len] = 0;
-        fil->len = new_len;
-    } while (found);
-    return FIL_NOT_IMPLEMENTED;
+#ifdef FIL_X86_SIMD
+    if (fil_cpu_features() & FIL_CPU_SSSE3) return fil_delete_set_ssse3(str, n, bitmap, nibbles);
+#endif
+    unsigned long len = 0;
+    for (unsigned long i = 0; i < n; i++)
+    {
+        if (!FIL_SET_HAS(bitmap, str[i])) str[len++] = str[i];
+    }
+    return len;
 }
 
-int Fil_rlstr(Fil *fil, const char *s1, const char *s2)
+void Fil_bytemap_init(Fil_ByteMap *map)
 {
-    if (!fil || !s1 || !s2) return FIL_ERR_PARAM;
+    if (!map) return;
 
-    const char *found = Fil_slstr(fil, s1);
-    if (!found) return FIL_ERR_SEQNOTFOUND;
+    memset(map->deltas, 0, sizeof(map->deltas));
+    map->rows = 0;
+}
 
-    unsigned long s1_len = Fil_len(s1);
-    unsigned long s1_start = (unsigned long)(found - fil->string);
-    unsigned long s2_len = Fil_len(s2);
-    unsigned long new_len = (fil->len - s1_len) + s2_len;
+int Fil_bytemap_set(Fil_ByteMap *map, Fil_View from, Fil_View to)
+{
+    if (!map || !FIL_VIEW_VALID(from) || !FIL_VIEW_VALID(to)) return FIL_ERR_PARAM;
+    if (to.len != from.len && to.len != 1) return FIL_ERR_PARAM;
 
-    if (new_len + 1 > fil->capacity)
+    for (unsigned long i = 0; i < from.len; i++)
     {
-        if (Fil_resize(fil, FIL_MAX(new_len + 1, fil->capacity * FIL_RESIZE_FACTOR)))
+        unsigned char c = (unsigned char)from.ptr[i];
+        map->deltas[c] = (unsigned char)((unsigned char)to.ptr[to.len == 1 ? 0 : i] - c);
+    }
+    map->rows = 0;
+    for (unsigned int h = 0; h < 16; h++)
+    {
+        for (unsigned int lo = 0; lo < 16; lo++)
         {
-            return FIL_ERR_MEMORY;
+            if (map->deltas[h * 16 + lo]) map->rows |= 1U << h;
         }
     }
-    Fil_cpy(fil->string + s1_start + s2_len, fil->string + s1_start + s1_len);
-    Fil_cpy(fil->string + s1_start, s2);
-    fil->string[new_len] = 0;
-    fil->len = new_len;
-    return FIL_NOT_IMPLEMENTED;
+    return 0;
 }
 
-int Fil_ristr(Fil *fil, const char *s1, unsigned long index, const char *s2)
+int Fil_translate(Fil *fil, const Fil_ByteMap *map)
 {
-    if (!fil || !s1 || index == 0 || !s2) return FIL_ERR_PARAM;
+    if (!fil || !FIL_HAS_STR(fil) || !map) return FIL_ERR_PARAM;
+
+    fil_translate(FIL_STR(fil), fil->len, map);
+    return 0;
+}
+
+int Fil_rachr(Fil *fil, const char c1, const char c2)
+{
+    if (!fil || !FIL_HAS_STR(fil)) return FIL_ERR_PARAM;
 
-    const char *found = Fil_sistr(fil, s1, index);
+    char *found = Fil_sfchr(fil, c1);
     if (!found) return FIL_ERR_SEQNOTFOUND;
 
-    unsigned long s1_len = Fil_len(s1);
-    unsigned long s1_start = (unsigned long)(found - fil->string);
-    unsigned long s2_len = Fil_len(s2);
-    unsigned long new_len = (fil->len - s1_len) + s2_len;
+    Fil_ByteMap map;
+    Fil_bytemap_init(&map);
+    Fil_bytemap_set(&map, (Fil_View){&c1, 1}, (Fil_View){&c2, 1});
+    fil_translate(found, (unsigned long)(FIL_STR(fil) + fil->len - found), &map);
+    return 0;
+}
+
+int Fil_delete_chars(Fil *fil, Fil_View set)
+{
+    if (!fil || !FIL_HAS_STR(fil) || !FIL_VIEW_VALID(set)) return FIL_ERR_PARAM;
+
+    unsigned char bitmap[32];
+    unsigned char nibbles[32];
+    fil_set_tables(set, bitmap, nibbles);
+
+    // Nothing moves before the first byte to delete.
+    const char *first = fil_find_set(bitmap, nibbles, FIL_STR(fil), fil->len);
+    if (!first) return 0;
+    unsigned long start = (unsigned long)(first - FIL_STR(fil));
+    fil->len = start + fil_delete_set(FIL_STR(fil) + start, fil->len - start, bitmap, nibbles);
+    FIL_STR(fil)[fil->len] = 0;
+    return 0;
+}
+
+/**
+ * Newlines of the n bytes of str. Only counted when out is NULL, else their
+ * offsets plus base are stored in out.
+ * Returns the number of newlines.
+ */
+#ifdef FIL_X86_SIMD
+FIL_TARGET("sse2")
+static unsigned long fil_newlines_sse2(const char *str, unsigned long n, unsigned long base, unsigned long *out)
+{
+    const __m128i nl = _mm_set1_epi8('\n');
+    unsigned long count = 0;
+    unsigned long i = 0;
 
-    if (new_len + 1 > fil->capacity)
+    for (; i + 16 <= n; i += 16)
     {
-        if (Fil_resize(fil, FIL_MAX(new_len + 1, fil->capacity * FIL_RESIZE_FACTOR)))
-        {
-            return FIL_ERR_MEMORY;
-        }
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(
+            _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(str + i)), nl));
+        if (!out) count += (unsigned long)__builtin_popcount(mask);
+        else for (; mask; mask &= mask - 1) out[count++] = base + i + (unsigned long)__builtin_ctz(mask);
     }
-    Fil_cpy(fil->string + s1_start + s2_len, fil->string + s1_start + s1_len);
-    Fil_cpy(fil->string + s1_start, s2);
-    fil->string[new_len] = 0;
-    fil->len = new_len;
-    return FIL_NOT_IMPLEMENTED;
+    for (; i < n; i++)
+    {
+        if (str[i] != '\n') continue;
+        if (out) out[count] = base + i;
+        count++;
+    }
+    return count;
 }
 
-char* Fil_sfstr(Fil *fil, const char *seq)
+FIL_TARGET("avx2")
+static unsigned long fil_newlines_avx2(const char *str, unsigned long n, unsigned long base, unsigned long *out)
 {
-    if (!fil || !seq) return ((void*)0);
+    const __m256i nl = _mm256_set1_epi8('\n');
+    unsigned long count = 0;
+    unsigned long i = 0;
 
-    const char *tmp = seq;
-    unsigned long seq_len = Fil_len(seq);
-    unsigned long down_counter = seq_len;
-    char *current = fil->string;
+    // 64 bytes per iteration, the two masks make a single 64 bit one.
+    for (; i + 64 <= n; i += 64)
+    {
+        unsigned long long lo = (unsigned int)_mm256_movemask_epi8(
+            _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(str + i)), nl));
+        unsigned long long hi = (unsigned int)_mm256_movemask_epi8(
+            _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(str + i + 32)), nl));
+        unsigned long long mask = lo | hi << 32;
+        if (!out) count += (unsigned long)__builtin_popcountll(mask);
+        else for (; mask; mask &= mask - 1) out[count++] = base + i + (unsigned long)__builtin_ctzll(mask);
+    }
+    for (; i < n; i++)
+    {
+        if (str[i] != '\n') continue;
+        if (out) out[count] = base + i;
+        count++;
+    }
+    return count;
+}
+#endif // FIL_X86_SIMD
 
-    while (*current)
+static unsigned long fil_newlines(const char *str, unsigned long n, unsigned long base, unsigned long *out)
+{
+#ifdef FIL_X86_SIMD
+    int features = fil_cpu_features();
+    if (features & FIL_CPU_AVX2) return fil_newlines_avx2(str, n, base, out);
+    if (features & FIL_CPU_SSE2) return fil_newlines_sse2(str, n, base, out);
+#endif
+    const char *end = str + n;
+    const char *p = str;
+    unsigned long count = 0;
+    while ((p = fil_memchr(p, '\n', (unsigned long)(end - p))))
     {
-        if (*current == *tmp)
-        {
-            char *ptr = current;
-            while(*current == *tmp && down_counter)
-            {
-                current++;
-                tmp++;
-                down_counter--;
-            }
-            if (!down_counter)
-            {
-                return ptr;
-            }
-            else
-            {
-                tmp = seq;
-                down_counter = seq_len;
-            }
-        }
-        else
-        {
-            current++;
-        }
+        if (out) out[count] = base + (unsigned long)(p - str);
+        count++;
+        p++;
     }
-    return ((void*)0);
+    return count;
 }
 
-// TODO : upgrade idea, start search from the end of the string.
-char* Fil_slstr(Fil *fil, const char *seq)
+/**
+ * Bytes [start, end) of str, scanned a first time to count the newlines
+ * and a second time to store them at out.
+ */
+typedef struct {
+    const char *str;
+    unsigned long start;
+    unsigned long end;
+    unsigned long count;
+    unsigned long *out;
+} Fil_LineChunk;
+
+static void fil_line_chunk(void *task)
+{
+    Fil_LineChunk *chunk = task;
+    chunk->count = fil_newlines(chunk->str + chunk->start, chunk->end - chunk->start, chunk->start, chunk->out);
+}
+
+/**
+ * Add the newlines of the bytes of view past index->len to the index.
+ * The newlines are counted first so the offsets are stored in an array of
+ * the exact size, each chunk at the place given by a prefix sum.
+ */
+static int fil_line_scan(Fil_LineIndex *index, Fil_View view, Fil_Pool *pool)
 {
-    if (!fil || !seq) return ((void*)0);
+    unsigned long from = index->len;
+    unsigned long count = fil_par_chunk_count(pool, view.len - from);
+    Fil_LineChunk single;
+    Fil_LineChunk *chunks = count == 1 ? &single : calloc(count, sizeof(Fil_LineChunk));
+    if (!chunks) return FIL_ERR_MEMORY;
 
-    const char *tmp = seq;
-    unsigned long seq_len = Fil_len(seq);
-    unsigned long down_counter = seq_len;
-    char *current = fil->string;
-    char *found_ptr = ((void*)0);
+    unsigned long size = (view.len - from) / count;
+    for (unsigned long c = 0; c < count; c++)
+    {
+        chunks[c].str = view.ptr;
+        chunks[c].start = from + c * size;
+        chunks[c].end = c + 1 == count ? view.len : from + (c + 1) * size;
+        chunks[c].out = ((void*)0);
+    }
+    fil_pool_run(pool, fil_line_chunk, chunks, sizeof(Fil_LineChunk), count);
 
-    while (*current)
+    unsigned long total = index->count;
+    for (unsigned long c = 0; c < count; c++) total += chunks[c].count;
+    if (total > index->count)
     {
-        if (*current == *tmp)
+        // Grown geometrically so that appending and updating stays linear.
+        if (total > index->capacity)
         {
-            char *ptr = current;
-            while(*current == *tmp && down_counter)
+            unsigned long capacity = FIL_MAX(total, index->capacity * 2);
+            unsigned long *newlines = realloc(index->newlines, capacity * sizeof(unsigned long));
+            if (!newlines)
             {
-                current++;
-                tmp++;
-                down_counter--;
-            }
-            if (!down_counter)
-            {
-                found_ptr = ptr;
+                if (chunks != &single) free(chunks);
+                return FIL_ERR_MEMORY;
             }
-            tmp = seq;
-            down_counter = seq_len;
+            index->newlines = newlines;
+            index->capacity = capacity;
         }
-        else
+
+        unsigned long offset = index->count;
+        for (unsigned long c = 0; c < count; c++)
         {
-            current++;
+            chunks[c].out = index->newlines + offset;
+            offset += chunks[c].count;
         }
+        fil_pool_run(pool, fil_line_chunk, chunks, sizeof(Fil_LineChunk), count);
     }
-    return found_ptr;
+
+    if (chunks != &single) free(chunks);
+    FIL_STAT_ADD(scanned, view.len - from);
+    FIL_STAT_ADD(matches, total - index->count);
+    index->count = total;
+    index->len = view.len;
+    return 0;
 }
 
-char* Fil_sistr(Fil *fil, const char *seq, unsigned long index)
+int Fil_line_index_init(Fil_LineIndex *index, Fil_View view, Fil_Pool *pool)
 {
-    if (!fil || !seq || index == 0) return ((void*)0);
+    if (!index || !FIL_VIEW_VALID(view)) return FIL_ERR_PARAM;
 
-    const char *tmp = seq;
-    unsigned long seq_len = Fil_len(seq);
-    unsigned long down_counter = seq_len;
-    char *current = fil->string;
-    unsigned long found = 0;
+    index->newlines = ((void*)0);
+    index->count = 0;
+    index->capacity = 0;
+    index->len = 0;
+    return fil_line_scan(index, view, pool);
+}
 
-    while (*current)
-    {
-        if (*current == *tmp)
-        {
-            char *ptr = current;
-            while(*current == *tmp && down_counter)
-            {
-                current++;
-                tmp++;
-                down_counter--;
-            }
-            if (!down_counter)
-            {
-                found++;
-                if (found == index)
-                {
-                    return ptr;
-                }
-            }
-            tmp = seq;
-            down_counter = seq_len;
-        }
-        else
-        {
-            current++;
-        }
-    }
-    return ((void*)0);
+void Fil_line_index_free(Fil_LineIndex *index)
+{
+    if (!index) return;
+
+    free(index->newlines);
+    index->newlines = ((void*)0);
+    index->count = 0;
+    index->capacity = 0;
+    index->len = 0;
 }
 
-char *Fil_sfchr(Fil *fil, const char c)
+int Fil_line_index_update(Fil_LineIndex *index, Fil_View view)
 {
-    if (!fil) return ((void*)0);
+    if (!index || !FIL_VIEW_VALID(view) || view.len < index->len) return FIL_ERR_PARAM;
 
-    for (unsigned long index = 0; index < fil->len; index++)
-    {
-        if (fil->string[index] == c)
-        {
-            return fil->string + index;
-        }
-    }
+    return fil_line_scan(index, view, ((void*)0));
+}
 
-    return ((void*)0);
+unsigned long Fil_line_count(const Fil_LineIndex *index)
+{
+    if (!index) return 0;
+
+    return index->count + 1;
 }
 
-char *Fil_slchr(Fil *fil, const char c)
+int Fil_line_range(const Fil_LineIndex *index, unsigned long line, unsigned long *start, unsigned long *end)
 {
-    if (!fil) return ((void*)0);
+    if (!index || !start || !end || line > index->count) return FIL_ERR_PARAM;
+
+    *start = line ? index->newlines[line - 1] + 1 : 0;
+    *end = line < index->count ? index->newlines[line] : index->len;
+    return 0;
+}
+
+unsigned long Fil_line_of(const Fil_LineIndex *index, unsigned long offset)
+{
+    if (!index || offset > index->len) return FIL_NPOS;
 
-    for (unsigned long index = fil->len + 1; index > 0; index--)
+    // Number of newlines before offset.
+    unsigned long lo = 0;
+    unsigned long hi = index->count;
+    while (lo < hi)
     {
-        if (fil->string[index - 1] == c)
-        {
-            return fil->string + index - 1;
-        }
+        unsigned long mid = lo + (hi - lo) / 2;
+        if (index->newlines[mid] < offset) lo = mid + 1;
+        else hi = mid;
     }
-    
-    return ((void*)0);
+    return lo;
 }
 
-char *Fil_sichr(Fil *fil, const char c, unsigned long index)
+void Fil_stats_snapshot(Fil_Stats *stats)
 {
-    if (!fil) return ((void*)0);
+    if (!stats) return;
+
+#ifdef FIL_STATS
+    *stats = fil_stats;
+#else
+    memset(stats, 0, sizeof(Fil_Stats));
+#endif // FIL_STATS
+}
+
+void Fil_stats_reset(void)
+{
+#ifdef FIL_STATS
+    memset(&fil_stats, 0, sizeof(Fil_Stats));
+#endif // FIL_STATS
+}
+
+int Fil_map_file(Fil_View *view, const char *path)
+{
+    if (!view || !path) return FIL_ERR_PARAM;
 
-    unsigned long found_index = 1;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return errno == ENOENT ? FIL_ERR_FILE_NOT_FOUND : FIL_ERR_FILE_OPEN;
 
-    for (unsigned long search_index = 0; search_index < fil->len; search_index++)
+    struct stat stat_buf;
+    if (fstat(fd, &stat_buf) < 0)
+    {
+        close(fd);
+        return FIL_ERR_FILE_READ;
+    }
+    view->ptr = "";
+    view->len = 0;
+    if (stat_buf.st_size > 0)
     {
-        if (fil->string[search_index] == c && found_index++ == index)
+        unsigned long size = (unsigned long)stat_buf.st_size;
+        void *addr = mmap(((void*)0), size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr == MAP_FAILED)
         {
-            return fil->string + search_index;
+            close(fd);
+            return FIL_ERR_FILE_READ;
         }
+        // Hints only, the mapping works without them.
+        madvise(addr, size, MADV_SEQUENTIAL);
+        madvise(addr, size, MADV_WILLNEED);
+        view->ptr = addr;
+        view->len = size;
     }
-
-    return ((void*)0);
+    // The mapping keeps its own reference to the file.
+    close(fd);
+    return 0;
 }
 
-int Fil_rfchr(Fil *fil, const char c)
+void Fil_unmap_file(Fil_View *view)
 {
-    if (!fil) return FIL_ERR_PARAM;
-    return FIL_NOT_IMPLEMENTED;
-}
+    if (!view) return;
 
-int Fil_rlchr(Fil *fil, const char c)
-{
-    if (!fil) return FIL_ERR_PARAM;
-    return FIL_NOT_IMPLEMENTED;
+    if (view->len) munmap((void *)view->ptr, view->len);
+    view->ptr = ((void*)0);
+    view->len = 0;
 }
 
-int Fil_richr(Fil *fil, const char c, unsigned long index)
+/**
+ * Read up to n bytes, retrying short and interrupted reads.
+ * Returns the number of bytes read, less than n at the end of the file,
+ * -1 on error.
+ */
+static long fil_read_full(int fd, char *buf, unsigned long n)
 {
-    if (!fil) return FIL_ERR_PARAM;
-    return FIL_NOT_IMPLEMENTED;
+    unsigned long done = 0;
+    while (done < n)
+    {
+        ssize_t got = read(fd, buf + done, n - done);
+        if (got < 0 && errno == EINTR) continue;
+        if (got < 0) return -1;
+        if (got == 0) break;
+        done += (unsigned long)got;
+    }
+    return (long)done;
 }
 
-int Fil_rachr(Fil *fil, const char c)
+int Fil_stream_search(const char *path, Fil_View seq, unsigned long chunk_size, Fil_Match_Fn on_match, void *ctx)
 {
-    if (!fil) return FIL_ERR_PARAM;
-    return FIL_NOT_IMPLEMENTED;
+    if (!path || !seq.ptr || !on_match) return FIL_ERR_PARAM;
+    if (!seq.len) return FIL_ERR_SEQNOTFOUND;
+    if (!chunk_size) chunk_size = FIL_STREAM_CHUNK_SIZE;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return errno == ENOENT ? FIL_ERR_FILE_NOT_FOUND : FIL_ERR_FILE_OPEN;
+
+    // The last seq.len - 1 bytes of a chunk are kept in front of the next
+    // one, a match straddling two chunks is then found in the second.
+    unsigned long keep_max = seq.len - 1;
+    char *buf = malloc(keep_max + chunk_size);
+    if (!buf)
+    {
+        close(fd);
+        return FIL_ERR_MEMORY;
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    Fil_Pattern pat;
+    fil_pattern_prepare(&pat, seq.ptr, seq.len, 1);
+
+    int ret = FIL_ERR_SEQNOTFOUND;
+    unsigned long base = 0;     // File offset of buf[0].
+    unsigned long next = 0;     // File offset where the next match may start.
+    unsigned long keep = 0;
+    for (;;)
+    {
+        long got = fil_read_full(fd, buf + keep, chunk_size);
+        if (got < 0)
+        {
+            ret = FIL_ERR_FILE_READ;
+            break;
+        }
+        unsigned long have = keep + (unsigned long)got;
+        if ((unsigned long)got == chunk_size)
+        {
+            posix_fadvise(fd, (off_t)(base + have), (off_t)chunk_size, POSIX_FADV_WILLNEED);
+        }
+
+        const char *end = buf + have;
+        const char *hay = buf + (next > base ? next - base : 0);
+        const char *found;
+        int stop = 0;
+        while ((found = fil_pattern_find(&pat, hay, (unsigned long)(end - hay))))
+        {
+            unsigned long offset = base + (unsigned long)(found - buf);
+            ret = 0;
+            if (on_match(offset, ctx))
+            {
+                stop = 1;
+                break;
+            }
+            next = offset + seq.len;
+            hay = found + seq.len;
+        }
+        if (stop || (unsigned long)got < chunk_size) break;
+
+        keep = FIL_MIN(keep_max, have);
+        memmove(buf, buf + have - keep, keep);
+        base += have - keep;
+    }
+
+    free(buf);
+    close(fd);
+    return ret;
 }
 
 int Fil_read_from_file(Fil *fil, const char *path)
@@ -434,10 +4927,10 @@ int Fil_read_from_file(Fil *fil, const char *path)
         fprintf(stderr, "Fil file open error: %s\n", strerror(errno));
         return FIL_ERR_FILE_OPEN;
     }
-    size_t nread = fread(fil->string, sizeof(char), (unsigned long)stat_buf.st_size, file);
+    size_t nread = fread(FIL_STR(fil), sizeof(char), (unsigned long)stat_buf.st_size, file);
     if ((long)nread != stat_buf.st_size) return FIL_ERR_FILE_READ;
     fil->len = (unsigned long)stat_buf.st_size;
-    fil->string[fil->len] = '\0';
+    FIL_STR(fil)[fil->len] = '\0';
     return 0;
 }
 
@@ -445,15 +4938,152 @@ int Fil_write_to_file(Fil *fil, const char *path, int overwrite)
 {
     if (!fil || !path) return FIL_ERR_PARAM;
 
-    struct stat stat_buf;
-    int ret = stat(path, &stat_buf);
-    if (ret < 0 && errno != ENOENT && !overwrite)
+    Fil_View view = Fil_view(fil);
+    return Fil_write_views(path, &view, 1, overwrite ? FIL_WRITE_OVERWRITE : 0);
+}
+
+// iovecs handed to a single writev call.
+#define FIL_IOV_BATCH 64
+
+/**
+ * Write every byte of the count views to fd, retrying short writes.
+ * Returns 0 on success, positive integer on error.
+ */
+static int fil_write_all(int fd, const Fil_View *views, unsigned long count)
+{
+    struct iovec iov[FIL_IOV_BATCH];
+    unsigned long i = 0;
+    unsigned long done = 0;     // Bytes of views[i] already written.
+
+    while (i < count)
     {
-        return FIL_ERR_OVERWRITE;
+        int n = 0;
+        for (unsigned long j = i; j < count && n < FIL_IOV_BATCH; j++)
+        {
+            unsigned long skip = j == i ? done : 0;
+            if (views[j].len == skip) continue;
+            iov[n].iov_base = (void *)(views[j].ptr + skip);
+            iov[n].iov_len = views[j].len - skip;
+            n++;
+        }
+        if (!n) break;
+
+        ssize_t wrote = writev(fd, iov, n);
+        if (wrote < 0 && errno == EINTR) continue;
+        if (wrote <= 0) return FIL_ERR_FILE_WRITE;
+
+        unsigned long left = (unsigned long)wrote;
+        while (i < count && left >= views[i].len - done)
+        {
+            left -= views[i].len - done;
+            done = 0;
+            i++;
+        }
+        done += left;
     }
-    FILE* file = fopen(path, "w");
-    if (!file) return FIL_ERR_FILE_NOT_FOUND;
-    size_t nwrite = fwrite(fil->string, sizeof(char), fil->len, file);
-    if ((unsigned long)nwrite != fil->len) return FIL_ERR_FILE_WRITE;
     return 0;
 }
+
+/**
+ * fsync the directory holding path, so a rename into it is durable.
+ */
+static void fil_sync_dir(const char *path)
+{
+    const char *slash = ((void*)0);
+    for (const char *c = path; *c; c++)
+    {
+        if (*c == '/') slash = c;
+    }
+
+    int fd;
+    if (!slash)
+    {
+        fd = open(".", O_RDONLY);
+    }
+    else
+    {
+        unsigned long len = slash == path ? 1 : (unsigned long)(slash - path);
+        char *dir = malloc(len + 1);
+        if (!dir) return;
+        memcpy(dir, path, len);
+        dir[len] = 0;
+        fd = open(dir, O_RDONLY);
+        free(dir);
+    }
+    if (fd < 0) return;
+    fsync(fd);
+    close(fd);
+}
+
+static unsigned long fil_tmp_counter = 0;
+
+/**
+ * Atomic write, the views go to a unique temporary file in the directory of
+ * path which is synced and then renamed, or linked when path must not be
+ * replaced, over path.
+ */
+static int fil_write_atomic(const char *path, const Fil_View *views, unsigned long count, int overwrite)
+{
+    unsigned long path_len = Fil_len(path);
+    char *tmp = malloc(path_len + 64);
+    if (!tmp) return FIL_ERR_MEMORY;
+    snprintf(tmp, path_len + 64, "%s.tmp.%ld.%lu", path, (long)getpid(),
+             __atomic_fetch_add(&fil_tmp_counter, 1, __ATOMIC_RELAXED));
+
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_EXCL, 0666);
+    if (fd < 0)
+    {
+        free(tmp);
+        return FIL_ERR_FILE_OPEN;
+    }
+    // An overwritten file keeps its permissions, the temporary file gets them.
+    struct stat stat_buf;
+    int ret = 0;
+    if (overwrite && stat(path, &stat_buf) == 0 && fchmod(fd, stat_buf.st_mode & 07777) < 0)
+    {
+        ret = FIL_ERR_FILE_WRITE;
+    }
+    if (!ret) ret = fil_write_all(fd, views, count);
+    if (!ret && fsync(fd) < 0) ret = FIL_ERR_FILE_WRITE;
+    if (close(fd) < 0 && !ret) ret = FIL_ERR_FILE_WRITE;
+
+    if (!ret && overwrite && rename(tmp, path) < 0)
+    {
+        ret = FIL_ERR_FILE_WRITE;
+    }
+    else if (!ret && !overwrite && link(tmp, path) < 0)
+    {
+        ret = errno == EEXIST ? FIL_ERR_OVERWRITE : FIL_ERR_FILE_WRITE;
+    }
+    if (ret || !overwrite) unlink(tmp);
+    if (!ret) fil_sync_dir(path);
+    free(tmp);
+    return ret;
+}
+
+int Fil_write_views(const char *path, const Fil_View *views, unsigned long count, int mode)
+{
+    if (!path || (!views && count)) return FIL_ERR_PARAM;
+    if ((mode & FIL_WRITE_ATOMIC) && (mode & FIL_WRITE_APPEND)) return FIL_ERR_PARAM;
+    for (unsigned long i = 0; i < count; i++)
+    {
+        if (!views[i].ptr && views[i].len) return FIL_ERR_PARAM;
+    }
+
+    if (mode & FIL_WRITE_ATOMIC)
+    {
+        return fil_write_atomic(path, views, count, mode & FIL_WRITE_OVERWRITE);
+    }
+
+    int flags = O_WRONLY | O_CREAT;
+    if (mode & FIL_WRITE_APPEND) flags |= O_APPEND;
+    else if (mode & FIL_WRITE_OVERWRITE) flags |= O_TRUNC;
+    else flags |= O_EXCL;
+
+    int fd = open(path, flags, 0666);
+    if (fd < 0) return errno == EEXIST ? FIL_ERR_OVERWRITE : FIL_ERR_FILE_OPEN;
+
+    int ret = fil_write_all(fd, views, count);
+    if (close(fd) < 0 && !ret) ret = FIL_ERR_FILE_WRITE;
+    return ret;
+}
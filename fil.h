@@ -41,7 +41,8 @@ SOFTWARE.
 /**
  * Define FIL_RESIZE_FACTOR before including to use your own resize factor.
  * Must be a positive integer > 0
- * Used when resizing the capacity of a string in a Fil struct.
+ * Used when resizing the capacity of a string in a Fil struct with the
+ * default FIL_GROW_GEOMETRIC growth policy.
  */
 #ifndef FIL_RESIZE_FACTOR
 #define FIL_RESIZE_FACTOR 2
@@ -51,26 +52,150 @@ SOFTWARE.
 #define FIL_DEFAULT_CAPACITY 20
 #endif // FIL_DEFAULT_CAPACITY
 
+/**
+ * Define FIL_MMAP_THRESHOLD when compiling fil.c to change the capacity from
+ * which strings without an allocator or arena get their own anonymous
+ * mapping. Mapped strings grow with mremap on Linux, their pages are moved
+ * instead of copied.
+ */
+#ifndef FIL_MMAP_THRESHOLD
+#define FIL_MMAP_THRESHOLD (1UL << 24)
+#endif // FIL_MMAP_THRESHOLD
+
+/**
+ * Define FIL_NO_SIMD when compiling fil.c to disable the SSE2/AVX2 kernels.
+ * The portable word-at-a-time implementations are used instead.
+ * Otherwise the best kernel is selected at runtime from the CPU features.
+ */
+
+/**
+ * Define FIL_STATS when compiling fil.c to count allocations, copies and
+ * search work per thread, see Fil_stats_snapshot.
+ */
+
+/**
+ * Define FIL_SSO_CAPACITY before including to change the inline buffer size,
+ * fil.c and its users must agree on it.
+ * Strings that fit in it, null byte included, are stored inside the Fil
+ * struct, over the pointer and capacity words of heap strings, and only
+ * spill to the heap past it.
+ */
+#ifndef FIL_SSO_CAPACITY
+#define FIL_SSO_CAPACITY 24
+#endif // FIL_SSO_CAPACITY
+
+#ifndef FIL_ARENA_CHUNK_SIZE
+#define FIL_ARENA_CHUNK_SIZE 65536
+#endif // FIL_ARENA_CHUNK_SIZE
+
+/**
+ * Bump allocator, allocations are carved out of a chain of chunks and are
+ * only given back all at once by Fil_arena_reset or Fil_arena_free.
+ * last is the most recent allocation, the only one that can grow in place.
+ */
+typedef struct {
+    struct Fil_ArenaChunk *chunk;
+    char *last;
+    unsigned long chunk_size;
+} Fil_Arena;
+
+/**
+ * Heap hooks for the strings of Fils.
+ * realloc_fn allocates new_size bytes when ptr is NULL, otherwise moves the
+ * old_size bytes block ptr to a new_size bytes one and keeps its content.
+ * It returns NULL on failure, leaving ptr untouched.
+ * free_fn releases the size bytes block ptr.
+ * context is passed as is to both.
+ */
+typedef struct {
+    void *(*realloc_fn)(void *context, void *ptr, unsigned long old_size, unsigned long new_size);
+    void (*free_fn)(void *context, void *ptr, unsigned long size);
+    void *context;
+} Fil_Allocator;
+
+/**
+ * The string is either stored inline, over the string and capacity words,
+ * or lives in a heap allocation or, when arena is set, in a block of the
+ * arena. Read it with Fil_str and Fil_capacity, buf is only meaningful
+ * through them.
+ * A Fil holds no pointer to itself, it can be returned by value or moved
+ * with memcpy or realloc. It must not be copied and both copies used, the
+ * heap string would be freed twice, copy its content with Fil_merge or
+ * Fil_append instead.
+ * Heap allocations go through allocator, or the global allocator when it
+ * is NULL.
+ */
 typedef struct {
-    char *string;
-    unsigned long len;     
-    unsigned long capacity;     
+    union {
+        struct {
+            char *string;
+            unsigned long capacity;
+        } heap;
+        char sso[FIL_SSO_CAPACITY];
+    } buf;
+    unsigned long len;
+    Fil_Arena *arena;
+    const Fil_Allocator *allocator;
+    unsigned long growth_step;
+    int growth;
+    int is_inline;
 } Fil;
 
 #define FIL_MIN(m, n) ((m) < (n) ? (m) : (n))
 #define FIL_MAX(m, n) ((m) > (n) ? (m) : (n))
 
 /**
- * Free allocated memory.
+ * Free allocated memory, the Fil is left empty and can be reused.
  */
 void Fil_free(Fil *fil);
 
+/**
+ * The null terminated string of fil, NULL while nothing is allocated.
+ * Short strings are stored in the Fil itself, the pointer is only valid
+ * until the Fil is modified or moved.
+ */
+char *Fil_str(const Fil *fil);
+
+/**
+ * Bytes the string of fil can hold without growing, null byte included.
+ */
+unsigned long Fil_capacity(const Fil *fil);
+
 /**
  * Internal function used to resize the capacity of a Fil struct string.
+ * Capacities up to FIL_SSO_CAPACITY use the inline buffer of an empty or
+ * inline Fil, larger ones move the string to the heap.
  * Returns 0 on success, positive integer on error.
  */
 int Fil_resize(Fil *fil, unsigned long new_cap);
 
+#define FIL_GROW_GEOMETRIC  0
+#define FIL_GROW_STEP       1
+#define FIL_GROW_EXACT      2
+
+/**
+ * Choose how the capacity of fil grows when its string no longer fits.
+ * FIL_GROW_GEOMETRIC, the default, multiplies it by FIL_RESIZE_FACTOR,
+ * FIL_GROW_STEP rounds the needed size up to a multiple of step and
+ * FIL_GROW_EXACT allocates the needed size only.
+ * Returns 0 on success, positive integer on error.
+ */
+int Fil_set_growth(Fil *fil, int policy, unsigned long step);
+
+/**
+ * Make room for a string of at least len bytes, null byte excluded, the
+ * capacity is never reduced.
+ * Returns 0 on success, positive integer on error.
+ */
+int Fil_reserve(Fil *fil, unsigned long len);
+
+/**
+ * Reduce the capacity to the string and its null byte, a string that fits
+ * moves back to the inline buffer. Arena strings only shrink in place.
+ * Returns 0 on success, positive integer on error.
+ */
+int Fil_shrink_to_fit(Fil *fil);
+
 /**
  * Returns the length of the provided null terminated string, 0 if str is NULL;
  * 
@@ -79,7 +204,8 @@ int Fil_resize(Fil *fil, unsigned long new_cap);
 unsigned long Fil_len(const char *str);
 
 /**
- * Copies src into dest.
+ * Copies src into dest, the terminating null byte is not copied.
+ * dest must not overlap the part of src that is still to be read.
  * Returns 0 on success, positive integer on error.
  */
 unsigned long Fil_cpy(char *dest, const char *src);
@@ -99,6 +225,35 @@ unsigned long Fil_cmp(const char *s1, const char *s2);
  */
 int Fil_append(Fil *fil, const char *str);
 
+#if defined(__GNUC__)
+#define FIL_PRINTF(fmt, args) __attribute__((format(printf, fmt, args)))
+#else
+#define FIL_PRINTF(fmt, args)
+#endif
+
+/**
+ * Append printf formatted output to your Fil, it is formatted directly in
+ * the spare capacity and only formatted again after a resize.
+ * The arguments must not point into the Fil string.
+ * Returns 0 on success, positive integer on error.
+ */
+int Fil_appendf(Fil *fil, const char *fmt, ...) FIL_PRINTF(2, 3);
+
+/**
+ * Append the decimal representation of n to your Fil.
+ * Returns 0 on success, positive integer on error.
+ */
+int Fil_append_u64(Fil *fil, unsigned long long n);
+int Fil_append_i64(Fil *fil, long long n);
+
+/**
+ * Append the shortest decimal representation of d that reads back as d,
+ * the closest to d when there are several, such as 0.1, 1e+21 or 5.
+ * nan and inf are written as printf does.
+ * Returns 0 on success, positive integer on error.
+ */
+int Fil_append_f64(Fil *fil, double d);
+
 /**
  * Merge two Fil structs.
  * Returns 0 on success, positive integer on error.
@@ -151,7 +306,6 @@ char* Fil_sistr(Fil *fil, const char *seq, unsigned long index);
 
 /**
  * Work in progress:
- * - Search and replace functions with chars on fil.string.
  * - Search and replace utility functions, on char*, might be used with fil.string ?
  * - Implement tests
  */
@@ -159,14 +313,638 @@ char *Fil_sfchr(Fil *fil, const char c);
 char *Fil_slchr(Fil *fil, const char c);
 char *Fil_sichr(Fil *fil, const char c, unsigned long index);
 
-int Fil_rfchr(Fil *fil, const char c);
-int Fil_rlchr(Fil *fil, const char c);
-int Fil_richr(Fil *fil, const char c, unsigned long index);
-int Fil_rachr(Fil *fil, const char c);
+/**
+ * Replace the first, last, index-th or all occurences of c1 by c2 in the Fil.
+ * Returns 0 on success, positive integer on error.
+ */
+int Fil_rfchr(Fil *fil, const char c1, const char c2);
+int Fil_rlchr(Fil *fil, const char c1, const char c2);
+int Fil_richr(Fil *fil, const char c1, unsigned long index, const char c2);
+int Fil_rachr(Fil *fil, const char c1, const char c2);
 // const char *Fil_strsf(const char *s1, const char *s2);
 // const char *Fil_strsf(const char *s1, const char *s2);
 
+/**
+ * Needle compiled once with Fil_pattern_init and reused across searches:
+ * length, SIMD filter bytes and the forward and backward Two-Way tables.
+ * A compiled pattern is only read by the search functions and can be
+ * shared between threads.
+ */
+typedef struct {
+    const char *needle;
+    unsigned long len;
+    unsigned long rare[2];
+    unsigned long split[2];
+    unsigned long period[2];
+    int periodic[2];
+    int ready[2];
+    unsigned char skip[2][256];
+} Fil_Pattern;
+
+/**
+ * Compile needle into pat, the needle is copied.
+ * Returns 0 on success, positive integer on error.
+ */
+int Fil_pattern_init(Fil_Pattern *pat, const char *needle);
+
+/**
+ * Free memory allocated by Fil_pattern_init.
+ */
+void Fil_pattern_free(Fil_Pattern *pat);
+
+/**
+ * Same as Fil_sfstr, Fil_slstr and Fil_sistr with a compiled pattern.
+ */
+char *Fil_sfpat(Fil *fil, const Fil_Pattern *pat);
+char *Fil_slpat(Fil *fil, const Fil_Pattern *pat);
+char *Fil_sipat(Fil *fil, const Fil_Pattern *pat, unsigned long index);
+
+/**
+ * Same as Fil_rastr with a compiled pattern.
+ * Returns 0 on success, positive integer on error.
+ */
+int Fil_rapat(Fil *fil, const Fil_Pattern *pat, const char *s2);
+
+/**
+ * Multi-pattern dictionary compiled into an Aho-Corasick automaton.
+ * Bytes are folded into equivalence classes, only the bytes used by the
+ * needles get their own class, so the transition table is a dense array of
+ * class_count entries per state.
+ */
+typedef struct {
+    unsigned int *transitions;
+    unsigned int *outputs;
+    unsigned int *depths;
+    unsigned long *needle_lens;
+    unsigned long *replacement_offsets;
+    unsigned long *replacement_lens;
+    char *replacements;
+    unsigned long count;
+    unsigned int state_count;
+    unsigned int class_count;
+    unsigned short classes[256];
+} Fil_Dict;
+
+/**
+ * Compile count needles, and their replacements, into dict.
+ * replacements may be NULL for a search only dictionary.
+ * When a needle is given twice, the first one is kept.
+ * Returns 0 on success, positive integer on error.
+ */
+int Fil_dict_build(Fil_Dict *dict, const char **needles, const char **replacements, unsigned long count);
+
+/**
+ * Free memory allocated by Fil_dict_build.
+ */
+void Fil_dict_free(Fil_Dict *dict);
+
+/**
+ * Look for the leftmost-longest occurence of any dict needle in the Fil.
+ * Stores the index of the found needle in index if not NULL.
+ * Returns a pointer to the found occurence, NULL if not found.
+ */
+char *Fil_smulti(Fil *fil, const Fil_Dict *dict, unsigned long *index);
+
+/**
+ * Replace every dict needle by its replacement in a single pass over the Fil.
+ * Matches are selected leftmost-longest and never overlap.
+ * The search for the next match restarts at the end of the previous one,
+ * so the bytes read past a match to settle its length are read again. The
+ * worst case is O(n * L) for L the longest needle, e.g. needles "a" and
+ * "aa...ab" over a run of 'a', it is linear when matches are settled by
+ * their own last byte.
+ * Returns 0 on success, positive integer on error.
+ */
+int Fil_rmulti(Fil *fil, const Fil_Dict *dict);
+
+/**
+ * Non-owning slice of len bytes starting at ptr, it is not null terminated
+ * and may contain null bytes.
+ * A view stays valid as long as the string it points to is not modified,
+ * views of a Fil are invalidated by any function that resizes it.
+ */
+typedef struct {
+    const char *ptr;
+    unsigned long len;
+} Fil_View;
+
+/**
+ * Returned by the view search functions when nothing is found.
+ */
+#define FIL_NPOS (~0UL)
+
+/**
+ * View of the whole string of the Fil, of a null terminated string, or of
+ * len bytes of view starting at start. Out of range bounds are clamped.
+ */
+Fil_View Fil_view(const Fil *fil);
+Fil_View Fil_view_cstr(const char *str);
+Fil_View Fil_view_sub(Fil_View view, unsigned long start, unsigned long len);
+
+/**
+ * Append the bytes of view to the Fil, view may point into the Fil itself.
+ * Returns 0 on success, positive integer on error.
+ */
+int Fil_append_v(Fil *fil, Fil_View view);
+
+/**
+ * Compares the bytes of v1 and v2.
+ * Returns 0 if v1 == v2, positive integer otherwise.
+ */
+unsigned long Fil_cmp_v(Fil_View v1, Fil_View v2);
+
+/**
+ * Same as Fil_sfstr, Fil_slstr and Fil_sistr on the bytes of hay.
+ * Returns the offset of the found occurence in hay, FIL_NPOS if not found.
+ */
+unsigned long Fil_sfstr_v(Fil_View hay, Fil_View seq);
+unsigned long Fil_slstr_v(Fil_View hay, Fil_View seq);
+unsigned long Fil_sistr_v(Fil_View hay, Fil_View seq, unsigned long index);
+
+/**
+ * Convert the ASCII letters of the Fil to lower or upper case in place,
+ * other bytes are left as they are.
+ * Returns 0 on success, positive integer on error.
+ */
+int Fil_to_lower(Fil *fil);
+int Fil_to_upper(Fil *fil);
+
+/**
+ * Compares the bytes of v1 and v2, ignoring the case of ASCII letters.
+ * Returns 0 if v1 == v2, positive integer otherwise.
+ */
+unsigned long Fil_cmp_ci_v(Fil_View v1, Fil_View v2);
+
+/**
+ * Same as Fil_sfstr_v, Fil_slstr_v and Fil_sistr_v, ignoring the case of
+ * ASCII letters. Case is folded while scanning, hay is not copied.
+ * Returns the offset of the found occurence in hay, FIL_NPOS if not found.
+ */
+unsigned long Fil_sfstr_ci_v(Fil_View hay, Fil_View seq);
+unsigned long Fil_slstr_ci_v(Fil_View hay, Fil_View seq);
+unsigned long Fil_sistr_ci_v(Fil_View hay, Fil_View seq, unsigned long index);
+
+/**
+ * Same as Fil_sfstr, Fil_slstr and Fil_sistr, ignoring the case of ASCII
+ * letters.
+ * Returns a pointer to the found occurence, NULL if not found.
+ */
+char *Fil_sfstr_ci(Fil *fil, const char *seq);
+char *Fil_slstr_ci(Fil *fil, const char *seq);
+char *Fil_sistr_ci(Fil *fil, const char *seq, unsigned long index);
+
+/**
+ * Same as Fil_rfstr, Fil_rastr, Fil_rlstr and Fil_ristr with views,
+ * s1 and s2 must not point into the Fil.
+ * Returns 0 on success, positive integer on error.
+ */
+int Fil_rfstr_v(Fil *fil, Fil_View s1, Fil_View s2);
+int Fil_rastr_v(Fil *fil, Fil_View s1, Fil_View s2);
+int Fil_rlstr_v(Fil *fil, Fil_View s1, Fil_View s2);
+int Fil_ristr_v(Fil *fil, Fil_View s1, unsigned long index, Fil_View s2);
+
+/**
+ * Initialize an empty arena, chunk_size 0 selects FIL_ARENA_CHUNK_SIZE.
+ */
+void Fil_arena_init(Fil_Arena *arena, unsigned long chunk_size);
+
+/**
+ * Allocate size bytes from the arena, aligned on 16 bytes.
+ * Returns a pointer to the allocated memory, NULL on error.
+ */
+void *Fil_arena_alloc(Fil_Arena *arena, unsigned long size);
+
+/**
+ * Allocate an empty Fil in the arena, its string is allocated there too.
+ * Returns a pointer to the Fil, NULL on error.
+ */
+Fil *Fil_arena_new(Fil_Arena *arena);
+
+/**
+ * Make an empty Fil allocate its string in the arena.
+ * Returns 0 on success, positive integer on error.
+ */
+int Fil_arena_attach(Fil_Arena *arena, Fil *fil);
+
+/**
+ * Release every allocation at once, the most recent chunk is kept for reuse.
+ * The Fils of the arena must not be used afterwards.
+ */
+void Fil_arena_reset(Fil_Arena *arena);
+
+/**
+ * Free the arena and every allocation made in it.
+ */
+void Fil_arena_free(Fil_Arena *arena);
+
+/**
+ * Set the allocator of the Fils that have none, NULL restores malloc.
+ * Only change it while none of them holds a heap allocation.
+ */
+void Fil_set_allocator(const Fil_Allocator *allocator);
+
+/**
+ * Make an empty Fil allocate its string with allocator, NULL selects the
+ * global allocator again.
+ * Returns 0 on success, positive integer on error.
+ */
+int Fil_use_allocator(Fil *fil, const Fil_Allocator *allocator);
+
+#ifndef FIL_TCACHE_MAX_CLASS
+#define FIL_TCACHE_MAX_CLASS 20
+#endif // FIL_TCACHE_MAX_CLASS
+
+#ifndef FIL_TCACHE_DEPTH
+#define FIL_TCACHE_DEPTH 32
+#endif // FIL_TCACHE_DEPTH
+
+/**
+ * Allocator caching freed buffers per thread, without any lock.
+ * Sizes are rounded up to a power of two, at least 32 bytes and at most
+ * 2^FIL_TCACHE_MAX_CLASS, larger ones go straight to malloc. Each thread
+ * keeps up to FIL_TCACHE_DEPTH free buffers per size, a buffer freed by
+ * another thread than the one that allocated it joins the cache of the
+ * freeing thread. Growing within a size class does not move the buffer.
+ * The cache of a thread is released when it exits.
+ */
+const Fil_Allocator *Fil_tcache_allocator(void);
+
+/**
+ * Release the buffers cached by the calling thread.
+ */
+void Fil_tcache_flush(void);
+
+#ifndef FIL_ROPE_CHUNK_SIZE
+#define FIL_ROPE_CHUNK_SIZE 1024
+#endif // FIL_ROPE_CHUNK_SIZE
+
+/**
+ * Text stored as a treap of chunks of at most FIL_ROPE_CHUNK_SIZE bytes,
+ * ordered by position, each node caches the length of its subtree.
+ * Chunks are never modified once created, an edit inside a chunk replaces
+ * it, so insert, delete and concat are O(log n) whatever the text size.
+ * A zeroed Fil_Rope is an empty rope.
+ */
+typedef struct {
+    struct Fil_RopeNode *root;
+} Fil_Rope;
+
+/**
+ * Initialize rope with the bytes of view.
+ * Returns 0 on success, positive integer on error.
+ */
+int Fil_rope_init(Fil_Rope *rope, Fil_View view);
+
+/**
+ * Free every chunk of the rope, it is left empty and can be reused.
+ */
+void Fil_rope_free(Fil_Rope *rope);
+
+/**
+ * Returns the length of the rope text, 0 if rope is NULL.
+ */
+unsigned long Fil_rope_len(const Fil_Rope *rope);
+
+/**
+ * Insert the bytes of view at offset, delete len bytes at offset, or both.
+ * Returns 0 on success, positive integer on error.
+ */
+int Fil_rope_insert(Fil_Rope *rope, unsigned long offset, Fil_View view);
+int Fil_rope_delete(Fil_Rope *rope, unsigned long offset, unsigned long len);
+int Fil_rope_replace(Fil_Rope *rope, unsigned long offset, unsigned long len, Fil_View view);
+
+/**
+ * Append the text of src to dest without copying it, src is left empty.
+ * Returns 0 on success, positive integer on error.
+ */
+int Fil_rope_concat(Fil_Rope *dest, Fil_Rope *src);
+
+/**
+ * Look for the first occurence of seq starting at or after offset from,
+ * matches spanning several chunks are found too.
+ * Returns the offset of the found occurence, FIL_NPOS if not found.
+ */
+unsigned long Fil_rope_sfstr(const Fil_Rope *rope, Fil_View seq, unsigned long from);
+
+/**
+ * Copy the rope text into the Fil, replacing its content.
+ * Returns 0 on success, positive integer on error.
+ */
+int Fil_rope_flatten(const Fil_Rope *rope, Fil *fil);
+
+/**
+ * Buffers are split in chunks of at least FIL_PAR_MIN_CHUNK bytes, smaller
+ * buffers are searched on the calling thread.
+ */
+#ifndef FIL_PAR_MIN_CHUNK
+#define FIL_PAR_MIN_CHUNK (1UL << 16)
+#endif // FIL_PAR_MIN_CHUNK
+
+/**
+ * Pool of worker threads started once and reused by the parallel
+ * functions, the calling thread works too.
+ * A pool runs the work of one caller at a time.
+ */
+typedef struct {
+    struct Fil_PoolState *state;
+    unsigned long threads;
+} Fil_Pool;
+
+/**
+ * Start a pool of threads threads, calling thread included, 0 selects the
+ * number of online CPUs.
+ * Returns 0 on success, positive integer on error.
+ */
+int Fil_pool_init(Fil_Pool *pool, unsigned long threads);
+
+/**
+ * Stop the threads and free the pool.
+ */
+void Fil_pool_free(Fil_Pool *pool);
+
+/**
+ * Same as counting with Fil_sistr_v, on the threads of pool.
+ * Matches straddling two chunks are resolved so the result is the same as
+ * a single threaded scan. pool may be NULL to run on the calling thread.
+ * *count is set to the number of non-overlapping occurences of seq in hay.
+ * Returns 0 on success, none found included, positive integer on error.
+ */
+int Fil_count_str_par(Fil_Pool *pool, Fil_View hay, Fil_View seq, unsigned long *count);
+
+/**
+ * Offsets of all the non-overlapping occurences of seq in hay, in order,
+ * found on the threads of pool. *offsets is allocated and must be freed
+ * with free().
+ * Returns 0 on success, positive integer on error.
+ */
+int Fil_find_all_par(Fil_Pool *pool, Fil_View hay, Fil_View seq, unsigned long **offsets, unsigned long *count);
+
+/**
+ * Same as Fil_rastr_v on the threads of pool. The matches are found in
+ * parallel, a prefix sum of the output size of each chunk tells where it
+ * goes and the chunks are then written concurrently into a new buffer.
+ * s1 and s2 must not point into the Fil.
+ * Returns 0 on success, positive integer on error.
+ */
+int Fil_rastr_par(Fil_Pool *pool, Fil *fil, Fil_View s1, Fil_View s2);
+
+/**
+ * Set of unique strings, each stored once, null terminated, in an arena.
+ * A string gets a stable id, its index in order of insertion, and a stable
+ * pointer, so equal strings of a table compare by id or by pointer.
+ * Slots are probed linearly and cache the hash of their string.
+ */
+typedef struct {
+    Fil_Arena arena;
+    struct Fil_InternSlot *slots;
+    unsigned long capacity;
+    Fil_View *strings;
+    unsigned long count;
+    unsigned long strings_capacity;
+    char *block;
+    unsigned long block_left;
+} Fil_Intern;
+
+/**
+ * Start an empty table, sized for capacity strings before it grows.
+ * Returns 0 on success, positive integer on error.
+ */
+int Fil_intern_init(Fil_Intern *intern, unsigned long capacity);
+
+/**
+ * Free the table and all of its strings.
+ */
+void Fil_intern_free(Fil_Intern *intern);
+
+/**
+ * Add view to the table if it is not in yet and store its id in id.
+ * Returns 0 on success, positive integer on error.
+ */
+int Fil_intern_add(Fil_Intern *intern, Fil_View view, unsigned long *id);
+
+/**
+ * Returns the id of view, FIL_NPOS if it is not in the table.
+ */
+unsigned long Fil_intern_find(const Fil_Intern *intern, Fil_View view);
+
+/**
+ * Returns the string of id, a view with a NULL ptr if there is none.
+ */
+Fil_View Fil_intern_get(const Fil_Intern *intern, unsigned long id);
+
+/**
+ * Iterator over the tokens of a view, separated by a byte, a string or any
+ * byte of a set. Tokens are views into the input, nothing is copied.
+ * n delimiters give n + 1 tokens, empty ones included, so an empty view
+ * gives a single empty token. A view with a NULL ptr gives none.
+ */
+typedef struct {
+    Fil_View rest;
+    int kind;
+    int done;
+    char byte;
+    unsigned char bitmap[32];
+    unsigned char nibbles[2][16];
+    Fil_Pattern delim;
+} Fil_Split;
+
+/**
+ * Start splitting view on the byte delim, on the string delim or on every
+ * byte of set. An empty delimiter string or set gives the whole view.
+ * Returns 0 on success, positive integer on error.
+ */
+int Fil_split_byte(Fil_Split *split, Fil_View view, char delim);
+int Fil_split_str(Fil_Split *split, Fil_View view, Fil_View delim);
+int Fil_split_set(Fil_Split *split, Fil_View view, Fil_View set);
+
+/**
+ * Store the next token in token.
+ * Returns 1 if a token was stored, 0 at the end.
+ */
+int Fil_split_next(Fil_Split *split, Fil_View *token);
+
+/**
+ * Byte translation map, byte b becomes b + deltas[b].
+ * Bit h of rows is set when a byte of high nibble h is changed, maps
+ * changing a few rows are applied with a pshufb per row, the others with
+ * a table lookup per byte.
+ */
+typedef struct {
+    unsigned char deltas[256];
+    unsigned int rows;
+} Fil_ByteMap;
+
+#ifndef FIL_TRANSLATE_ROWS
+#define FIL_TRANSLATE_ROWS 4
+#endif // FIL_TRANSLATE_ROWS
+
+/**
+ * Start a map leaving every byte as it is.
+ */
+void Fil_bytemap_init(Fil_ByteMap *map);
+
+/**
+ * Map each byte of from to the byte of to at the same index, or to the
+ * single byte of to. Later bytes of from override earlier ones.
+ * Returns 0 on success, positive integer on error.
+ */
+int Fil_bytemap_set(Fil_ByteMap *map, Fil_View from, Fil_View to);
+
+/**
+ * Apply map to the bytes of the Fil in place.
+ * Returns 0 on success, positive integer on error.
+ */
+int Fil_translate(Fil *fil, const Fil_ByteMap *map);
+
+/**
+ * Remove the bytes of the Fil that are in set, in a single pass.
+ * Returns 0 on success, positive integer on error.
+ */
+int Fil_delete_chars(Fil *fil, Fil_View set);
+
+/**
+ * Offsets of the newlines of a text, lines are numbered from 0.
+ * n newlines make n + 1 lines, the last one empty when the text ends with
+ * a newline. Line ranges exclude the newline.
+ */
+typedef struct {
+    unsigned long *newlines;
+    unsigned long count;
+    unsigned long capacity;     // Offsets newlines has room for.
+    unsigned long len;
+} Fil_LineIndex;
+
+/**
+ * Index the newlines of view, on the threads of pool. pool may be NULL to
+ * run on the calling thread.
+ * Returns 0 on success, positive integer on error.
+ */
+int Fil_line_index_init(Fil_LineIndex *index, Fil_View view, Fil_Pool *pool);
+
+/**
+ * Free the offsets of the index.
+ */
+void Fil_line_index_free(Fil_LineIndex *index);
+
+/**
+ * Index the bytes appended to the text since the last update, view is the
+ * whole text and must start with the bytes already indexed.
+ * Returns 0 on success, positive integer on error.
+ */
+int Fil_line_index_update(Fil_LineIndex *index, Fil_View view);
+
+/**
+ * Returns the number of lines of the index.
+ */
+unsigned long Fil_line_count(const Fil_LineIndex *index);
+
+/**
+ * Store the offsets of the first byte of line and of the byte after it in
+ * start and end.
+ * Returns 0 on success, positive integer on error.
+ */
+int Fil_line_range(const Fil_LineIndex *index, unsigned long line, unsigned long *start, unsigned long *end);
+
+/**
+ * Returns the line of the byte at offset, a newline belongs to the line it
+ * ends. FIL_NPOS if offset is past the end of the text.
+ */
+unsigned long Fil_line_of(const Fil_LineIndex *index, unsigned long offset);
+
+#define FIL_STATS_BUCKETS 64
+
+/**
+ * Counters of the calling thread, kept when fil.c is compiled with
+ * FIL_STATS defined. Without it they are not updated and cost nothing,
+ * a snapshot is all zeroes.
+ * scanned and matches count the bytes examined and the matches found by
+ * the search kernels, a function searching twice counts twice.
+ * capacities[i] is the number of Fils freed with a capacity in
+ * [2^i, 2^(i+1)). Work done on Fil_Pool threads counts on those threads.
+ */
+typedef struct {
+    unsigned long reallocs;
+    unsigned long realloc_bytes;
+    unsigned long copied;
+    unsigned long scanned;
+    unsigned long matches;
+    unsigned long capacities[FIL_STATS_BUCKETS];
+} Fil_Stats;
+
+/**
+ * Copy the counters of the calling thread into stats.
+ */
+void Fil_stats_snapshot(Fil_Stats *stats);
+
+/**
+ * Set the counters of the calling thread to zero.
+ */
+void Fil_stats_reset(void);
+
+/**
+ * Map the file at path read-only into view, without copying it.
+ * The pages are read on first access, the kernel is told the mapping is
+ * read sequentially. Empty files give an empty view.
+ * The view search functions work on it directly, release it with
+ * Fil_unmap_file.
+ * Returns 0 on success, positive integer on error.
+ */
+int Fil_map_file(Fil_View *view, const char *path);
+
+/**
+ * Unmap a view returned by Fil_map_file, the view is left empty.
+ */
+void Fil_unmap_file(Fil_View *view);
+
+#ifndef FIL_STREAM_CHUNK_SIZE
+#define FIL_STREAM_CHUNK_SIZE (1UL << 20)
+#endif // FIL_STREAM_CHUNK_SIZE
+
+/**
+ * Called with the offset of every match found by Fil_stream_search.
+ * Return 0 to continue, anything else stops the search.
+ */
+typedef int (*Fil_Match_Fn)(unsigned long offset, void *ctx);
+
+/**
+ * Search seq in the file at path without loading it, the file is read in
+ * chunks of chunk_size bytes, 0 selects FIL_STREAM_CHUNK_SIZE, and the
+ * next chunk is read ahead by the kernel while the current one is searched.
+ * Memory use is bounded by the chunk size whatever the file size.
+ * Matches do not overlap, like Fil_sistr, and are reported in file order.
+ * Returns 0 on success, FIL_ERR_SEQNOTFOUND if nothing was found,
+ * positive integer on error.
+ */
+int Fil_stream_search(const char *path, Fil_View seq, unsigned long chunk_size, Fil_Match_Fn on_match, void *ctx);
+
 int Fil_read_from_file(Fil *fil, const char *path);
+
+/**
+ * Write the Fil to the file at path, an existing file is only replaced
+ * when overwrite is not 0.
+ * Returns 0 on success, positive integer on error.
+ */
 int Fil_write_to_file(Fil *fil, const char *path, int overwrite);
 
+// Fil_write_views modes, to be or'ed together.
+#define FIL_WRITE_OVERWRITE 0x1
+#define FIL_WRITE_APPEND    0x2
+#define FIL_WRITE_ATOMIC    0x4
+
+/**
+ * Write the count views one after the other to the file at path, with as
+ * few writev calls as possible and without any intermediate copy.
+ * By default the file must not exist yet.
+ * FIL_WRITE_OVERWRITE replaces an existing file.
+ * FIL_WRITE_APPEND appends to the file, creating it if needed, with
+ * O_APPEND so concurrent appenders do not overwrite each other.
+ * FIL_WRITE_ATOMIC writes a temporary file next to path, syncs it and
+ * renames it to path, readers see either the old or the whole new file.
+ * An overwritten file keeps its permission bits, its owner and extended
+ * attributes are not preserved.
+ * It can not be combined with FIL_WRITE_APPEND.
+ * Returns 0 on success, positive integer on error.
+ */
+int Fil_write_views(const char *path, const Fil_View *views, unsigned long count, int mode);
+
 #endif // FIL_H
\ No newline at end of file
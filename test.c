@@ -1,8 +1,12 @@
 #include "fil.h"
 
 #include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sys/stat.h>
 
-#define PRINT_FIL(fil) (printf("Cap: %lu, Len: %lu, String: %s\n", (fil).capacity, (fil).len, (fil).string))
+#define PRINT_FIL(fil) (printf("Cap: %lu, Len: %lu, String: %s\n", Fil_capacity(&(fil)), (fil).len, Fil_str(&(fil))))
 #define PRINT_POINTER(ptr) (printf("%s: %p\n", #ptr, ptr))
 
 #define PASS(test) (printf("\tTest passed: %s:%d:%s: %s\n", __FILE__, __LINE__, __func__, #test))
@@ -23,6 +27,10 @@ void Fil_len_test(void);
 void Fil_cmp_test(void);
 void Fil_cpy_test(void);
 void Fil_append_test(void);
+void Fil_move_test(void);
+void Fil_appendf_test(void);
+void Fil_append_int_test(void);
+void Fil_append_f64_test(void);
 void Fil_merge_test(void);
 void Fil_sfstr_test(void);
 void Fil_slstr_test(void);
@@ -30,12 +38,46 @@ void Fil_sistr_test(void);
 void Fil_sfchr_test(void);
 void Fil_slchr_test(void);
 void Fil_sichr_test(void);
+void Fil_rchr_test(void);
+void Fil_translate_test(void);
+void Fil_delete_chars_test(void);
 void Fil_rfstr_test(void);
 void Fil_rastr_test(void);
 void Fil_rlstr_test(void);
 void Fil_ristr_test(void);
+void Fil_pattern_init_test(void);
+void Fil_sfpat_test(void);
+void Fil_slpat_test(void);
+void Fil_sipat_test(void);
+void Fil_rapat_test(void);
+void Fil_smulti_test(void);
+void Fil_rmulti_test(void);
+void Fil_view_test(void);
+void Fil_append_v_test(void);
+void Fil_cmp_v_test(void);
+void Fil_sstr_v_test(void);
+void Fil_rstr_v_test(void);
+void Fil_to_lower_test(void);
+void Fil_sstr_ci_test(void);
+void Fil_split_test(void);
+void Fil_line_index_test(void);
+void Fil_arena_test(void);
+void Fil_intern_test(void);
+void Fil_rope_test(void);
+void Fil_rope_sfstr_test(void);
+void Fil_pool_test(void);
+void Fil_count_str_par_test(void);
+void Fil_find_all_par_test(void);
+void Fil_rastr_par_test(void);
+void Fil_map_file_test(void);
+void Fil_stream_search_test(void);
 void Fil_read_from_file_test(void);
 void Fil_write_to_file_test(void);
+void Fil_write_views_test(void);
+void Fil_stats_test(void);
+void Fil_allocator_test(void);
+void Fil_tcache_test(void);
+void Fil_growth_test(void);
 
 int main(void)
 {
@@ -45,6 +87,10 @@ int main(void)
     TEST(Fil_cmp_test);
     TEST(Fil_cpy_test);
     TEST(Fil_append_test);
+    TEST(Fil_move_test);
+    TEST(Fil_appendf_test);
+    TEST(Fil_append_int_test);
+    TEST(Fil_append_f64_test);
     TEST(Fil_merge_test);
     TEST(Fil_sfstr_test);
     TEST(Fil_slstr_test);
@@ -52,12 +98,46 @@ int main(void)
     TEST(Fil_sfchr_test);
     TEST(Fil_slchr_test);
     TEST(Fil_sichr_test);
+    TEST(Fil_rchr_test);
+    TEST(Fil_translate_test);
+    TEST(Fil_delete_chars_test);
     TEST(Fil_rfstr_test);
     TEST(Fil_rastr_test);
     TEST(Fil_rlstr_test);
     TEST(Fil_ristr_test);
+    TEST(Fil_pattern_init_test);
+    TEST(Fil_sfpat_test);
+    TEST(Fil_slpat_test);
+    TEST(Fil_sipat_test);
+    TEST(Fil_rapat_test);
+    TEST(Fil_smulti_test);
+    TEST(Fil_rmulti_test);
+    TEST(Fil_view_test);
+    TEST(Fil_append_v_test);
+    TEST(Fil_cmp_v_test);
+    TEST(Fil_sstr_v_test);
+    TEST(Fil_rstr_v_test);
+    TEST(Fil_to_lower_test);
+    TEST(Fil_sstr_ci_test);
+    TEST(Fil_split_test);
+    TEST(Fil_line_index_test);
+    TEST(Fil_arena_test);
+    TEST(Fil_intern_test);
+    TEST(Fil_rope_test);
+    TEST(Fil_rope_sfstr_test);
+    TEST(Fil_pool_test);
+    TEST(Fil_count_str_par_test);
+    TEST(Fil_find_all_par_test);
+    TEST(Fil_rastr_par_test);
+    TEST(Fil_map_file_test);
+    TEST(Fil_stream_search_test);
     TEST(Fil_read_from_file_test);
     TEST(Fil_write_to_file_test);
+    TEST(Fil_write_views_test);
+    TEST(Fil_stats_test);
+    TEST(Fil_allocator_test);
+    TEST(Fil_tcache_test);
+    TEST(Fil_growth_test);
     return 0;
 }
 
@@ -75,15 +155,32 @@ void Fil_resize_test(void)
     ASSERT(Fil_resize(NULL, FIL_RESIZE_FACTOR) & FIL_ERR_PARAM);
     ASSERT(Fil_resize(&fil, 0) & FIL_ERR_PARAM);
 
-    unsigned long new_cap = fil.capacity * FIL_RESIZE_FACTOR;
+    unsigned long new_cap = Fil_capacity(&fil) * FIL_RESIZE_FACTOR;
     Fil_resize(&fil, new_cap);
-    ASSERT(fil.capacity == new_cap);
+    ASSERT(Fil_capacity(&fil) == new_cap);
+
+    ASSERT(Fil_resize(&fil, 4) == 0);
+    ASSERT(fil.is_inline);
+    ASSERT(Fil_capacity(&fil) == FIL_SSO_CAPACITY);
+    Fil_str(&fil)[0] = 'a';
+    ASSERT(Fil_resize(&fil, FIL_SSO_CAPACITY * 4) == 0);
+    ASSERT(!fil.is_inline);
+    ASSERT(Fil_str(&fil)[0] == 'a');
+    ASSERT(Fil_capacity(&fil) == FIL_SSO_CAPACITY * 4);
+
+    Fil_free(&fil);
 }
 
 void Fil_len_test(void)
 {
     ASSERT(Fil_len(NULL) == 0);
     ASSERT(Fil_len("Test") == 4);
+
+    char long_str[128];
+    memset(long_str, 'a', sizeof(long_str) - 1);
+    long_str[sizeof(long_str) - 1] = 0;
+    ASSERT(Fil_len(long_str) == 127);
+    ASSERT(Fil_len(long_str + 3) == 124);
 }
 
 void Fil_cmp_test(void)
@@ -97,9 +194,17 @@ void Fil_cmp_test(void)
 
 void Fil_cpy_test(void)
 {
-    char hello[13] = "Hello";
+    char hello[sizeof("Hello, world!")] = "Hello";
     Fil_cpy(hello + 5, ", world!");
     ASSERT(Fil_cmp(hello, "Hello, world!") == FIL_CEQ);
+
+    char src[100];
+    char dest[101] = {0};
+    memset(src, 'b', sizeof(src) - 1);
+    src[sizeof(src) - 1] = 0;
+    Fil_cpy(dest + 1, src + 1);
+    ASSERT(Fil_cmp(dest + 1, src + 1) == FIL_CEQ);
+    ASSERT(dest[0] == 0);
 }
 
 void Fil_append_test(void)
@@ -108,8 +213,137 @@ void Fil_append_test(void)
     const char *hello = "Hello, world!";
 
     Fil_append(&fil, hello);
-    ASSERT(Fil_cmp(fil.string, hello) == FIL_CEQ);
+    ASSERT(Fil_cmp(Fil_str(&fil), hello) == FIL_CEQ);
     ASSERT(fil.len == Fil_len(hello));
+    ASSERT(fil.is_inline);
+    ASSERT(Fil_capacity(&fil) == FIL_SSO_CAPACITY);
+
+    Fil_append(&fil, " Hello, world! Hello, world!");
+    ASSERT(Fil_cmp(Fil_str(&fil), "Hello, world! Hello, world! Hello, world!") == FIL_CEQ);
+    ASSERT(!fil.is_inline);
+    ASSERT(Fil_capacity(&fil) > fil.len);
+
+    Fil_free(&fil);
+    ASSERT(Fil_str(&fil) == NULL);
+}
+
+static Fil move_make(const char *str)
+{
+    Fil fil = {0};
+    Fil_append(&fil, str);
+    return fil;
+}
+
+void Fil_move_test(void)
+{
+    // Returned by value, inline and on the heap.
+    Fil short_fil = move_make("key");
+    Fil long_fil = move_make("a value too long for the inline buffer");
+    ASSERT(short_fil.is_inline);
+    ASSERT(Fil_cmp(Fil_str(&short_fil), "key") == FIL_CEQ);
+    ASSERT(Fil_cmp(Fil_str(&long_fil), "a value too long for the inline buffer") == FIL_CEQ);
+
+    // Moved with memcpy into an array that is then moved by realloc.
+    Fil *fils = malloc(2 * sizeof(Fil));
+    ASSERT(fils != NULL);
+    memcpy(&fils[0], &short_fil, sizeof(Fil));
+    memcpy(&fils[1], &long_fil, sizeof(Fil));
+    Fil *moved = malloc(64 * sizeof(Fil));
+    ASSERT(moved != NULL);
+    memcpy(moved, fils, 2 * sizeof(Fil));
+    memset(fils, 0xAA, 2 * sizeof(Fil));
+    free(fils);
+    fils = realloc(moved, 128 * sizeof(Fil));
+    ASSERT(fils != NULL);
+    ASSERT(Fil_cmp(Fil_str(&fils[0]), "key") == FIL_CEQ);
+    ASSERT(Fil_capacity(&fils[0]) == FIL_SSO_CAPACITY);
+    ASSERT(Fil_append(&fils[0], "s and a longer tail that spills") == 0);
+    ASSERT(Fil_cmp(Fil_str(&fils[0]), "keys and a longer tail that spills") == FIL_CEQ);
+    ASSERT(Fil_append(&fils[1], "!") == 0);
+    ASSERT(Fil_cmp(Fil_str(&fils[1]), "a value too long for the inline buffer!") == FIL_CEQ);
+
+    ASSERT(Fil_str(NULL) == NULL);
+    ASSERT(Fil_capacity(NULL) == 0);
+    Fil_free(&fils[0]);
+    Fil_free(&fils[1]);
+    ASSERT(Fil_str(&fils[0]) == NULL);
+    ASSERT(Fil_capacity(&fils[0]) == 0);
+    free(fils);
+}
+
+void Fil_appendf_test(void)
+{
+    Fil fil = {0};
+    ASSERT(Fil_appendf(NULL, "%d", 1) & FIL_ERR_PARAM);
+
+    ASSERT(Fil_appendf(&fil, "%s", "") == 0);
+    ASSERT(Fil_str(&fil) != NULL && fil.len == 0);
+    ASSERT(Fil_appendf(&fil, "%s=%d", "answer", 42) == 0);
+    ASSERT(Fil_cmp(Fil_str(&fil), "answer=42") == FIL_CEQ);
+    ASSERT(Fil_appendf(&fil, ", %s and %05.1f", "grows past the inline buffer", 3.14159) == 0);
+    ASSERT(Fil_cmp(Fil_str(&fil), "answer=42, grows past the inline buffer and 003.1") == FIL_CEQ);
+    ASSERT(fil.len == Fil_len(Fil_str(&fil)));
+
+    Fil_free(&fil);
+}
+
+void Fil_append_int_test(void)
+{
+    Fil fil = {0};
+    ASSERT(Fil_append_u64(NULL, 1) & FIL_ERR_PARAM);
+    ASSERT(Fil_append_i64(NULL, 1) & FIL_ERR_PARAM);
+
+    Fil_append_u64(&fil, 0);
+    Fil_append(&fil, " ");
+    Fil_append_u64(&fil, 7);
+    Fil_append(&fil, " ");
+    Fil_append_u64(&fil, 10);
+    Fil_append(&fil, " ");
+    Fil_append_u64(&fil, 18446744073709551615ULL);
+    ASSERT(Fil_cmp(Fil_str(&fil), "0 7 10 18446744073709551615") == FIL_CEQ);
+
+    Fil_free(&fil);
+    Fil_append_i64(&fil, -1);
+    Fil_append(&fil, " ");
+    Fil_append_i64(&fil, 123456789);
+    Fil_append(&fil, " ");
+    Fil_append_i64(&fil, -9223372036854775807LL - 1);
+    ASSERT(Fil_cmp(Fil_str(&fil), "-1 123456789 -9223372036854775808") == FIL_CEQ);
+
+    Fil_free(&fil);
+}
+
+void Fil_append_f64_test(void)
+{
+    Fil fil = {0};
+    ASSERT(Fil_append_f64(NULL, 1.0) & FIL_ERR_PARAM);
+
+    const double values[] = {0.0, -0.0, 5.0, 0.1, 1.0 / 3.0, 100.0, 0.001234, 1e-7, 1e21, 123.456e300, 5e-324, -2.5};
+    const char *expected[] = {"0", "-0", "5", "0.1", "0.3333333333333333", "100", "0.001234", "1e-7", "1e+21",
+                              "1.23456e+302", "5e-324", "-2.5"};
+    for (unsigned long i = 0; i < sizeof(values) / sizeof(values[0]); i++)
+    {
+        Fil_free(&fil);
+        Fil_append_f64(&fil, values[i]);
+        ASSERT(Fil_cmp(Fil_str(&fil), expected[i]) == FIL_CEQ);
+    }
+
+    // Grisu3 leaves the first three to the exact fallback, then the ends of the normal range.
+    const double hard[] = {41653430430398784.0, 8.565368834782699e16, 4.104e22, 2.2250738585072014e-308,
+                           1.7976931348623157e308};
+    const char *hard_expected[] = {"41653430430398780", "85653688347826990", "4.104e+22", "2.2250738585072014e-308",
+                                   "1.7976931348623157e+308"};
+    for (unsigned long i = 0; i < sizeof(hard) / sizeof(hard[0]); i++)
+    {
+        Fil_free(&fil);
+        Fil_append_f64(&fil, hard[i]);
+        ASSERT(Fil_cmp(Fil_str(&fil), hard_expected[i]) == FIL_CEQ);
+    }
+
+    Fil_free(&fil);
+    Fil_append_f64(&fil, 1.0 / 0.0);
+    Fil_append_f64(&fil, -1.0 / 0.0);
+    ASSERT(Fil_cmp(Fil_str(&fil), "inf-inf") == FIL_CEQ);
 
     Fil_free(&fil);
 }
@@ -122,8 +356,8 @@ void Fil_merge_test(void)
 
     Fil_append(&dest, "Hello");
     Fil_append(&src, ", world!");
-    Fil_merge(&dest, &src);
-    ASSERT(Fil_cmp(dest.string, hello) == FIL_CEQ);
+    ASSERT(Fil_merge(&dest, &src) == 0);
+    ASSERT(Fil_cmp(Fil_str(&dest), hello) == FIL_CEQ);
     ASSERT(dest.len == Fil_len(hello));
 
     Fil_free(&dest);
@@ -138,6 +372,23 @@ void Fil_sfstr_test(void)
     const char *ptr = Fil_sfstr(&fil, "world");
     ASSERT(ptr != NULL);
     ASSERT(Fil_cmp(ptr, "world!world") == FIL_CEQ);
+
+    Fil prefix = {0};
+    Fil_append(&prefix, "aaab");
+    ASSERT(Fil_sfstr(&prefix, "aab") == Fil_str(&prefix) + 1);
+    ASSERT(Fil_sfstr(&prefix, "") == NULL);
+
+    Fil long_fil = {0};
+    char needle[101];
+    memset(needle, 'x', sizeof(needle) - 1);
+    needle[sizeof(needle) - 1] = 0;
+    for (int i = 0; i < 50; i++) Fil_append(&long_fil, "xxxxxxxxxxy");
+    Fil_append(&long_fil, needle);
+    ASSERT(Fil_sfstr(&long_fil, needle) == Fil_str(&long_fil) + 550);
+
+    Fil_free(&fil);
+    Fil_free(&prefix);
+    Fil_free(&long_fil);
 }
 
 void Fil_slstr_test(void)
@@ -148,6 +399,15 @@ void Fil_slstr_test(void)
     const char *ptr = Fil_slstr(&fil, "world");
     ASSERT(ptr != NULL);
     ASSERT(Fil_cmp(ptr, "world!") == FIL_CEQ);
+    ASSERT(Fil_slstr(&fil, "Hello") == Fil_str(&fil));
+    ASSERT(Fil_slstr(&fil, "planet") == NULL);
+
+    Fil repeat = {0};
+    Fil_append(&repeat, "aaa");
+    ASSERT(Fil_slstr(&repeat, "aa") == Fil_str(&repeat) + 1);
+
+    Fil_free(&fil);
+    Fil_free(&repeat);
 }
 
 void Fil_sistr_test(void)
@@ -158,6 +418,15 @@ void Fil_sistr_test(void)
     const char *ptr = Fil_sistr(&fil, "world", 2);
     ASSERT(ptr != NULL);
     ASSERT(Fil_cmp(ptr, "world!world!") == FIL_CEQ);
+    ASSERT(Fil_sistr(&fil, "world", 4) == NULL);
+
+    Fil repeat = {0};
+    Fil_append(&repeat, "aaaaa");
+    ASSERT(Fil_sistr(&repeat, "aa", 2) == Fil_str(&repeat) + 2);
+    ASSERT(Fil_sistr(&repeat, "aa", 3) == NULL);
+
+    Fil_free(&fil);
+    Fil_free(&repeat);
 }
 
 void Fil_sfchr_test(void)
@@ -166,7 +435,7 @@ void Fil_sfchr_test(void)
     Fil_append(&fil, "Hello, world!");
 
     const char *ptr = Fil_sfchr(&fil, ',');
-    ASSERT(ptr == fil.string + 5);
+    ASSERT(ptr == Fil_str(&fil) + 5);
 }
 
 void Fil_slchr_test(void)
@@ -175,7 +444,14 @@ void Fil_slchr_test(void)
     Fil_append(&fil, "Hello! world!");
 
     const char *ptr = Fil_slchr(&fil, '!');
-    ASSERT(ptr == fil.string + 12);
+    ASSERT(ptr == Fil_str(&fil) + 12);
+    ASSERT(Fil_slchr(&fil, 'H') == Fil_str(&fil));
+    ASSERT(Fil_slchr(&fil, '?') == NULL);
+
+    for (int i = 0; i < 10; i++) Fil_append(&fil, "0123456789");
+    ASSERT(Fil_slchr(&fil, '!') == Fil_str(&fil) + 12);
+
+    Fil_free(&fil);
 }
 
 void Fil_sichr_test(void)
@@ -184,7 +460,88 @@ void Fil_sichr_test(void)
     Fil_append(&fil, "Hello! world!");
 
     const char *ptr = Fil_sichr(&fil, '!', 2);
-    ASSERT(ptr == fil.string + 12);
+    ASSERT(ptr == Fil_str(&fil) + 12);
+}
+
+void Fil_rchr_test(void)
+{
+    Fil fil = {0};
+    ASSERT(Fil_rfchr(NULL, 'a', 'b') & FIL_ERR_PARAM);
+    ASSERT(Fil_rachr(&fil, 'a', 'b') & FIL_ERR_PARAM);
+    Fil_append(&fil, "a,b,c,d");
+
+    ASSERT(Fil_rfchr(&fil, ',', ';') == 0);
+    ASSERT(Fil_cmp(Fil_str(&fil), "a;b,c,d") == FIL_CEQ);
+    ASSERT(Fil_rlchr(&fil, ',', '|') == 0);
+    ASSERT(Fil_cmp(Fil_str(&fil), "a;b,c|d") == FIL_CEQ);
+    ASSERT(Fil_richr(&fil, ';', 1, '.') == 0);
+    ASSERT(Fil_richr(&fil, ',', 2, '.') == FIL_ERR_SEQNOTFOUND);
+    ASSERT(Fil_richr(&fil, ',', 0, '.') & FIL_ERR_PARAM);
+    ASSERT(Fil_cmp(Fil_str(&fil), "a.b,c|d") == FIL_CEQ);
+    ASSERT(Fil_rfchr(&fil, 'x', 'y') == FIL_ERR_SEQNOTFOUND);
+
+    Fil_free(&fil);
+    for (int i = 0; i < 20; i++) Fil_append(&fil, "a,b\t");
+    ASSERT(Fil_rachr(&fil, '\t', ',') == 0);
+    ASSERT(Fil_sfchr(&fil, '\t') == NULL);
+    ASSERT(Fil_sichr(&fil, ',', 40) == Fil_str(&fil) + 79);
+    ASSERT(Fil_rachr(&fil, '\t', ',') == FIL_ERR_SEQNOTFOUND);
+
+    Fil_free(&fil);
+}
+
+void Fil_translate_test(void)
+{
+    Fil_ByteMap map;
+    Fil fil = {0};
+    Fil_bytemap_init(&map);
+    ASSERT(Fil_bytemap_set(&map, Fil_view_cstr("ab"), Fil_view_cstr("xyz")) & FIL_ERR_PARAM);
+    ASSERT(Fil_translate(&fil, &map) & FIL_ERR_PARAM);
+
+    // Few rows, the shuffle kernels and the tail.
+    Fil_append(&fil, "id;name|city\tzip;\x01 Brussels|1000\t\xff;end of a longer record|x");
+    ASSERT(Fil_bytemap_set(&map, Fil_view_cstr(";|\t"), Fil_view_cstr(",")) == 0);
+    ASSERT(Fil_bytemap_set(&map, Fil_view_cstr("\x01\xff"), Fil_view_cstr("??")) == 0);
+    ASSERT(map.rows == ((1U << 0) | (1U << 3) | (1U << 7) | (1U << 15)));
+    ASSERT(Fil_translate(&fil, &map) == 0);
+    ASSERT(Fil_cmp(Fil_str(&fil), "id,name,city,zip,? Brussels,1000,?,end of a longer record,x") == FIL_CEQ);
+
+    // Every row, the table loop.
+    Fil_ByteMap rot;
+    Fil_bytemap_init(&rot);
+    char from[256], to[256];
+    for (int i = 0; i < 256; i++)
+    {
+        from[i] = (char)i;
+        to[i] = (char)(i + 1);
+    }
+    ASSERT(Fil_bytemap_set(&rot, (Fil_View){from, 256}, (Fil_View){to, 256}) == 0);
+    ASSERT(rot.rows == 0xFFFF);
+    ASSERT(Fil_translate(&fil, &rot) == 0);
+    ASSERT(Fil_cmp(Fil_str(&fil), "je-obnf-djuz-{jq-@!Csvttfmt-2111-@-foe!pg!b!mpohfs!sfdpse-y") == FIL_CEQ);
+
+    Fil_free(&fil);
+}
+
+void Fil_delete_chars_test(void)
+{
+    Fil fil = {0};
+    ASSERT(Fil_delete_chars(&fil, Fil_view_cstr("a")) & FIL_ERR_PARAM);
+
+    Fil_append(&fil, "no control characters here, nothing to remove");
+    ASSERT(Fil_delete_chars(&fil, Fil_view_cstr("\r\x7f")) == 0);
+    ASSERT(fil.len == 45);
+
+    Fil_free(&fil);
+    Fil_append(&fil, "line one\r\n\x01line\x7f two\r\nand a third line longer than one block\r\n\x02");
+    ASSERT(Fil_delete_chars(&fil, Fil_view_cstr("\r\x01\x02\x7f")) == 0);
+    ASSERT(Fil_cmp(Fil_str(&fil), "line one\nline two\nand a third line longer than one block\n") == FIL_CEQ);
+    ASSERT(fil.len == 57);
+
+    ASSERT(Fil_delete_chars(&fil, Fil_view_cstr("\nabcdefghijklmnopqrstuvwxyz ")) == 0);
+    ASSERT(fil.len == 0 && Fil_str(&fil)[0] == 0);
+
+    Fil_free(&fil);
 }
 
 void Fil_rfstr_test(void)
@@ -198,7 +555,7 @@ void Fil_rfstr_test(void)
     ASSERT(Fil_rfstr(&fil, "Test", "Hello") & FIL_ERR_SEQNOTFOUND);
 
     Fil_rfstr(&fil, "bar", "Hello, world!");
-    ASSERT(Fil_cmp(fil.string, "foo Hello, world! bar baz") == FIL_CEQ);
+    ASSERT(Fil_cmp(Fil_str(&fil), "foo Hello, world! bar baz") == FIL_CEQ);
 }
 
 void Fil_rastr_test(void)
@@ -211,8 +568,20 @@ void Fil_rastr_test(void)
     ASSERT(Fil_rastr(&fil, "Test", NULL) & FIL_ERR_PARAM);
     ASSERT(Fil_rastr(&fil, "Test", "Hello") & FIL_ERR_SEQNOTFOUND);
 
-    Fil_rastr(&fil, "bar", "Hello, world!");
-    ASSERT(Fil_cmp(fil.string, "foo Hello, world! Hello, world! baz") == FIL_CEQ);
+    ASSERT(Fil_rastr(&fil, "bar", "Hello, world!") == 0);
+    ASSERT(Fil_cmp(Fil_str(&fil), "foo Hello, world! Hello, world! baz") == FIL_CEQ);
+
+    ASSERT(Fil_rastr(&fil, "Hello, world!", "bar") == 0);
+    ASSERT(Fil_cmp(Fil_str(&fil), "foo bar bar baz") == FIL_CEQ);
+    ASSERT(fil.len == Fil_len("foo bar bar baz"));
+
+    ASSERT(Fil_rastr(&fil, "ba", "ab") == 0);
+    ASSERT(Fil_cmp(Fil_str(&fil), "foo abr abr abz") == FIL_CEQ);
+
+    ASSERT(Fil_rastr(&fil, "ab", "abab") == 0);
+    ASSERT(Fil_cmp(Fil_str(&fil), "foo ababr ababr ababz") == FIL_CEQ);
+
+    Fil_free(&fil);
 }
 
 void Fil_rlstr_test(void)
@@ -226,7 +595,7 @@ void Fil_rlstr_test(void)
     ASSERT(Fil_rlstr(&fil, "Test", "Hello") & FIL_ERR_SEQNOTFOUND);
 
     Fil_rlstr(&fil, "bar", "Hello, world!");
-    ASSERT(Fil_cmp(fil.string, "foo bar Hello, world! baz") == FIL_CEQ);
+    ASSERT(Fil_cmp(Fil_str(&fil), "foo bar Hello, world! baz") == FIL_CEQ);
 }
 
 void Fil_ristr_test(void)
@@ -241,9 +610,812 @@ void Fil_ristr_test(void)
     ASSERT(Fil_ristr(&fil, "Test", 1, "Hello") & FIL_ERR_SEQNOTFOUND);
 
     Fil_ristr(&fil, "bar", 2, "Hello, world!");
-    ASSERT(Fil_cmp(fil.string, "foo bar Hello, world! bar baz") == FIL_CEQ);
+    ASSERT(Fil_cmp(Fil_str(&fil), "foo bar Hello, world! bar baz") == FIL_CEQ);
+}
+
+void Fil_pattern_init_test(void)
+{
+    Fil_Pattern pat;
+
+    ASSERT(Fil_pattern_init(NULL, "world") & FIL_ERR_PARAM);
+    ASSERT(Fil_pattern_init(&pat, NULL) & FIL_ERR_PARAM);
+    ASSERT(Fil_pattern_init(&pat, "") & FIL_ERR_PARAM);
+    ASSERT(Fil_pattern_init(&pat, "world") == 0);
+    ASSERT(pat.len == 5);
+    ASSERT(Fil_cmp(pat.needle, "world") == FIL_CEQ);
+
+    Fil_pattern_free(&pat);
+}
+
+void Fil_sfpat_test(void)
+{
+    Fil fil = {0};
+    Fil_Pattern pat;
+    Fil_append(&fil, "Hello, world!world");
+    Fil_pattern_init(&pat, "world");
+
+    ASSERT(Fil_sfpat(NULL, &pat) == NULL);
+    ASSERT(Fil_sfpat(&fil, NULL) == NULL);
+    ASSERT(Fil_sfpat(&fil, &pat) == Fil_str(&fil) + 7);
+
+    Fil_free(&fil);
+    Fil_pattern_free(&pat);
+}
+
+void Fil_slpat_test(void)
+{
+    Fil fil = {0};
+    Fil_Pattern pat;
+    Fil_append(&fil, "Hello, worldworld!");
+    Fil_pattern_init(&pat, "world");
+
+    ASSERT(Fil_slpat(&fil, &pat) == Fil_str(&fil) + 12);
+
+    Fil_free(&fil);
+    Fil_pattern_free(&pat);
+}
+
+void Fil_sipat_test(void)
+{
+    Fil fil = {0};
+    Fil_Pattern pat;
+    Fil_append(&fil, "Hello, world!world!world!");
+    Fil_pattern_init(&pat, "world");
+
+    ASSERT(Fil_sipat(&fil, &pat, 0) == NULL);
+    ASSERT(Fil_sipat(&fil, &pat, 2) == Fil_str(&fil) + 13);
+    ASSERT(Fil_sipat(&fil, &pat, 4) == NULL);
+
+    Fil_free(&fil);
+    Fil_pattern_free(&pat);
+}
+
+void Fil_rapat_test(void)
+{
+    Fil fil = {0};
+    Fil_Pattern pat;
+    Fil_append(&fil, "foo bar bar baz");
+    Fil_pattern_init(&pat, "bar");
+
+    ASSERT(Fil_rapat(&fil, &pat, NULL) & FIL_ERR_PARAM);
+    ASSERT(Fil_rapat(&fil, &pat, "qux") == 0);
+    ASSERT(Fil_cmp(Fil_str(&fil), "foo qux qux baz") == FIL_CEQ);
+    ASSERT(Fil_rapat(&fil, &pat, "qux") & FIL_ERR_SEQNOTFOUND);
+
+    Fil_free(&fil);
+    Fil_pattern_free(&pat);
+}
+
+void Fil_smulti_test(void)
+{
+    const char *needles[] = { "bar", "ba", "baz" };
+    Fil_Dict dict = {0};
+    Fil fil = {0};
+    unsigned long index = 0;
+
+    ASSERT(Fil_dict_build(NULL, needles, NULL, 3) & FIL_ERR_PARAM);
+    ASSERT(Fil_dict_build(&dict, needles, NULL, 0) & FIL_ERR_PARAM);
+    ASSERT(Fil_dict_build(&dict, needles, NULL, 3) == 0);
+
+    Fil_append(&fil, "foo baz bar");
+    ASSERT(Fil_smulti(&fil, &dict, &index) == Fil_str(&fil) + 4);
+    ASSERT(index == 2);
+
+    Fil_free(&fil);
+    Fil_dict_free(&dict);
+}
+
+void Fil_rmulti_test(void)
+{
+    const char *needles[] = { "&", "<", ">", "<<" };
+    const char *replacements[] = { "&amp;", "&lt;", "&gt;", "&laquo;" };
+    Fil_Dict dict = {0};
+    Fil fil = {0};
+
+    ASSERT(Fil_dict_build(&dict, needles, replacements, 4) == 0);
+    ASSERT(Fil_rmulti(NULL, &dict) & FIL_ERR_PARAM);
+    ASSERT(Fil_rmulti(&fil, NULL) & FIL_ERR_PARAM);
+
+    Fil_append(&fil, "a < b && c >> d << e");
+    ASSERT(Fil_rmulti(&fil, &dict) == 0);
+    ASSERT(Fil_cmp(Fil_str(&fil), "a &lt; b &amp;&amp; c &gt;&gt; d &laquo; e") == FIL_CEQ);
+    ASSERT(fil.len == Fil_len(Fil_str(&fil)));
+    ASSERT(Fil_rmulti(&fil, &dict) == 0);
+    ASSERT(Fil_cmp(Fil_str(&fil), "a &amp;lt; b &amp;amp;&amp;amp; c &amp;gt;&amp;gt; d &amp;laquo; e") == FIL_CEQ);
+
+    Fil_free(&fil);
+    Fil_append(&fil, "nothing to escape");
+    ASSERT(Fil_rmulti(&fil, &dict) & FIL_ERR_SEQNOTFOUND);
+
+    Fil_free(&fil);
+    Fil_dict_free(&dict);
+}
+
+void Fil_view_test(void)
+{
+    Fil fil = {0};
+    Fil_View view = Fil_view(&fil);
+    ASSERT(view.ptr == NULL && view.len == 0);
+    view = Fil_view(NULL);
+    ASSERT(view.ptr == NULL && view.len == 0);
+    view = Fil_view_cstr(NULL);
+    ASSERT(view.ptr == NULL && view.len == 0);
+
+    Fil_append(&fil, "key=value");
+    view = Fil_view(&fil);
+    ASSERT(view.ptr == Fil_str(&fil) && view.len == 9);
+
+    Fil_View sub = Fil_view_sub(view, 4, 5);
+    ASSERT(sub.ptr == Fil_str(&fil) + 4 && sub.len == 5);
+    sub = Fil_view_sub(view, 4, 100);
+    ASSERT(sub.len == 5);
+    sub = Fil_view_sub(view, 100, 1);
+    ASSERT(sub.ptr == Fil_str(&fil) + 9 && sub.len == 0);
+    sub = Fil_view_sub(Fil_view(NULL), 1, 1);
+    ASSERT(sub.ptr == NULL && sub.len == 0);
+
+    Fil_free(&fil);
+}
+
+void Fil_append_v_test(void)
+{
+    Fil fil = {0};
+    Fil_View bad = {NULL, 3};
+    ASSERT(Fil_append_v(NULL, Fil_view_cstr("Hello")) & FIL_ERR_PARAM);
+    ASSERT(Fil_append_v(&fil, bad) & FIL_ERR_PARAM);
+
+    ASSERT(Fil_append_v(&fil, Fil_view_sub(Fil_view_cstr("Hello, World!"), 0, 5)) == 0);
+    ASSERT(Fil_cmp(Fil_str(&fil), "Hello") == FIL_CEQ);
+    ASSERT(Fil_append_v(&fil, Fil_view(NULL)) == 0);
+    ASSERT(fil.len == 5);
+
+    Fil_View nul = {"a\0b", 3};
+    ASSERT(Fil_append_v(&fil, nul) == 0);
+    ASSERT(fil.len == 8);
+    ASSERT(Fil_str(&fil)[6] == 0 && Fil_str(&fil)[7] == 'b');
+
+    // Doubling the Fil from a view of itself, across a resize.
+    for (int i = 0; i < 4; i++) Fil_append_v(&fil, Fil_view(&fil));
+    ASSERT(fil.len == 128);
+    ASSERT(Fil_cmp_v(Fil_view_sub(Fil_view(&fil), 120, 8), Fil_view_sub(Fil_view(&fil), 0, 8)) == FIL_CEQ);
+
+    Fil_free(&fil);
+}
+
+void Fil_cmp_v_test(void)
+{
+    Fil_View bad = {NULL, 3};
+    ASSERT(Fil_cmp_v(bad, Fil_view_cstr("abc")) & FIL_ERR_PARAM);
+    ASSERT(Fil_cmp_v(Fil_view_cstr("abc"), Fil_view_cstr("abc")) == FIL_CEQ);
+    ASSERT(Fil_cmp_v(Fil_view_cstr("abc"), Fil_view_cstr("abd")) == FIL_CNEQ);
+    ASSERT(Fil_cmp_v(Fil_view_cstr("abc"), Fil_view_cstr("ab")) == FIL_CNEQ);
+    ASSERT(Fil_cmp_v(Fil_view_cstr(""), Fil_view(NULL)) == FIL_CEQ);
+
+    Fil_View a = {"x\0y", 3};
+    Fil_View b = {"x\0z", 3};
+    ASSERT(Fil_cmp_v(a, b) == FIL_CNEQ);
+    ASSERT(Fil_cmp_v(Fil_view_sub(a, 0, 2), Fil_view_sub(b, 0, 2)) == FIL_CEQ);
+}
+
+void Fil_sstr_v_test(void)
+{
+    Fil_View hay = Fil_view_cstr("name,age,city,age");
+    ASSERT(Fil_sfstr_v(hay, Fil_view_cstr("age")) == 5);
+    ASSERT(Fil_slstr_v(hay, Fil_view_cstr("age")) == 14);
+    ASSERT(Fil_sistr_v(hay, Fil_view_cstr("age"), 2) == 14);
+    ASSERT(Fil_sistr_v(hay, Fil_view_cstr("age"), 3) == FIL_NPOS);
+    ASSERT(Fil_sistr_v(hay, Fil_view_cstr("age"), 0) == FIL_NPOS);
+    ASSERT(Fil_sfstr_v(hay, Fil_view_cstr("zip")) == FIL_NPOS);
+    ASSERT(Fil_sfstr_v(hay, Fil_view_cstr("")) == FIL_NPOS);
+    ASSERT(Fil_sfstr_v(Fil_view(NULL), Fil_view_cstr("age")) == FIL_NPOS);
+
+    // Fields of a line, without copies.
+    Fil_View rest = hay;
+    unsigned long comma, fields = 0;
+    while ((comma = Fil_sfstr_v(rest, Fil_view_cstr(","))) != FIL_NPOS)
+    {
+        fields++;
+        rest = Fil_view_sub(rest, comma + 1, FIL_NPOS);
+    }
+    ASSERT(fields == 3);
+    ASSERT(Fil_cmp_v(rest, Fil_view_cstr("age")) == FIL_CEQ);
+
+    // The needle is not matched past the end of the view.
+    ASSERT(Fil_sfstr_v(Fil_view_sub(hay, 0, 6), Fil_view_cstr("age")) == FIL_NPOS);
+
+    Fil_View nul = {"a\0b\0c", 5};
+    Fil_View seq = {"\0c", 2};
+    ASSERT(Fil_sfstr_v(nul, seq) == 3);
+}
+
+void Fil_rstr_v_test(void)
+{
+    Fil fil = {0};
+    Fil_View bad = {NULL, 3};
+    ASSERT(Fil_rfstr_v(NULL, Fil_view_cstr("a"), Fil_view_cstr("b")) & FIL_ERR_PARAM);
+    ASSERT(Fil_rfstr_v(&fil, bad, Fil_view_cstr("b")) & FIL_ERR_PARAM);
+    ASSERT(Fil_rastr_v(&fil, Fil_view_cstr("a"), bad) & FIL_ERR_PARAM);
+    ASSERT(Fil_ristr_v(&fil, Fil_view_cstr("a"), 0, Fil_view_cstr("b")) & FIL_ERR_PARAM);
+    ASSERT(Fil_rlstr_v(&fil, Fil_view_cstr("a"), Fil_view_cstr("b")) & FIL_ERR_SEQNOTFOUND);
+
+    Fil_append(&fil, "one two one two one");
+    Fil_View line = Fil_view_cstr("one,uno;");
+    ASSERT(Fil_rfstr_v(&fil, Fil_view_sub(line, 0, 3), Fil_view_sub(line, 4, 3)) == 0);
+    ASSERT(Fil_cmp(Fil_str(&fil), "uno two one two one") == FIL_CEQ);
+    ASSERT(Fil_rlstr_v(&fil, Fil_view_cstr("one"), Fil_view_cstr("1")) == 0);
+    ASSERT(Fil_cmp(Fil_str(&fil), "uno two one two 1") == FIL_CEQ);
+    ASSERT(Fil_ristr_v(&fil, Fil_view_cstr("two"), 2, Fil_view(NULL)) == 0);
+    ASSERT(Fil_cmp(Fil_str(&fil), "uno two one  1") == FIL_CEQ);
+    ASSERT(Fil_rastr_v(&fil, Fil_view_cstr(" "), Fil_view_cstr("__")) == 0);
+    ASSERT(Fil_cmp(Fil_str(&fil), "uno__two__one____1") == FIL_CEQ);
+    ASSERT(fil.len == Fil_len(Fil_str(&fil)));
+    ASSERT(Fil_rastr_v(&fil, Fil_view(NULL), Fil_view_cstr("x")) & FIL_ERR_SEQNOTFOUND);
+
+    Fil_free(&fil);
+}
+
+void Fil_to_lower_test(void)
+{
+    Fil fil = {0};
+    ASSERT(Fil_to_lower(NULL) & FIL_ERR_PARAM);
+    ASSERT(Fil_to_lower(&fil) & FIL_ERR_PARAM);
+
+    // Longer than a vector, with the bytes around the letter ranges.
+    Fil_append(&fil, "@AZ[`az{ Content-Type: TEXT/html; charset=UTF-8 \xc1\xe1 0123456789");
+    ASSERT(Fil_to_lower(&fil) == 0);
+    ASSERT(Fil_cmp(Fil_str(&fil), "@az[`az{ content-type: text/html; charset=utf-8 \xc1\xe1 0123456789") == FIL_CEQ);
+    ASSERT(Fil_to_upper(&fil) == 0);
+    ASSERT(Fil_cmp(Fil_str(&fil), "@AZ[`AZ{ CONTENT-TYPE: TEXT/HTML; CHARSET=UTF-8 \xc1\xe1 0123456789") == FIL_CEQ);
+
+    Fil_free(&fil);
+}
+
+void Fil_sstr_ci_test(void)
+{
+    Fil fil = {0};
+    Fil_append(&fil, "GET / HTTP/1.1\r\nHost: example.com\r\ncontent-length: 42\r\nX-Empty:\r\nCONTENT-LENGTH: 7\r\n");
+
+    ASSERT(Fil_sfstr_ci(&fil, "Content-Length:") == Fil_str(&fil) + 35);
+    ASSERT(Fil_slstr_ci(&fil, "Content-Length:") == Fil_str(&fil) + 65);
+    ASSERT(Fil_sistr_ci(&fil, "content-LENGTH", 2) == Fil_str(&fil) + 65);
+    ASSERT(Fil_sistr_ci(&fil, "content-LENGTH", 3) == NULL);
+    ASSERT(Fil_sfstr_ci(&fil, "host") == Fil_str(&fil) + 16);
+    ASSERT(Fil_sfstr_ci(&fil, "HOST: EXAMPLE.ORG") == NULL);
+    ASSERT(Fil_sfstr_ci(&fil, "") == NULL);
+    ASSERT(Fil_sfstr_ci(NULL, "host") == NULL);
+
+    // Only ASCII letters fold.
+    ASSERT(Fil_sfstr_ci_v(Fil_view_cstr("a@b"), Fil_view_cstr("A`B")) == FIL_NPOS);
+    ASSERT(Fil_sfstr_ci_v(Fil_view_cstr("\xe1"), Fil_view_cstr("\xc1")) == FIL_NPOS);
+    ASSERT(Fil_slstr_ci_v(Fil_view_cstr("abAB"), Fil_view_cstr("Ab")) == 2);
+    ASSERT(Fil_slstr_ci_v(Fil_view_cstr("ab"), Fil_view_cstr("abc")) == FIL_NPOS);
+
+    // Backward search over several vector blocks, the last match is kept.
+    char text[200];
+    memset(text, 'x', sizeof(text));
+    memcpy(text + 3, "NeEdLe", 6);
+    memcpy(text + 100, "needle", 6);
+    memcpy(text + 190, "NEEDL", 5);
+    ASSERT(Fil_slstr_ci_v((Fil_View){text, sizeof(text)}, Fil_view_cstr("needle")) == 100);
+    ASSERT(Fil_slstr_ci_v((Fil_View){text, 99}, Fil_view_cstr("NEEDLE")) == 3);
+    ASSERT(Fil_slstr_ci_v((Fil_View){text + 4, 190}, Fil_view_cstr("needle")) == 96);
+    ASSERT(Fil_slstr_ci_v((Fil_View){text, 8}, Fil_view_cstr("needle")) == FIL_NPOS);
+
+    // Every position passes the first and last byte filter, Two-Way takes over.
+    static char run[1 << 16];
+    for (unsigned long i = 0; i < sizeof(run); i++) run[i] = i % 3 ? 'a' : 'A';
+    char periodic[33];
+    memset(periodic, 'a', 32);
+    periodic[32] = '\0';
+    periodic[30] = 'B';
+    memcpy(run + 40000, "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaB", 32);
+    memcpy(run + 20000, "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaabA", 32);
+    ASSERT(Fil_sfstr_ci_v((Fil_View){run, sizeof(run)}, Fil_view_cstr(periodic)) == 20000);
+    ASSERT(Fil_slstr_ci_v((Fil_View){run, sizeof(run)}, Fil_view_cstr(periodic)) == 40001);
+    ASSERT(Fil_slstr_ci_v((Fil_View){run, sizeof(run)}, Fil_view_cstr("aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaab")) == 40000);
+    ASSERT(Fil_sfstr_ci_v((Fil_View){run, sizeof(run)}, Fil_view_cstr("aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaab")) == 19999);
+    ASSERT(Fil_sfstr_ci_v((Fil_View){run, 20030}, Fil_view_cstr("aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaab")) == FIL_NPOS);
+    ASSERT(Fil_slstr_ci_v((Fil_View){run + 20001, 20000}, Fil_view_cstr(periodic)) == FIL_NPOS);
+
+    ASSERT(Fil_cmp_ci_v(Fil_view_cstr("Keep-Alive"), Fil_view_cstr("keep-alive")) == FIL_CEQ);
+    ASSERT(Fil_cmp_ci_v(Fil_view_cstr("Keep-Alive"), Fil_view_cstr("keep-alive ")) == FIL_CNEQ);
+    ASSERT(Fil_cmp_ci_v(Fil_view_cstr("["), Fil_view_cstr("{")) == FIL_CNEQ);
+
+    Fil_free(&fil);
+}
+
+static int split_check(Fil_Split *split, const char **expected, int count)
+{
+    Fil_View token;
+    for (int i = 0; i < count; i++)
+    {
+        if (!Fil_split_next(split, &token)) return 0;
+        if (token.len != strlen(expected[i]) || memcmp(token.ptr, expected[i], token.len)) return 0;
+    }
+    return !Fil_split_next(split, &token) && !Fil_split_next(split, &token);
+}
+
+void Fil_split_test(void)
+{
+    Fil_Split split;
+    Fil_View token;
+    ASSERT(Fil_split_byte(NULL, Fil_view_cstr("a"), ',') & FIL_ERR_PARAM);
+    ASSERT(Fil_split_str(&split, Fil_view_cstr("a"), (Fil_View){NULL, 1}) & FIL_ERR_PARAM);
+
+    const char *csv[] = {"name", "", "age", "city", ""};
+    ASSERT(Fil_split_byte(&split, Fil_view_cstr("name,,age,city,"), ',') == 0);
+    ASSERT(split_check(&split, csv, 5));
+
+    const char *tsv[] = {"a\tb"};
+    ASSERT(Fil_split_byte(&split, Fil_view_cstr("a\tb"), ',') == 0);
+    ASSERT(split_check(&split, tsv, 1));
+
+    const char *empty[] = {""};
+    ASSERT(Fil_split_byte(&split, Fil_view_cstr(""), ',') == 0);
+    ASSERT(split_check(&split, empty, 1));
+    ASSERT(Fil_split_byte(&split, Fil_view(NULL), ',') == 0);
+    ASSERT(!Fil_split_next(&split, &token));
+
+    const char *str[] = {"std", "vector", "", "size"};
+    ASSERT(Fil_split_str(&split, Fil_view_cstr("std::vector::::size"), Fil_view_cstr("::")) == 0);
+    ASSERT(split_check(&split, str, 4));
+    const char *whole[] = {"a::b"};
+    ASSERT(Fil_split_str(&split, Fil_view_cstr("a::b"), Fil_view_cstr("")) == 0);
+    ASSERT(split_check(&split, whole, 1));
+
+    const char *set[] = {"one", "two", "", "three", "four"};
+    ASSERT(Fil_split_set(&split, Fil_view_cstr("one two\t,three,four"), Fil_view_cstr(" \t,")) == 0);
+    ASSERT(split_check(&split, set, 5));
+    ASSERT(Fil_split_set(&split, Fil_view_cstr("a::b"), Fil_view_cstr("")) == 0);
+    ASSERT(split_check(&split, whole, 1));
+
+    // Long enough for the vector loops, with delimiters in the tail and >= 0x80.
+    const char *set_long[] = {"0123456789012345678901234567890123456789", "ab", "c", "d"};
+    ASSERT(Fil_split_set(&split, Fil_view_cstr("0123456789012345678901234567890123456789\xe9" "ab;c\xff" "d"),
+                         Fil_view_cstr("\xff;\xe9")) == 0);
+    ASSERT(split_check(&split, set_long, 4));
+
+    char buf[100];
+    memset(buf, 'x', sizeof(buf));
+    buf[33] = '\x80';
+    buf[70] = '\x7f';
+    int count = 0;
+    ASSERT(Fil_split_set(&split, (Fil_View){buf, sizeof(buf)}, Fil_view_cstr("\x7f\x80")) == 0);
+    while (Fil_split_next(&split, &token)) count++;
+    ASSERT(count == 3);
+    ASSERT(token.ptr == buf + 71 && token.len == 29);
 }
 
+void Fil_line_index_test(void)
+{
+    Fil_LineIndex index;
+    unsigned long start, end;
+    ASSERT(Fil_line_index_init(NULL, Fil_view_cstr("a"), NULL) & FIL_ERR_PARAM);
+
+    ASSERT(Fil_line_index_init(&index, Fil_view_cstr(""), NULL) == 0);
+    ASSERT(Fil_line_count(&index) == 1);
+    ASSERT(Fil_line_range(&index, 0, &start, &end) == 0 && start == 0 && end == 0);
+    ASSERT(Fil_line_range(&index, 1, &start, &end) & FIL_ERR_PARAM);
+    Fil_line_index_free(&index);
+
+    Fil fil = {0};
+    Fil_append(&fil, "first\n\nthird line");
+    ASSERT(Fil_line_index_init(&index, Fil_view(&fil), NULL) == 0);
+    ASSERT(Fil_line_count(&index) == 3);
+    ASSERT(Fil_line_range(&index, 1, &start, &end) == 0 && start == 6 && end == 6);
+    ASSERT(Fil_line_range(&index, 2, &start, &end) == 0 && start == 7 && end == 17);
+    ASSERT(Fil_line_of(&index, 0) == 0);
+    ASSERT(Fil_line_of(&index, 5) == 0);
+    ASSERT(Fil_line_of(&index, 6) == 1);
+    ASSERT(Fil_line_of(&index, 17) == 2);
+    ASSERT(Fil_line_of(&index, 18) == FIL_NPOS);
+
+    // Appended text, the new first newline ends the last line.
+    Fil_append(&fil, "\n0123456789012345678901234567890123456789\n\n");
+    ASSERT(Fil_line_index_update(&index, Fil_view_cstr("short")) & FIL_ERR_PARAM);
+    ASSERT(Fil_line_index_update(&index, Fil_view(&fil)) == 0);
+    ASSERT(Fil_line_count(&index) == 6);
+    ASSERT(Fil_line_range(&index, 2, &start, &end) == 0 && start == 7 && end == 17);
+    ASSERT(Fil_line_range(&index, 3, &start, &end) == 0 && start == 18 && end == 58);
+    ASSERT(Fil_line_range(&index, 5, &start, &end) == 0 && start == 60 && end == 60);
+    ASSERT(Fil_line_of(&index, 59) == 4);
+
+    // One line appended per update, the offsets grow geometrically.
+    unsigned long grows = 0;
+    unsigned long capacity = index.capacity;
+    for (int i = 0; i < 1000; i++)
+    {
+        Fil_append(&fil, "line\n");
+        Fil_line_index_update(&index, Fil_view(&fil));
+        grows += index.capacity != capacity;
+        capacity = index.capacity;
+    }
+    ASSERT(Fil_line_count(&index) == 1006);
+    ASSERT(grows < 16);
+    ASSERT(Fil_line_range(&index, 1004, &start, &end) == 0 && start == fil.len - 5 && end == fil.len - 1);
+    Fil_line_index_free(&index);
+    ASSERT(index.capacity == 0);
+
+    // Several chunks on the pool, same result as a single thread.
+    Fil_Pool pool = {0};
+    Fil_pool_init(&pool, 4);
+    Fil_LineIndex par;
+    Fil_free(&fil);
+    for (unsigned long i = 0; i < 2 * FIL_PAR_MIN_CHUNK; i++) Fil_append(&fil, i % 3 ? "ab\n" : "abcdef");
+    ASSERT(Fil_line_index_init(&index, Fil_view(&fil), NULL) == 0);
+    ASSERT(Fil_line_index_init(&par, Fil_view(&fil), &pool) == 0);
+    ASSERT(par.count == index.count);
+    ASSERT(memcmp(par.newlines, index.newlines, par.count * sizeof(unsigned long)) == 0);
+    ASSERT(Fil_line_of(&par, par.newlines[1000] + 1) == 1001);
+
+    Fil_line_index_free(&par);
+    Fil_line_index_free(&index);
+    Fil_pool_free(&pool);
+    Fil_free(&fil);
+}
+
+void Fil_arena_test(void)
+{
+    Fil_Arena arena;
+    Fil_arena_init(&arena, 256);
+    ASSERT(Fil_arena_alloc(NULL, 8) == NULL);
+    ASSERT(Fil_arena_alloc(&arena, 0) == NULL);
+    ASSERT(Fil_arena_new(NULL) == NULL);
+
+    char *block = Fil_arena_alloc(&arena, 3);
+    ASSERT(block != NULL);
+    ASSERT(((unsigned long)block & 15) == 0);
+    ASSERT(((unsigned long)Fil_arena_alloc(&arena, 5) & 15) == 0);
+
+    Fil *fil = Fil_arena_new(&arena);
+    ASSERT(fil != NULL);
+    ASSERT(fil->arena == &arena);
+    Fil_append(fil, "Hello, World! This string is too long to be inline.");
+    ASSERT(!fil->is_inline);
+    char *string = Fil_str(fil);
+    Fil_append(fil, " Growing it again keeps the same block.");
+    ASSERT(Fil_str(fil) == string);
+    ASSERT(Fil_cmp(Fil_str(fil), "Hello, World! This string is too long to be inline. Growing it again keeps the same block.") == FIL_CEQ);
+
+    Fil other = {0};
+    ASSERT(Fil_arena_attach(NULL, &other) & FIL_ERR_PARAM);
+    ASSERT(Fil_arena_attach(&arena, &other) == 0);
+    Fil_append(&other, "short");
+    ASSERT(other.is_inline);
+    Fil_append(&other, ", then long enough for the arena");
+    ASSERT(!other.is_inline);
+    ASSERT(Fil_arena_attach(&arena, &other) & FIL_ERR_PARAM);
+
+    Fil_append(fil, " Now it moves, past the end of the first chunk.");
+    ASSERT(Fil_str(fil) != string);
+    ASSERT(fil->len == Fil_len(Fil_str(fil)));
+    ASSERT(Fil_rastr(fil, "it", "IT") == 0);
+    ASSERT(Fil_sfstr(fil, "IT moves") != NULL);
+    ASSERT(Fil_rastr(&other, "long", "longer and longer") == 0);
+    ASSERT(Fil_cmp(Fil_str(&other), "short, then longer and longer enough for the arena") == FIL_CEQ);
+
+    Fil_Dict dict = {0};
+    const char *needles[] = {"short", "arena"};
+    const char *replacements[] = {"tiny", "heap"};
+    Fil_dict_build(&dict, needles, replacements, 2);
+    ASSERT(Fil_rmulti(&other, &dict) == 0);
+    ASSERT(Fil_cmp(Fil_str(&other), "tiny, then longer and longer enough for the heap") == FIL_CEQ);
+    ASSERT(other.arena == &arena);
+    Fil_dict_free(&dict);
+
+    Fil_free(&other);
+    ASSERT(Fil_str(&other) == NULL);
+    ASSERT(other.arena == &arena);
+
+    Fil_arena_reset(&arena);
+    ASSERT(arena.chunk != NULL);
+    fil = Fil_arena_new(&arena);
+    Fil_append(fil, "After reset");
+    ASSERT(Fil_cmp(Fil_str(fil), "After reset") == FIL_CEQ);
+
+    Fil_arena_free(&arena);
+    ASSERT(arena.chunk == NULL);
+}
+
+void Fil_intern_test(void)
+{
+    Fil_Intern intern;
+    unsigned long id, other;
+    ASSERT(Fil_intern_init(NULL, 0) & FIL_ERR_PARAM);
+    ASSERT(Fil_intern_init(&intern, 0) == 0);
+    ASSERT(Fil_intern_add(&intern, Fil_view_cstr("key"), NULL) & FIL_ERR_PARAM);
+
+    Fil fil = {0};
+    Fil_append(&fil, "user_id");
+    ASSERT(Fil_intern_add(&intern, Fil_view(&fil), &id) == 0 && id == 0);
+    ASSERT(Fil_intern_add(&intern, Fil_view_cstr("session"), &other) == 0 && other == 1);
+    ASSERT(Fil_intern_add(&intern, Fil_view_cstr("user_id"), &other) == 0 && other == id);
+    ASSERT(Fil_intern_add(&intern, Fil_view_sub(Fil_view_cstr("user"), 0, 0), &other) == 0 && other == 2);
+    ASSERT(intern.count == 3);
+
+    Fil_View str = Fil_intern_get(&intern, id);
+    ASSERT(str.ptr != Fil_str(&fil) && str.len == 7 && Fil_cmp(str.ptr, "user_id") == FIL_CEQ);
+    ASSERT(Fil_intern_get(&intern, 2).len == 0 && Fil_intern_get(&intern, 2).ptr[0] == 0);
+    ASSERT(Fil_intern_get(&intern, 3).ptr == NULL);
+    ASSERT(Fil_intern_find(&intern, Fil_view_cstr("session")) == 1);
+    ASSERT(Fil_intern_find(&intern, Fil_view_cstr("sessio")) == FIL_NPOS);
+
+    // Growing keeps ids and pointers, long strings are stored apart.
+    char key[32];
+    int same = 1;
+    for (int i = 0; i < 5000; i++)
+    {
+        snprintf(key, sizeof(key), "key-%d", i % 2500);
+        if (Fil_intern_add(&intern, Fil_view_cstr(key), &other) || other != 3 + (unsigned long)(i % 2500)) same = 0;
+    }
+    ASSERT(same);
+    ASSERT(intern.count == 2503);
+    ASSERT(Fil_intern_get(&intern, id).ptr == str.ptr);
+    ASSERT(Fil_intern_find(&intern, Fil_view_cstr("key-1234")) == 1237);
+
+    Fil_free(&fil);
+    for (unsigned long i = 0; i < FIL_ARENA_CHUNK_SIZE; i++) Fil_append(&fil, "x");
+    ASSERT(Fil_intern_add(&intern, Fil_view(&fil), &id) == 0 && id == 2503);
+    ASSERT(Fil_intern_get(&intern, id).len == FIL_ARENA_CHUNK_SIZE);
+    ASSERT(Fil_cmp_v(Fil_intern_get(&intern, id), Fil_view(&fil)) == FIL_CEQ);
+
+    Fil_free(&fil);
+    Fil_intern_free(&intern);
+}
+
+void Fil_rope_test(void)
+{
+    Fil_Rope rope = {0};
+    Fil fil = {0};
+    ASSERT(Fil_rope_init(NULL, Fil_view_cstr("Hello")) & FIL_ERR_PARAM);
+    ASSERT(Fil_rope_len(&rope) == 0);
+    ASSERT(Fil_rope_insert(&rope, 1, Fil_view_cstr("Hello")) & FIL_ERR_PARAM);
+    ASSERT(Fil_rope_insert(&rope, 0, Fil_view_cstr("World")) == 0);
+    ASSERT(Fil_rope_insert(&rope, 0, Fil_view_cstr("Hello, ")) == 0);
+    ASSERT(Fil_rope_insert(&rope, Fil_rope_len(&rope), Fil_view_cstr("!")) == 0);
+    ASSERT(Fil_rope_flatten(&rope, &fil) == 0);
+    ASSERT(Fil_cmp(Fil_str(&fil), "Hello, World!") == FIL_CEQ);
+
+    ASSERT(Fil_rope_delete(&rope, 5, 100) & FIL_ERR_PARAM);
+    ASSERT(Fil_rope_delete(&rope, 5, 2) == 0);
+    ASSERT(Fil_rope_replace(&rope, 5, 5, Fil_view_cstr(" there")) == 0);
+    ASSERT(Fil_rope_flatten(&rope, &fil) == 0);
+    ASSERT(Fil_cmp(Fil_str(&fil), "Hello there!") == FIL_CEQ);
+    ASSERT(fil.len == Fil_rope_len(&rope));
+    Fil_rope_free(&rope);
+    ASSERT(Fil_rope_len(&rope) == 0);
+
+    // Larger than a chunk, edited across chunk boundaries.
+    Fil text = {0};
+    for (int i = 0; i < 500; i++) Fil_append(&text, "0123456789");
+    ASSERT(Fil_rope_init(&rope, Fil_view(&text)) == 0);
+    ASSERT(Fil_rope_len(&rope) == 5000);
+    ASSERT(Fil_rope_delete(&rope, 1000, 2500) == 0);
+    ASSERT(Fil_rope_insert(&rope, 1500, Fil_view(&text)) == 0);
+    Fil_rope_flatten(&rope, &fil);
+    ASSERT(fil.len == 7500);
+    ASSERT(Fil_cmp_v(Fil_view_sub(Fil_view(&fil), 995, 10), Fil_view_cstr("5678901234")) == FIL_CEQ);
+    ASSERT(Fil_cmp_v(Fil_view_sub(Fil_view(&fil), 1500, 5000), Fil_view(&text)) == FIL_CEQ);
+
+    Fil_Rope other = {0};
+    Fil_rope_init(&other, Fil_view_cstr("END"));
+    ASSERT(Fil_rope_concat(&rope, &rope) & FIL_ERR_PARAM);
+    ASSERT(Fil_rope_concat(&rope, &other) == 0);
+    ASSERT(Fil_rope_len(&other) == 0);
+    ASSERT(Fil_rope_len(&rope) == 7503);
+    Fil_rope_flatten(&rope, &fil);
+    ASSERT(Fil_cmp(Fil_str(&fil) + 7500, "END") == FIL_CEQ);
+
+    Fil_rope_free(&rope);
+    Fil_free(&text);
+    Fil_free(&fil);
+}
+
+void Fil_rope_sfstr_test(void)
+{
+    Fil_Rope rope = {0};
+    ASSERT(Fil_rope_sfstr(&rope, Fil_view_cstr("a"), 0) == FIL_NPOS);
+
+    // One byte chunks, every match spans several of them.
+    const char *text = "Xabcabcabd";
+    Fil_Rope chunks = {0};
+    for (unsigned long i = 0; text[i]; i++)
+    {
+        Fil_rope_init(&rope, Fil_view_sub(Fil_view_cstr(text), i, 1));
+        Fil_rope_concat(&chunks, &rope);
+    }
+    ASSERT(Fil_rope_sfstr(&chunks, Fil_view_cstr("abd"), 0) == 7);
+    ASSERT(Fil_rope_sfstr(&chunks, Fil_view_cstr("cab"), 0) == 3);
+    ASSERT(Fil_rope_sfstr(&chunks, Fil_view_cstr("cab"), 4) == 6);
+    ASSERT(Fil_rope_sfstr(&chunks, Fil_view_cstr("Xabc"), 0) == 0);
+    ASSERT(Fil_rope_sfstr(&chunks, Fil_view_cstr("b"), 9) == FIL_NPOS);
+    ASSERT(Fil_rope_sfstr(&chunks, Fil_view_cstr("abe"), 0) == FIL_NPOS);
+    ASSERT(Fil_rope_sfstr(&chunks, Fil_view_cstr(""), 0) == FIL_NPOS);
+    ASSERT(Fil_rope_sfstr(&chunks, Fil_view_cstr("d"), 100) == FIL_NPOS);
+
+    Fil_rope_free(&chunks);
+}
+
+void Fil_pool_test(void)
+{
+    Fil_Pool pool = {0};
+    ASSERT(Fil_pool_init(NULL, 2) & FIL_ERR_PARAM);
+    ASSERT(Fil_pool_init(&pool, 0) == 0);
+    ASSERT(pool.threads >= 1);
+    Fil_pool_free(&pool);
+    ASSERT(pool.state == NULL);
+    Fil_pool_free(&pool);
+}
+
+// While set, calloc fails. The test build links with --wrap=calloc.
+static int fail_calloc;
+
+void *__real_calloc(size_t count, size_t size);
+void *__wrap_calloc(size_t count, size_t size);
+
+void *__wrap_calloc(size_t count, size_t size)
+{
+    if (fail_calloc) return NULL;
+    return __real_calloc(count, size);
+}
+
+void Fil_count_str_par_test(void)
+{
+    Fil_Pool pool = {0};
+    Fil_pool_init(&pool, 4);
+    Fil fil = {0};
+    unsigned long count = 1;
+    // "aab" repeated, "aaba" matches overlap and straddle every chunk boundary.
+    for (unsigned long i = 0; i < 3 * FIL_PAR_MIN_CHUNK; i++) Fil_append(&fil, "aab");
+
+    ASSERT(Fil_count_str_par(&pool, Fil_view(&fil), Fil_view_cstr("aab"), NULL) & FIL_ERR_PARAM);
+    ASSERT(Fil_count_str_par(&pool, Fil_view(&fil), Fil_view_cstr("aab"), &count) == 0);
+    ASSERT(count == 3 * FIL_PAR_MIN_CHUNK);
+    ASSERT(Fil_count_str_par(&pool, Fil_view(&fil), Fil_view_cstr("aaba"), &count) == 0);
+    ASSERT(count == 3 * FIL_PAR_MIN_CHUNK / 2);
+    ASSERT(Fil_count_str_par(&pool, Fil_view(&fil), Fil_view_cstr("a"), &count) == 0);
+    ASSERT(count == 6 * FIL_PAR_MIN_CHUNK);
+    ASSERT(Fil_count_str_par(NULL, Fil_view(&fil), Fil_view_cstr("ba"), &count) == 0);
+    ASSERT(count == 3 * FIL_PAR_MIN_CHUNK - 1);
+    ASSERT(Fil_count_str_par(&pool, Fil_view(&fil), Fil_view_cstr("bb"), &count) == 0);
+    ASSERT(count == 0);
+    count = 1;
+    ASSERT(Fil_count_str_par(&pool, Fil_view(&fil), Fil_view_cstr(""), &count) == 0);
+    ASSERT(count == 0);
+    ASSERT(Fil_count_str_par(&pool, Fil_view_cstr("abab"), Fil_view_cstr("ab"), &count) == 0);
+    ASSERT(count == 2);
+
+    // Running out of memory is an error, not an absence of matches.
+    fail_calloc = 1;
+    ASSERT(Fil_count_str_par(&pool, Fil_view(&fil), Fil_view_cstr("aab"), &count) == FIL_ERR_MEMORY);
+    fail_calloc = 0;
+    ASSERT(count == 0);
+
+    Fil_free(&fil);
+    Fil_pool_free(&pool);
+}
+
+void Fil_find_all_par_test(void)
+{
+    Fil_Pool pool = {0};
+    Fil_pool_init(&pool, 3);
+    Fil fil = {0};
+    for (unsigned long i = 0; i < FIL_PAR_MIN_CHUNK; i++) Fil_append(&fil, "xxxxxxx");
+
+    unsigned long *offsets = NULL;
+    unsigned long count = 0;
+    ASSERT(Fil_find_all_par(&pool, Fil_view(&fil), Fil_view_cstr("x"), NULL, &count) & FIL_ERR_PARAM);
+    ASSERT(Fil_find_all_par(&pool, Fil_view(&fil), Fil_view_cstr("y"), &offsets, &count) == FIL_ERR_SEQNOTFOUND);
+    ASSERT(offsets == NULL && count == 0);
+
+    ASSERT(Fil_find_all_par(&pool, Fil_view(&fil), Fil_view_cstr("xxx"), &offsets, &count) == 0);
+    ASSERT(count == 7 * FIL_PAR_MIN_CHUNK / 3);
+    int ordered = 1;
+    for (unsigned long i = 0; i < count; i++) ordered &= offsets[i] == i * 3;
+    ASSERT(ordered);
+    free(offsets);
+
+    fail_calloc = 1;
+    ASSERT(Fil_find_all_par(&pool, Fil_view(&fil), Fil_view_cstr("xxx"), &offsets, &count) == FIL_ERR_MEMORY);
+    fail_calloc = 0;
+    ASSERT(offsets == NULL && count == 0);
+
+    Fil_free(&fil);
+    Fil_pool_free(&pool);
+}
+
+void Fil_rastr_par_test(void)
+{
+    Fil_Pool pool = {0};
+    Fil_pool_init(&pool, 4);
+    Fil fil = {0};
+    Fil expected = {0};
+    for (unsigned long i = 0; i < FIL_PAR_MIN_CHUNK; i++)
+    {
+        Fil_append(&fil, "secret:xyz;");
+        Fil_append(&expected, "secret:[REDACTED];");
+    }
+    ASSERT(Fil_rastr_par(&pool, NULL, Fil_view_cstr("xyz"), Fil_view_cstr("")) & FIL_ERR_PARAM);
+    ASSERT(Fil_rastr_par(&pool, &fil, Fil_view_cstr("abc"), Fil_view_cstr("")) & FIL_ERR_SEQNOTFOUND);
+
+    ASSERT(Fil_rastr_par(&pool, &fil, Fil_view_cstr("xyz"), Fil_view_cstr("[REDACTED]")) == 0);
+    ASSERT(fil.len == expected.len);
+    ASSERT(Fil_cmp(Fil_str(&fil), Fil_str(&expected)) == FIL_CEQ);
+
+    // Shrinking, with matches straddling the chunk boundaries.
+    ASSERT(Fil_rastr_par(&pool, &fil, Fil_view_cstr(";secret:[REDACTED]"), Fil_view_cstr("-")) == 0);
+    ASSERT(fil.len == 17 + FIL_PAR_MIN_CHUNK);
+    ASSERT(Fil_cmp_v(Fil_view_sub(Fil_view(&fil), 0, 20), Fil_view_cstr("secret:[REDACTED]---")) == FIL_CEQ);
+    ASSERT(Fil_str(&fil)[fil.len - 1] == ';');
+
+    // Without a pool it is Fil_rastr_v.
+    ASSERT(Fil_rastr_par(NULL, &fil, Fil_view_cstr("-"), Fil_view_cstr("")) == 0);
+    ASSERT(Fil_cmp(Fil_str(&fil), "secret:[REDACTED];") == FIL_CEQ);
+
+    Fil_free(&fil);
+    Fil_free(&expected);
+    Fil_pool_free(&pool);
+}
+
+void Fil_map_file_test(void)
+{
+    const char *file_path = "tests/read_from_file.txt";
+    Fil_View view = {0};
+    ASSERT(Fil_map_file(NULL, file_path) & FIL_ERR_PARAM);
+    ASSERT(Fil_map_file(&view, NULL) & FIL_ERR_PARAM);
+    ASSERT(Fil_map_file(&view, "tests/does_not_exist.txt") == FIL_ERR_FILE_NOT_FOUND);
+
+    ASSERT(Fil_map_file(&view, file_path) == 0);
+    ASSERT(Fil_cmp_v(view, Fil_view_cstr("Hello, World!")) == FIL_CEQ);
+    ASSERT(Fil_sfstr_v(view, Fil_view_cstr("World")) == 7);
+    ASSERT(Fil_slstr_v(view, Fil_view_cstr("o")) == 8);
+    Fil_unmap_file(&view);
+    ASSERT(view.ptr == NULL && view.len == 0);
+    Fil_unmap_file(&view);
+}
+
+typedef struct {
+    unsigned long offsets[8];
+    unsigned long count;
+    unsigned long limit;
+} Stream_Matches;
+
+static int stream_match(unsigned long offset, void *ctx)
+{
+    Stream_Matches *matches = ctx;
+    if (matches->count < 8) matches->offsets[matches->count] = offset;
+    matches->count++;
+    return matches->limit && matches->count >= matches->limit;
+}
+
+void Fil_stream_search_test(void)
+{
+    const char *file_path = "tests/read_from_file.txt";
+    Stream_Matches matches = {0};
+    ASSERT(Fil_stream_search(NULL, Fil_view_cstr("o"), 0, stream_match, &matches) & FIL_ERR_PARAM);
+    ASSERT(Fil_stream_search(file_path, Fil_view(NULL), 0, stream_match, &matches) & FIL_ERR_PARAM);
+    ASSERT(Fil_stream_search(file_path, Fil_view_cstr("o"), 0, NULL, &matches) & FIL_ERR_PARAM);
+    ASSERT(Fil_stream_search("tests/does_not_exist.txt", Fil_view_cstr("o"), 0, stream_match, &matches) == FIL_ERR_FILE_NOT_FOUND);
+    ASSERT(Fil_stream_search(file_path, Fil_view_cstr("Bye"), 0, stream_match, &matches) == FIL_ERR_SEQNOTFOUND);
+    ASSERT(matches.count == 0);
+
+    ASSERT(Fil_stream_search(file_path, Fil_view_cstr("o"), 0, stream_match, &matches) == 0);
+    ASSERT(matches.count == 2 && matches.offsets[0] == 4 && matches.offsets[1] == 8);
+
+    // Matches straddling the 2 bytes chunks.
+    matches.count = 0;
+    ASSERT(Fil_stream_search(file_path, Fil_view_cstr("lo, W"), 2, stream_match, &matches) == 0);
+    ASSERT(matches.count == 1 && matches.offsets[0] == 3);
+    matches.count = 0;
+    ASSERT(Fil_stream_search(file_path, Fil_view_cstr("l"), 3, stream_match, &matches) == 0);
+    ASSERT(matches.count == 3 && matches.offsets[2] == 10);
+
+    // The callback stops the search.
+    matches.count = 0;
+    matches.limit = 1;
+    ASSERT(Fil_stream_search(file_path, Fil_view_cstr("l"), 1, stream_match, &matches) == 0);
+    ASSERT(matches.count == 1 && matches.offsets[0] == 2);
+}
 
 void Fil_read_from_file_test()
 {
@@ -252,9 +1424,301 @@ void Fil_read_from_file_test()
     Fil_read_from_file(&fil, file_path);
     ASSERT(Fil_read_from_file(NULL, file_path) & FIL_ERR_PARAM);
     ASSERT(Fil_read_from_file(&fil, NULL) & FIL_ERR_PARAM);
-    ASSERT(Fil_cmp(fil.string, "Hello, World!") == FIL_CEQ);
+    ASSERT(Fil_cmp(Fil_str(&fil), "Hello, World!") == FIL_CEQ);
 }
 void Fil_write_to_file_test()
 {
+    const char *file_path = "tests/write_to_file.txt";
+    Fil fil = {0};
+    Fil read = {0};
+    Fil_append(&fil, "Hello, World!");
+    remove(file_path);
+    ASSERT(Fil_write_to_file(NULL, file_path, 0) & FIL_ERR_PARAM);
+    ASSERT(Fil_write_to_file(&fil, NULL, 0) & FIL_ERR_PARAM);
+
+    ASSERT(Fil_write_to_file(&fil, file_path, 0) == 0);
+    Fil_read_from_file(&read, file_path);
+    ASSERT(Fil_cmp(Fil_str(&read), "Hello, World!") == FIL_CEQ);
+
+    Fil_append(&fil, " Again.");
+    ASSERT(Fil_write_to_file(&fil, file_path, 0) == FIL_ERR_OVERWRITE);
+    ASSERT(Fil_write_to_file(&fil, file_path, 1) == 0);
+    Fil_read_from_file(&read, file_path);
+    ASSERT(Fil_cmp(Fil_str(&read), "Hello, World! Again.") == FIL_CEQ);
+
+    remove(file_path);
+    Fil_free(&fil);
+    Fil_free(&read);
+}
+
+void Fil_write_views_test(void)
+{
+    const char *file_path = "tests/write_views.txt";
+    Fil fil = {0};
+    Fil read = {0};
+    Fil_append(&fil, "World");
+    Fil_View views[] = {Fil_view_cstr("Hello, "), Fil_view(NULL), Fil_view(&fil), Fil_view_cstr("!")};
+    Fil_View bad = {NULL, 1};
+    remove(file_path);
+    ASSERT(Fil_write_views(NULL, views, 4, 0) & FIL_ERR_PARAM);
+    ASSERT(Fil_write_views(file_path, NULL, 4, 0) & FIL_ERR_PARAM);
+    ASSERT(Fil_write_views(file_path, &bad, 1, 0) & FIL_ERR_PARAM);
+    ASSERT(Fil_write_views(file_path, views, 4, FIL_WRITE_ATOMIC | FIL_WRITE_APPEND) & FIL_ERR_PARAM);
+
+    ASSERT(Fil_write_views(file_path, views, 4, 0) == 0);
+    Fil_read_from_file(&read, file_path);
+    ASSERT(Fil_cmp(Fil_str(&read), "Hello, World!") == FIL_CEQ);
+
+    ASSERT(Fil_write_views(file_path, views + 3, 1, FIL_WRITE_APPEND) == 0);
+    Fil_read_from_file(&read, file_path);
+    ASSERT(Fil_cmp(Fil_str(&read), "Hello, World!!") == FIL_CEQ);
+
+    ASSERT(Fil_write_views(file_path, views + 2, 1, FIL_WRITE_ATOMIC) == FIL_ERR_OVERWRITE);
+    ASSERT(Fil_write_views(file_path, views + 2, 2, FIL_WRITE_ATOMIC | FIL_WRITE_OVERWRITE) == 0);
+    Fil_read_from_file(&read, file_path);
+    ASSERT(Fil_cmp(Fil_str(&read), "World!") == FIL_CEQ);
+
+    remove(file_path);
+    ASSERT(Fil_write_views(file_path, views, 3, FIL_WRITE_ATOMIC) == 0);
+    Fil_read_from_file(&read, file_path);
+    ASSERT(Fil_cmp(Fil_str(&read), "Hello, World") == FIL_CEQ);
+
+    // An atomic overwrite keeps the permissions of the replaced file.
+    struct stat stat_buf;
+    ASSERT(chmod(file_path, 0600) == 0);
+    ASSERT(Fil_write_views(file_path, views, 2, FIL_WRITE_ATOMIC | FIL_WRITE_OVERWRITE) == 0);
+    ASSERT(stat(file_path, &stat_buf) == 0 && (stat_buf.st_mode & 0777) == 0600);
+    ASSERT(chmod(file_path, 0755) == 0);
+    ASSERT(Fil_write_views(file_path, views, 3, FIL_WRITE_ATOMIC | FIL_WRITE_OVERWRITE) == 0);
+    ASSERT(stat(file_path, &stat_buf) == 0 && (stat_buf.st_mode & 0777) == 0755);
+    Fil_read_from_file(&read, file_path);
+    ASSERT(Fil_cmp(Fil_str(&read), "Hello, World") == FIL_CEQ);
+
+    // More views than a single writev call takes.
+    Fil_View many[200];
+    for (int i = 0; i < 200; i++) many[i] = Fil_view_cstr(i % 2 ? "b" : "a");
+    ASSERT(Fil_write_views(file_path, many, 200, FIL_WRITE_OVERWRITE) == 0);
+    Fil_read_from_file(&read, file_path);
+    ASSERT(read.len == 200);
+    ASSERT(Fil_sistr(&read, "ab", 100) == Fil_str(&read) + 198);
+
+    remove(file_path);
+    Fil_free(&fil);
+    Fil_free(&read);
+}
+
+void Fil_stats_test(void)
+{
+    Fil fil = {0};
+    Fil_Stats stats;
+
+    Fil_stats_reset();
+    Fil_append(&fil, "short");
+    Fil_append(&fil, " and a string that no longer fits inline");
+    Fil_sfchr(&fil, 'a');
+    Fil_sfstr(&fil, "missing");
+    unsigned long len = fil.len;
+    unsigned long capacity = Fil_capacity(&fil);
+    Fil_free(&fil);
+
+    Fil_stats_snapshot(&stats);
+#ifdef FIL_STATS
+    ASSERT(stats.reallocs == 1);
+    ASSERT(stats.realloc_bytes == capacity);
+    ASSERT(stats.copied == 5 + FIL_SSO_CAPACITY + 40);
+    ASSERT(stats.scanned == 7 + len);
+    ASSERT(stats.matches == 1);
+    ASSERT(stats.capacities[63 - __builtin_clzl(capacity)] == 1);
+
+    Fil_stats_reset();
+    Fil_stats_snapshot(&stats);
+    ASSERT(stats.reallocs == 0 && stats.copied == 0 && stats.scanned == 0);
+#else
+    (void)len;
+    (void)capacity;
+    ASSERT(stats.reallocs == 0 && stats.realloc_bytes == 0 && stats.copied == 0);
+    ASSERT(stats.scanned == 0 && stats.matches == 0 && stats.capacities[0] == 0);
+#endif // FIL_STATS
+}
+
+typedef struct {
+    unsigned long reallocs;
+    unsigned long frees;
+    unsigned long live;
+} Counting;
+
+static void *counting_realloc(void *context, void *ptr, unsigned long old_size, unsigned long new_size)
+{
+    Counting *counting = context;
+    counting->reallocs++;
+    counting->live += new_size - old_size;
+    return realloc(ptr, new_size);
+}
+
+static void counting_free(void *context, void *ptr, unsigned long size)
+{
+    Counting *counting = context;
+    counting->frees++;
+    counting->live -= size;
+    free(ptr);
+}
+
+void Fil_allocator_test(void)
+{
+    Counting counting = {0};
+    Fil_Allocator allocator = {counting_realloc, counting_free, &counting};
+    Fil fil = {0};
+    Fil other = {0};
+
+    ASSERT(Fil_use_allocator(NULL, &allocator) == FIL_ERR_PARAM);
+    ASSERT(Fil_use_allocator(&fil, &allocator) == 0);
+    Fil_append(&fil, "short");
+    ASSERT(counting.reallocs == 0);
+    Fil_append(&fil, " and a string that no longer fits inline");
+    ASSERT(counting.reallocs == 1);
+    ASSERT(counting.live == Fil_capacity(&fil));
+    ASSERT(Fil_use_allocator(&fil, NULL) == FIL_ERR_PARAM);
+    for (int i = 0; i < 10; i++) Fil_append(&fil, "0123456789abcdef");
+    ASSERT(counting.reallocs > 1);
+    ASSERT(counting.live == Fil_capacity(&fil));
+    ASSERT(Fil_rastr(&fil, "a", "AAAA") == 0);
+    ASSERT(counting.live == Fil_capacity(&fil));
+    ASSERT(Fil_sfstr(&fil, "short AAAAnd") == Fil_str(&fil));
+    Fil_free(&fil);
+    ASSERT(counting.live == 0);
+
+    // Global allocator, used by the Fils without their own.
+    counting.reallocs = 0;
+    counting.frees = 0;
+    Fil_set_allocator(&allocator);
+    Fil_append(&other, "a string that does not fit inline");
+    Fil_append(&fil, "another one that does not fit inline");
+    ASSERT(counting.reallocs == 2);
+    Fil_free(&other);
+    Fil_free(&fil);
+    Fil_set_allocator(NULL);
+    ASSERT(counting.live == 0);
+    ASSERT(counting.frees == 2);
+}
+
+static void *tcache_thread(void *arg)
+{
+    Fil fil = {0};
+    Fil_use_allocator(&fil, Fil_tcache_allocator());
+    for (int i = 0; i < 1000; i++)
+    {
+        Fil_append(&fil, "0123456789abcdef");
+        if (i % 100 == 99) Fil_free(&fil);
+    }
+    *(int *)arg = fil.len == 0;
+    Fil_free(&fil);
+    return NULL;
+}
+
+void Fil_tcache_test(void)
+{
+    Fil fil = {0};
+    Fil other = {0};
+    const Fil_Allocator *tcache = Fil_tcache_allocator();
+
+    Fil_use_allocator(&fil, tcache);
+    Fil_use_allocator(&other, tcache);
+    ASSERT(Fil_resize(&fil, 100) == 0);
+    char *block = Fil_str(&fil);
+    // Growing within the 128 bytes class keeps the buffer.
+    ASSERT(Fil_resize(&fil, 128) == 0);
+    ASSERT(Fil_str(&fil) == block);
+    Fil_append(&fil, "Hello, world!");
+    ASSERT(Fil_resize(&fil, 1000) == 0);
+    ASSERT(Fil_str(&fil) != block);
+    ASSERT(Fil_cmp(Fil_str(&fil), "Hello, world!") == FIL_CEQ);
+
+    // The freed 128 bytes buffer is handed out again.
+    ASSERT(Fil_resize(&other, 120) == 0);
+    ASSERT(Fil_str(&other) == block);
+    Fil_free(&other);
+
+    // Sizes past the largest class go to malloc.
+    ASSERT(Fil_resize(&fil, (1UL << FIL_TCACHE_MAX_CLASS) + 1) == 0);
+    ASSERT(Fil_cmp(Fil_str(&fil), "Hello, world!") == FIL_CEQ);
+    ASSERT(Fil_resize(&fil, (1UL << FIL_TCACHE_MAX_CLASS) * 2) == 0);
+    ASSERT(Fil_cmp(Fil_str(&fil), "Hello, world!") == FIL_CEQ);
+    Fil_free(&fil);
+
+    pthread_t threads[2];
+    int ok[2] = {0};
+    for (int t = 0; t < 2; t++) pthread_create(&threads[t], NULL, tcache_thread, &ok[t]);
+    for (int t = 0; t < 2; t++) pthread_join(threads[t], NULL);
+    ASSERT(ok[0] && ok[1]);
+
+    Fil_tcache_flush();
+}
+
+void Fil_growth_test(void)
+{
+    Fil fil = {0};
+    Fil arena_fil = {0};
+    Fil_Arena arena;
+
+    ASSERT(Fil_set_growth(NULL, FIL_GROW_EXACT, 0) == FIL_ERR_PARAM);
+    ASSERT(Fil_set_growth(&fil, FIL_GROW_STEP, 0) == FIL_ERR_PARAM);
+    ASSERT(Fil_set_growth(&fil, 3, 0) == FIL_ERR_PARAM);
+
+    ASSERT(Fil_reserve(NULL, 10) == FIL_ERR_PARAM);
+    ASSERT(Fil_reserve(&fil, 100) == 0);
+    ASSERT(Fil_capacity(&fil) == 101);
+    ASSERT(Fil_reserve(&fil, 50) == 0);
+    ASSERT(Fil_capacity(&fil) == 101);
+    Fil_append(&fil, "Hello, world!");
+    ASSERT(Fil_shrink_to_fit(NULL) == FIL_ERR_PARAM);
+    ASSERT(Fil_shrink_to_fit(&fil) == 0);
+    ASSERT(fil.is_inline);
+    ASSERT(Fil_cmp(Fil_str(&fil), "Hello, world!") == FIL_CEQ);
+
+    ASSERT(Fil_set_growth(&fil, FIL_GROW_EXACT, 0) == 0);
+    Fil_append(&fil, " A string that no longer fits inline.");
+    ASSERT(Fil_capacity(&fil) == fil.len + 1);
+    ASSERT(Fil_set_growth(&fil, FIL_GROW_STEP, 64) == 0);
+    Fil_append(&fil, "!");
+    ASSERT(Fil_capacity(&fil) == 64);
+    Fil_append(&fil, " And another sentence to reach the next step.");
+    ASSERT(Fil_capacity(&fil) == 128);
+    ASSERT(Fil_shrink_to_fit(&fil) == 0);
+    ASSERT(Fil_capacity(&fil) == fil.len + 1);
+    ASSERT(Fil_sfstr(&fil, "next step.") == Fil_str(&fil) + fil.len - 10);
+
+    // Past FIL_MMAP_THRESHOLD the string is a mapping, grown by mremap.
+    ASSERT(Fil_set_growth(&fil, FIL_GROW_GEOMETRIC, 0) == 0);
+    unsigned long len = fil.len;
+    ASSERT(Fil_reserve(&fil, FIL_MMAP_THRESHOLD) == 0);
+    ASSERT(Fil_cmp(Fil_str(&fil), "Hello, world! A string that no longer fits inline.! "
+                   "And another sentence to reach the next step.") == FIL_CEQ);
+    memset(Fil_str(&fil) + len, 'x', FIL_MMAP_THRESHOLD - len);
+    fil.len = FIL_MMAP_THRESHOLD;
+    Fil_str(&fil)[fil.len] = 0;
+    Fil_append(&fil, "end");
+    ASSERT(Fil_capacity(&fil) == (FIL_MMAP_THRESHOLD + 1) * 2);
+    ASSERT(Fil_slstr(&fil, "xend") == Fil_str(&fil) + FIL_MMAP_THRESHOLD - 1);
+    ASSERT(Fil_sfstr(&fil, "Hello") == Fil_str(&fil));
+    ASSERT(Fil_shrink_to_fit(&fil) == 0);
+    ASSERT(Fil_capacity(&fil) == FIL_MMAP_THRESHOLD + 4);
+    ASSERT(Fil_slstr(&fil, "xend") == Fil_str(&fil) + FIL_MMAP_THRESHOLD - 1);
+
+    // Back under the threshold the string returns to malloc.
+    fil.len = 100;
+    Fil_str(&fil)[fil.len] = 0;
+    ASSERT(Fil_shrink_to_fit(&fil) == 0);
+    ASSERT(Fil_capacity(&fil) == 101);
+    ASSERT(Fil_sfstr(&fil, "Hello") == Fil_str(&fil));
+    Fil_free(&fil);
 
+    // Arena strings shrink in place when they are the last allocation.
+    Fil_arena_init(&arena, 0);
+    Fil_arena_attach(&arena, &arena_fil);
+    ASSERT(Fil_reserve(&arena_fil, 1000) == 0);
+    Fil_append(&arena_fil, "An arena string that does not fit inline");
+    ASSERT(Fil_shrink_to_fit(&arena_fil) == 0);
+    ASSERT(Fil_capacity(&arena_fil) == arena_fil.len + 1);
+    ASSERT(Fil_cmp(Fil_str(&arena_fil), "An arena string that does not fit inline") == FIL_CEQ);
+    Fil_arena_free(&arena);
 }